@@ -0,0 +1,531 @@
+
+// MIT License
+//
+// Copyright (c) 2019 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Benchmarks the LZ4 stream implementations in the tree, and ZstdOStream for reference: compression and decompression MB/s,
+// ratio, heap allocations and p50/p99 latency of a single write or read call, over payload sizes (bytes per call),
+// compression levels, and with raw writes or through a cereal archive. The implementations (and
+// cereal) that are not on the include path are skipped. "sf::LZ4OStream no bulk" is sf::LZ4OStream with every write and read
+// cut into calls of less than its buffers, which takes the copying path through the put and get areas, against the bulk
+// path of the large payloads. On Linux:
+//
+//     g++ -std=c++17 -O3 -DNDEBUG -pthread -I cstreams cstreams/Benchmark/LZ4Benchmark.cpp cstreams/LZ4Stream.cpp
+//         cstreams/ZstdStream.cpp -l:liblz4.a -lzstd -o lz4_benchmark
+//     ./lz4_benchmark [--size MB] [--repeat N] [--csv] [file ...]
+//
+// LZ4 must be linked statically, the shared library doesn't export the static-only API (LZ4F_createCDict,
+// LZ4F_uncompressedUpdate, LZ4_attach_dictionary, ...) that LZ4Stream.cpp uses. zstd is needed by ZstdStream.cpp and by the
+// dictionary trainer.
+//
+// Without files the corpora are synthetic and generated from a fixed seed, so runs are reproducible.
+//
+// Dictionaries pay off on small independent payloads, which have no history of their own to match against, so they are
+// measured on their own: the corpus is cut into payloads of 256 B, 1 KB and 4 KB, packed by LZ4BatchCompressor (one thread)
+// and read back by LZ4BatchReader, without and with a dictionary. The dictionary is trained (LZ4DictionaryTrainer) on the
+// last TRAINING_SIZE bytes of the corpus, which are not part of the payloads.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Extensions/LZ4Stream.h"
+#include "Extensions/ZstdStream.h"
+
+#if __has_include( <cereal/archives/binary.hpp>)
+#    include <cereal/archives/binary.hpp>
+#    include <cereal/cereal.hpp>
+#    define LZ4_BENCHMARK_CEREAL 1
+#endif
+#if __has_include( <compressed_streams/lz4_stream.h>)
+#    include <compressed_streams/lz4_stream.h>
+#    define LZ4_BENCHMARK_COMPRESSED_STREAMS 1
+#endif
+#if __has_include( <lz4stream.hpp>)
+#    include <lz4stream.hpp>
+#    define LZ4_BENCHMARK_LZ4_STREAM 1
+#endif
+
+namespace fs = std::filesystem;
+
+// Counts all heap allocations of the process.
+static std::atomic<std::uint64_t> g_allocations{ 0u };
+
+void * operator new ( std::size_t size_ ) {
+    g_allocations.fetch_add ( 1u, std::memory_order_relaxed );
+    if ( void * p = std::malloc ( size_ ? size_ : 1u ) )
+        return p;
+    throw std::bad_alloc ( );
+}
+void operator delete ( void * p_ ) noexcept { std::free ( p_ ); }
+void operator delete ( void * p_, std::size_t ) noexcept { std::free ( p_ ); }
+
+namespace {
+
+// Writes to a preallocated buffer, so the sink doesn't allocate while measuring.
+class MemorySink final : public std::streambuf {
+    public:
+    explicit MemorySink ( std::size_t const capacity_ ) { m_data.reserve ( capacity_ ); }
+
+    [[nodiscard]] std::vector<char> const & data ( ) const noexcept { return m_data; }
+
+    protected:
+    [[nodiscard]] virtual std::streamsize xsputn ( char_type const * s_, std::streamsize n_ ) override {
+        m_data.insert ( m_data.end ( ), s_, s_ + n_ );
+        return n_;
+    }
+    [[nodiscard]] virtual int_type overflow ( int_type ch_ ) override {
+        if ( not traits_type::eq_int_type ( ch_, traits_type::eof ( ) ) )
+            m_data.push_back ( traits_type::to_char_type ( ch_ ) );
+        return traits_type::not_eof ( ch_ );
+    }
+
+    private:
+    std::vector<char> m_data;
+};
+
+// Reads from a buffer.
+class MemorySource final : public std::streambuf {
+    public:
+    explicit MemorySource ( std::vector<char> const & data_ ) {
+        char * const begin = const_cast<char *> ( data_.data ( ) );
+        setg ( begin, begin, begin + data_.size ( ) );
+    }
+
+    protected:
+    [[nodiscard]] virtual pos_type seekoff ( off_type off_, std::ios_base::seekdir dir_, std::ios_base::openmode ) override {
+        char * const target = ( std::ios_base::beg == dir_ ? eback ( ) : std::ios_base::cur == dir_ ? gptr ( ) : egptr ( ) ) + off_;
+        if ( target < eback ( ) or target > egptr ( ) )
+            return pos_type ( off_type ( -1 ) );
+        setg ( eback ( ), target, egptr ( ) );
+        return pos_type ( off_type ( target - eback ( ) ) );
+    }
+    [[nodiscard]] virtual pos_type seekpos ( pos_type pos_, std::ios_base::openmode which_ ) override {
+        return seekoff ( off_type ( pos_ ), std::ios_base::beg, which_ );
+    }
+};
+
+struct Corpus {
+    std::string name;
+    std::vector<char> data;
+    std::vector<char> training; // Dictionary training sample, not part of data.
+};
+
+// Of the dictionary training sample, and of the payloads of the dictionary table, cut from the front of the corpus.
+constexpr std::size_t TRAINING_SIZE   = 4u * 1024u * 1024u;
+constexpr std::size_t DICTIONARY_DATA = 8u * 1024u * 1024u;
+
+// Moves the last TRAINING_SIZE bytes (at most a quarter) of the corpus to its training sample.
+[[nodiscard]] Corpus split_training ( Corpus corpus_ ) {
+    std::size_t const size = std::min ( TRAINING_SIZE, corpus_.data.size ( ) / 4u );
+    corpus_.training.assign ( corpus_.data.end ( ) - size, corpus_.data.end ( ) );
+    corpus_.data.resize ( corpus_.data.size ( ) - size );
+    return corpus_;
+}
+
+// Text-like data, words drawn from a skewed distribution over a small vocabulary.
+[[nodiscard]] Corpus make_text ( std::size_t const size_ ) {
+    std::mt19937_64 rng ( 0x5EED );
+    std::vector<std::string> words;
+    for ( int i = 0; i < 2048; ++i ) {
+        std::string word ( 2 + rng ( ) % 9, ' ' );
+        for ( char & c : word )
+            c = static_cast<char> ( 'a' + rng ( ) % 26 );
+        words.push_back ( std::move ( word ) );
+    }
+    std::geometric_distribution<std::size_t> pick ( 0.01 );
+    Corpus corpus{ "text", {} };
+    corpus.data.reserve ( size_ + 16u );
+    while ( corpus.data.size ( ) < size_ ) {
+        std::string const & word = words[ std::min<std::size_t> ( pick ( rng ), words.size ( ) - 1 ) ];
+        corpus.data.insert ( corpus.data.end ( ), word.begin ( ), word.end ( ) );
+        corpus.data.push_back ( rng ( ) % 12 ? ' ' : '\n' );
+    }
+    corpus.data.resize ( size_ );
+    return corpus;
+}
+
+// Records of small, slowly changing integers, as a serialized simulation state would look.
+[[nodiscard]] Corpus make_records ( std::size_t const size_ ) {
+    std::mt19937_64 rng ( 0x5EED + 1 );
+    Corpus corpus{ "records", std::vector<char> ( size_ ) };
+    std::int32_t values[ 16 ]{};
+    for ( std::size_t i = 0u; i + sizeof ( values ) <= size_; i += sizeof ( values ) ) {
+        for ( std::int32_t & value : values )
+            value += static_cast<std::int32_t> ( rng ( ) % 5 ) - 2;
+        std::memcpy ( corpus.data.data ( ) + i, values, sizeof ( values ) );
+    }
+    return corpus;
+}
+
+// Uniformly random bytes, incompressible.
+[[nodiscard]] Corpus make_random ( std::size_t const size_ ) {
+    std::mt19937_64 rng ( 0x5EED + 2 );
+    Corpus corpus{ "random", std::vector<char> ( size_ ) };
+    for ( char & c : corpus.data )
+        c = static_cast<char> ( rng ( ) );
+    return corpus;
+}
+
+[[nodiscard]] Corpus load_file ( fs::path const & path_, std::size_t const size_ ) {
+    std::ifstream file ( path_, std::ios::binary );
+    if ( not file )
+        throw std::runtime_error ( "Failed to open file." );
+    Corpus corpus{ path_.filename ( ).string ( ), std::vector<char> ( size_ ) };
+    file.read ( corpus.data.data ( ), corpus.data.size ( ) );
+    corpus.data.resize ( static_cast<std::size_t> ( file.gcount ( ) ) );
+    return corpus;
+}
+
+// An implementation under test, streams are created over the given stream buffer.
+struct Implementation {
+    std::string name;
+    bool has_levels;
+    std::function<std::unique_ptr<std::ostream> ( std::ostream &, int )> make_ostream;
+    std::function<std::unique_ptr<std::istream> ( std::istream & )> make_istream;
+    std::size_t max_call = 0u; // Raw writes and reads are cut into calls of at most this many bytes, 0 == whole payloads.
+};
+
+[[nodiscard]] std::vector<Implementation> implementations ( ) {
+    std::vector<Implementation> list;
+    list.push_back ( { "sf::LZ4OStream", true,
+                       [] ( std::ostream & sink_, int level_ ) {
+                           return std::unique_ptr<std::ostream> ( std::make_unique<sf::LZ4OStream> ( sink_, level_ ) );
+                       },
+                       [] ( std::istream & source_ ) {
+                           return std::unique_ptr<std::istream> ( std::make_unique<sf::LZ4IStream> ( source_ ) );
+                       } } );
+    // Less than the read area (4096 bytes) and the write area (a block), so no call takes the bulk path.
+    list.push_back ( { "sf::LZ4OStream no bulk", true,
+                       [] ( std::ostream & sink_, int level_ ) {
+                           return std::unique_ptr<std::ostream> ( std::make_unique<sf::LZ4OStream> ( sink_, level_ ) );
+                       },
+                       [] ( std::istream & source_ ) {
+                           return std::unique_ptr<std::istream> ( std::make_unique<sf::LZ4IStream> ( source_ ) );
+                       },
+                       4095u } );
+    list.push_back ( { "sf::LZ4OutputStream", true,
+                       [] ( std::ostream & sink_, int level_ ) {
+                           return std::unique_ptr<std::ostream> ( std::make_unique<sf::LZ4OutputStream> ( sink_, level_ ) );
+                       },
+                       [] ( std::istream & source_ ) {
+                           return std::unique_ptr<std::istream> ( std::make_unique<sf::LZ4InputStream> ( source_ ) );
+                       } } );
+    list.push_back ( { "sf::ZstdOStream", true,
+                       [] ( std::ostream & sink_, int level_ ) {
+                           sf::ZstdOptions options;
+                           options.compression_level = level_;
+                           return std::unique_ptr<std::ostream> ( std::make_unique<sf::ZstdOStream> ( sink_, options ) );
+                       },
+                       [] ( std::istream & source_ ) {
+                           return std::unique_ptr<std::istream> ( std::make_unique<sf::ZstdIStream> ( source_ ) );
+                       } } );
+#ifdef LZ4_BENCHMARK_COMPRESSED_STREAMS
+    list.push_back ( { "compressed_streams::Lz4", true,
+                       [] ( std::ostream & sink_, int level_ ) {
+                           return std::unique_ptr<std::ostream> (
+                               std::make_unique<compressed_streams::Lz4OStream> ( sink_, level_ ) );
+                       },
+                       [] ( std::istream & source_ ) {
+                           return std::unique_ptr<std::istream> ( std::make_unique<compressed_streams::Lz4IStream> ( source_ ) );
+                       } } );
+#endif
+#ifdef LZ4_BENCHMARK_LZ4_STREAM
+    list.push_back ( { "lz4_stream", false,
+                       [] ( std::ostream & sink_, int ) {
+                           return std::unique_ptr<std::ostream> ( std::make_unique<lz4_stream::ostream> ( sink_ ) );
+                       },
+                       [] ( std::istream & source_ ) {
+                           return std::unique_ptr<std::istream> ( std::make_unique<lz4_stream::istream> ( source_ ) );
+                       } } );
+#endif
+    return list;
+}
+
+using Clock = std::chrono::steady_clock;
+
+// Latencies of single calls, in nanoseconds.
+struct Latencies {
+    std::vector<std::uint64_t> samples;
+
+    void add ( Clock::time_point const start_ ) {
+        samples.push_back ( static_cast<std::uint64_t> (
+            std::chrono::duration_cast<std::chrono::nanoseconds> ( Clock::now ( ) - start_ ).count ( ) ) );
+    }
+    [[nodiscard]] double percentile ( double const p_ ) {
+        if ( samples.empty ( ) )
+            return 0.0;
+        std::size_t const i = std::min ( samples.size ( ) - 1u, static_cast<std::size_t> ( p_ * samples.size ( ) ) );
+        std::nth_element ( samples.begin ( ), samples.begin ( ) + i, samples.end ( ) );
+        return static_cast<double> ( samples[ i ] );
+    }
+};
+
+struct Result {
+    double compress_mbs = 0.0, decompress_mbs = 0.0, ratio = 0.0;
+    std::uint64_t compress_allocations = 0u, decompress_allocations = 0u;
+    double write_p50 = 0.0, write_p99 = 0.0, read_p50 = 0.0, read_p99 = 0.0;
+    bool ok = true;
+};
+
+[[nodiscard]] double mbs ( std::size_t const bytes_, Clock::duration const duration_ ) {
+    return bytes_ / ( 1024.0 * 1024.0 ) / std::chrono::duration<double> ( duration_ ).count ( );
+}
+
+// The payload is written and read in calls of payload_ bytes, through a cereal archive if cereal_.
+[[nodiscard]] Result run ( Implementation const & implementation_, Corpus const & corpus_, std::size_t const payload_,
+                           int const level_, [[maybe_unused]] bool const cereal_,
+                           int const repeat_ ) {
+    Result result;
+    std::size_t const size = corpus_.data.size ( );
+    std::size_t const call = implementation_.max_call ? implementation_.max_call : payload_;
+    std::vector<char> compressed;
+    Clock::duration best_compress = Clock::duration::max ( ), best_decompress = Clock::duration::max ( );
+    std::vector<char> output ( size );
+    for ( int r = 0; r < repeat_; ++r ) {
+        Latencies writes, reads;
+        MemorySink sink ( size + size / 8u + 4096u );
+        std::ostream sink_stream ( &sink );
+        std::uint64_t allocations = g_allocations.load ( );
+        Clock::time_point start   = Clock::now ( );
+        {
+            std::unique_ptr<std::ostream> stream = implementation_.make_ostream ( sink_stream, level_ );
+#ifdef LZ4_BENCHMARK_CEREAL
+            std::unique_ptr<cereal::BinaryOutputArchive> archive;
+            if ( cereal_ )
+                archive = std::make_unique<cereal::BinaryOutputArchive> ( *stream );
+#endif
+            for ( std::size_t i = 0u; i < size; i += payload_ ) {
+                std::size_t const n        = std::min ( payload_, size - i );
+                Clock::time_point const at = Clock::now ( );
+#ifdef LZ4_BENCHMARK_CEREAL
+                if ( cereal_ )
+                    ( *archive ) ( cereal::binary_data ( corpus_.data.data ( ) + i, n ) );
+                else
+#endif
+                    for ( std::size_t j = 0u; j < n; j += call )
+                        stream->write ( corpus_.data.data ( ) + i + j, std::min ( call, n - j ) );
+                writes.add ( at );
+            }
+        }
+        best_compress               = std::min ( best_compress, Clock::now ( ) - start );
+        result.compress_allocations = g_allocations.load ( ) - allocations;
+        compressed                  = sink.data ( );
+
+        MemorySource source ( compressed );
+        std::istream source_stream ( &source );
+        allocations = g_allocations.load ( );
+        start       = Clock::now ( );
+        {
+            std::unique_ptr<std::istream> stream = implementation_.make_istream ( source_stream );
+#ifdef LZ4_BENCHMARK_CEREAL
+            std::unique_ptr<cereal::BinaryInputArchive> archive;
+            if ( cereal_ )
+                archive = std::make_unique<cereal::BinaryInputArchive> ( *stream );
+#endif
+            for ( std::size_t i = 0u; i < size; i += payload_ ) {
+                std::size_t const n        = std::min ( payload_, size - i );
+                Clock::time_point const at = Clock::now ( );
+#ifdef LZ4_BENCHMARK_CEREAL
+                if ( cereal_ )
+                    ( *archive ) ( cereal::binary_data ( output.data ( ) + i, n ) );
+                else
+#endif
+                    for ( std::size_t j = 0u; j < n; j += call )
+                        stream->read ( output.data ( ) + i + j, std::min ( call, n - j ) );
+                reads.add ( at );
+            }
+        }
+        best_decompress               = std::min ( best_decompress, Clock::now ( ) - start );
+        result.decompress_allocations = g_allocations.load ( ) - allocations;
+        result.ok                     = result.ok and output == corpus_.data;
+
+        result.write_p50 = writes.percentile ( 0.50 );
+        result.write_p99 = writes.percentile ( 0.99 );
+        result.read_p50  = reads.percentile ( 0.50 );
+        result.read_p99  = reads.percentile ( 0.99 );
+    }
+    result.compress_mbs   = mbs ( size, best_compress );
+    result.decompress_mbs = mbs ( size, best_decompress );
+    result.ratio          = compressed.empty ( ) ? 0.0 : static_cast<double> ( size ) / compressed.size ( );
+    return result;
+}
+
+// The front of the corpus is cut into payloads of payload_ bytes, packed into one container and read back one by one.
+[[nodiscard]] Result run_dictionary ( Corpus const & corpus_, std::size_t const payload_, int const level_,
+                                      sf::LZ4Dictionary const * dictionary_, int const repeat_ ) {
+    Result result;
+    std::size_t const size = std::min ( corpus_.data.size ( ), DICTIONARY_DATA );
+    std::vector<sf::LZ4Payload> payloads;
+    for ( std::size_t i = 0u; i < size; i += payload_ )
+        payloads.push_back ( { corpus_.data.data ( ) + i, std::min ( payload_, size - i ) } );
+    sf::LZ4ParallelOptions parallel;
+    parallel.threads = 1u;
+    std::unique_ptr<sf::LZ4BatchCompressor> compressor =
+        dictionary_ ? std::make_unique<sf::LZ4BatchCompressor> ( *dictionary_, level_, parallel )
+                    : std::make_unique<sf::LZ4BatchCompressor> ( level_, parallel );
+    std::vector<char> container, output ( size );
+    Clock::duration best_compress = Clock::duration::max ( ), best_decompress = Clock::duration::max ( );
+    for ( int r = 0; r < repeat_; ++r ) {
+        std::uint64_t allocations = g_allocations.load ( );
+        Clock::time_point start   = Clock::now ( );
+        compressor->pack ( payloads.data ( ), payloads.size ( ), container );
+        best_compress               = std::min ( best_compress, Clock::now ( ) - start );
+        result.compress_allocations = g_allocations.load ( ) - allocations;
+
+        allocations = g_allocations.load ( );
+        start       = Clock::now ( );
+        {
+            std::unique_ptr<sf::LZ4BatchReader> reader =
+                dictionary_ ? std::make_unique<sf::LZ4BatchReader> ( container.data ( ), container.size ( ), *dictionary_ )
+                            : std::make_unique<sf::LZ4BatchReader> ( container.data ( ), container.size ( ) );
+            for ( std::size_t i = 0u; i < reader->size ( ); ++i )
+                reader->read ( i, output.data ( ) + i * payload_ );
+        }
+        best_decompress               = std::min ( best_decompress, Clock::now ( ) - start );
+        result.decompress_allocations = g_allocations.load ( ) - allocations;
+        result.ok = result.ok and std::equal ( output.begin ( ), output.end ( ), corpus_.data.begin ( ) );
+    }
+    result.compress_mbs   = mbs ( size, best_compress );
+    result.decompress_mbs = mbs ( size, best_decompress );
+    result.ratio          = container.empty ( ) ? 0.0 : static_cast<double> ( size ) / container.size ( );
+    return result;
+}
+
+// Trained on the training sample of the corpus, cut into samples of payload_ bytes, nullptr if training fails (as it does on
+// incompressible data).
+[[nodiscard]] std::unique_ptr<sf::LZ4Dictionary> train ( Corpus const & corpus_, std::size_t const payload_ ) {
+    sf::LZ4DictionaryTrainer trainer ( corpus_.training.size ( ) );
+    for ( std::size_t i = 0u; i < corpus_.training.size ( ); i += payload_ )
+        trainer.addSample ( corpus_.training.data ( ) + i, std::min ( payload_, corpus_.training.size ( ) - i ) );
+    try {
+        return std::make_unique<sf::LZ4Dictionary> ( trainer.train ( ) );
+    }
+    catch ( std::exception const & ) {
+        return nullptr;
+    }
+}
+
+} // namespace
+
+int main ( int argc, char ** argv ) {
+    std::size_t size = 64u * 1024u * 1024u;
+    int repeat       = 3;
+    bool csv         = false;
+    std::vector<fs::path> files;
+    for ( int i = 1; i < argc; ++i ) {
+        std::string const arg = argv[ i ];
+        if ( "--size" == arg and i + 1 < argc )
+            size = std::stoul ( argv[ ++i ] ) * 1024u * 1024u;
+        else if ( "--repeat" == arg and i + 1 < argc )
+            repeat = std::max ( 1, std::stoi ( argv[ ++i ] ) );
+        else if ( "--csv" == arg )
+            csv = true;
+        else
+            files.emplace_back ( arg );
+    }
+
+    std::vector<Corpus> corpora;
+    if ( files.empty ( ) ) {
+        corpora.push_back ( split_training ( make_text ( size + TRAINING_SIZE ) ) );
+        corpora.push_back ( split_training ( make_records ( size + TRAINING_SIZE ) ) );
+        corpora.push_back ( split_training ( make_random ( size + TRAINING_SIZE ) ) );
+    }
+    for ( fs::path const & file : files )
+        corpora.push_back ( split_training ( load_file ( file, size + TRAINING_SIZE ) ) );
+
+    std::size_t const payloads[] = { 64u, 4u * 1024u, 1024u * 1024u, 64u * 1024u * 1024u };
+    int const levels[]           = { sf::LZ4OStream::BEST_SPEED, sf::LZ4OStream::BEST_COMPRESSION };
+    bool const cereals[]         = {
+        false,
+#ifdef LZ4_BENCHMARK_CEREAL
+        true,
+#endif
+    };
+
+    if ( csv )
+        std::printf ( "corpus,implementation,payload,level,cereal,compress_mbs,decompress_mbs,ratio,compress_allocations,"
+                      "decompress_allocations,write_p50_ns,write_p99_ns,read_p50_ns,read_p99_ns,ok\n" );
+    else
+        std::printf ( "%-10s %-26s %8s %5s %6s %9s %9s %6s %8s %8s %9s %9s %9s %9s\n", "corpus", "implementation", "payload",
+                      "level", "cereal", "comp MB/s", "dec MB/s", "ratio", "c alloc", "d alloc", "w p50 ns", "w p99 ns",
+                      "r p50 ns", "r p99 ns" );
+    bool ok = true;
+    for ( Corpus const & corpus : corpora )
+        for ( Implementation const & implementation : implementations ( ) )
+            for ( std::size_t const payload : payloads )
+                for ( int const level : levels ) {
+                    if ( not implementation.has_levels and level != levels[ 0 ] )
+                        continue;
+                    for ( bool const cereal : cereals ) {
+                        Result const r = run ( implementation, corpus, payload, level, cereal, repeat );
+                        ok             = ok and r.ok;
+                        std::printf ( csv ? "%s,%s,%zu,%d,%d,%.1f,%.1f,%.3f,%llu,%llu,%.0f,%.0f,%.0f,%.0f,%s\n"
+                                          : "%-10s %-26s %8zu %5d %6d %9.1f %9.1f %6.3f %8llu %8llu %9.0f %9.0f %9.0f %9.0f%s\n",
+                                      corpus.name.c_str ( ), implementation.name.c_str ( ), payload, level, int{ cereal },
+                                      r.compress_mbs, r.decompress_mbs, r.ratio,
+                                      static_cast<unsigned long long> ( r.compress_allocations ),
+                                      static_cast<unsigned long long> ( r.decompress_allocations ), r.write_p50, r.write_p99,
+                                      r.read_p50, r.read_p99, csv ? ( r.ok ? "1" : "0" ) : ( r.ok ? "" : "  MISMATCH" ) );
+                    }
+                }
+
+    std::size_t const small_payloads[] = { 256u, 1024u, 4u * 1024u };
+    if ( csv )
+        std::printf ( "\ncorpus,payload,level,dictionary,compress_mbs,decompress_mbs,ratio,compress_allocations,"
+                      "decompress_allocations,ok\n" );
+    else
+        std::printf ( "\n%-10s %8s %5s %4s %9s %9s %6s %8s %8s\n", "corpus", "payload", "level", "dict", "comp MB/s", "dec MB/s",
+                      "ratio", "c alloc", "d alloc" );
+    for ( Corpus const & corpus : corpora )
+        for ( std::size_t const payload : small_payloads ) {
+            std::unique_ptr<sf::LZ4Dictionary> const dictionary = train ( corpus, payload );
+            for ( int const level : levels )
+                for ( bool const with_dictionary : { false, true } ) {
+                    if ( with_dictionary and not dictionary )
+                        continue;
+                    Result const r = run_dictionary ( corpus, payload, level, with_dictionary ? dictionary.get ( ) : nullptr, repeat );
+                    ok             = ok and r.ok;
+                    std::printf ( csv ? "%s,%zu,%d,%d,%.1f,%.1f,%.3f,%llu,%llu,%s\n"
+                                      : "%-10s %8zu %5d %4d %9.1f %9.1f %6.3f %8llu %8llu%s\n",
+                                  corpus.name.c_str ( ), payload, level, int{ with_dictionary }, r.compress_mbs, r.decompress_mbs,
+                                  r.ratio, static_cast<unsigned long long> ( r.compress_allocations ),
+                                  static_cast<unsigned long long> ( r.decompress_allocations ),
+                                  csv ? ( r.ok ? "1" : "0" ) : ( r.ok ? "" : "  MISMATCH" ) );
+                }
+        }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
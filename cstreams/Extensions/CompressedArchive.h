@@ -0,0 +1,463 @@
+// MIT License
+//
+// Copyright (c) 2019 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cereal/cereal.hpp>
+
+#include "CompressedStream.h"
+#include "LZ4Stream.h"
+#include "ZstdStream.h"
+
+namespace sf {
+
+// Binary cereal archives that own the compressed stream buffer, so every field is copied straight into the write area (or
+// out of the read area) without a std::ostream (std::istream), a sentry or a virtual call. Contiguous ranges of arithmetic
+// types (cereal::BinaryData) take one copy, or none when they don't fit the write (read) area. The format is the one of
+// cereal::BinaryOutputArchive, compressed, so it can be read back with cereal::BinaryInputArchive over a decompressing
+// stream and vice versa.
+template<typename Codec>
+class CompressedOutputArchive : public cereal::OutputArchive<CompressedOutputArchive<Codec>, cereal::AllowEmptyClassElision> {
+    public:
+    using Options    = typename Codec::Options;
+    using Dictionary = typename Codec::Dictionary;
+
+    CompressedOutputArchive ( std::ostream & stream_, Options const & options_ = Options ( ) ) :
+        cereal::OutputArchive<CompressedOutputArchive<Codec>, cereal::AllowEmptyClassElision> ( this ),
+        m_buffer ( stream_.rdbuf ( ), options_ ) {}
+    CompressedOutputArchive ( std::ostream & stream_, Dictionary const & dictionary_, Options const & options_ = Options ( ) ) :
+        cereal::OutputArchive<CompressedOutputArchive<Codec>, cereal::AllowEmptyClassElision> ( this ),
+        m_buffer ( stream_.rdbuf ( ), options_, &dictionary_ ) {}
+
+    // Ends the frame, the destructor does this too, but can't report failure.
+    void close ( ) { m_buffer.close ( ); }
+
+    void saveBinary ( void const * data_, std::streamsize size_ ) {
+        m_buffer.write ( static_cast<char const *> ( data_ ), static_cast<std::size_t> ( size_ ) );
+    }
+
+    private:
+    CompressedOStreamBuf<Codec> m_buffer;
+};
+
+template<typename Codec>
+class CompressedInputArchive : public cereal::InputArchive<CompressedInputArchive<Codec>, cereal::AllowEmptyClassElision> {
+    public:
+    using Options    = typename Codec::Options;
+    using Dictionary = typename Codec::Dictionary;
+
+    CompressedInputArchive ( std::istream & stream_, Options const & options_ = Options ( ) ) :
+        cereal::InputArchive<CompressedInputArchive<Codec>, cereal::AllowEmptyClassElision> ( this ),
+        m_buffer ( stream_.rdbuf ( ), options_ ) {}
+    CompressedInputArchive ( std::istream & stream_, Dictionary const & dictionary_, Options const & options_ = Options ( ) ) :
+        cereal::InputArchive<CompressedInputArchive<Codec>, cereal::AllowEmptyClassElision> ( this ),
+        m_buffer ( stream_.rdbuf ( ), options_, &dictionary_ ) {}
+
+    void loadBinary ( void * const data_, std::streamsize size_ ) {
+        std::size_t const read_size = m_buffer.read ( static_cast<char *> ( data_ ), static_cast<std::size_t> ( size_ ) );
+        if ( read_size != static_cast<std::size_t> ( size_ ) )
+            throw cereal::Exception ( "Failed to read " + std::to_string ( size_ ) + " bytes from input stream! Read " +
+                                      std::to_string ( read_size ) );
+    }
+
+    private:
+    CompressedIStreamBuf<Codec> m_buffer;
+};
+
+using LZ4OutputArchive  = CompressedOutputArchive<LZ4FrameCodec>;
+using LZ4InputArchive   = CompressedInputArchive<LZ4FrameCodec>;
+using ZstdOutputArchive = CompressedOutputArchive<ZstdCodec>;
+using ZstdInputArchive  = CompressedInputArchive<ZstdCodec>;
+
+// The chunk directory of a chunked archive, a skippable frame (of LZ4 and zstd alike) of the layout:
+//
+//     magic (FRAME_MAGIC), frame size, entries ( compressed size, record count ) ... , entry count, MAGIC
+//
+// Sizes and counts are 64 bits, all other fields 32 bits, all little endian. It follows the last chunk, chunk i starts where
+// chunk i - 1 ends, the first chunk where the archive starts.
+struct ChunkDirectory {
+    static constexpr std::uint32_t FRAME_MAGIC = 0x184D2A5Du; // Skippable, 0xE is taken by the index of LZ4SeekableOStream.
+    static constexpr std::uint32_t MAGIC       = 0x4B4E4843u; // "CHNK".
+    // A bound on the records of a chunk per compressed byte, no codec compresses a record (a byte at least, once serialized)
+    // that well. A directory that claims more is corrupt, and is rejected before the records are allocated.
+    static constexpr std::uint64_t MAX_RECORDS_PER_BYTE = 64u * 1024u;
+
+    struct Entry {
+        std::uint64_t size = 0u, records = 0u;
+    };
+
+    std::vector<Entry> entries;
+
+    [[nodiscard]] std::vector<char> serialize ( ) const {
+        std::vector<char> frame ( 8u + 16u * entries.size ( ) + 8u );
+        write32 ( frame.data ( ), FRAME_MAGIC );
+        write32 ( frame.data ( ) + 4, static_cast<std::uint32_t> ( frame.size ( ) - 8u ) );
+        char * p = frame.data ( ) + 8;
+        for ( Entry const & entry : entries ) {
+            write64 ( p, entry.size );
+            write64 ( p + 8, entry.records );
+            p += 16;
+        }
+        write32 ( p, static_cast<std::uint32_t> ( entries.size ( ) ) );
+        write32 ( p + 4, MAGIC );
+        return frame;
+    }
+
+    // Loads the directory at the end of [ data_, data_ + size_ ), returns the size of the frame, throws if there's none.
+    std::size_t load ( char const * data_, std::size_t const size_ ) {
+        if ( size_ < 16u or MAGIC != read32 ( data_ + size_ - 4u ) )
+            throw std::runtime_error ( "Error during chunked archive loading, no chunk directory" );
+        std::uint64_t const count      = read32 ( data_ + size_ - 8u );
+        std::uint64_t const frame_size = 8u + 16u * count + 8u;
+        if ( size_ < frame_size )
+            throw std::runtime_error ( "Error during chunked archive loading, corrupt chunk directory" );
+        char const * const frame = data_ + ( size_ - frame_size );
+        if ( FRAME_MAGIC != read32 ( frame ) or frame_size - 8u != read32 ( frame + 4 ) )
+            throw std::runtime_error ( "Error during chunked archive loading, corrupt chunk directory" );
+        entries.resize ( count );
+        char const * p = frame + 8;
+        for ( Entry & entry : entries ) {
+            entry = { read64 ( p ), read64 ( p + 8 ) };
+            p += 16;
+        }
+        return static_cast<std::size_t> ( frame_size );
+    }
+
+    private:
+    [[nodiscard]] static std::uint32_t read32 ( char const * src_ ) noexcept {
+        unsigned char const * const p = reinterpret_cast<unsigned char const *> ( src_ );
+        return std::uint32_t{ p[ 0 ] } | std::uint32_t{ p[ 1 ] } << 8 | std::uint32_t{ p[ 2 ] } << 16 | std::uint32_t{ p[ 3 ] } << 24;
+    }
+    [[nodiscard]] static std::uint64_t read64 ( char const * src_ ) noexcept {
+        return std::uint64_t{ read32 ( src_ ) } | std::uint64_t{ read32 ( src_ + 4 ) } << 32;
+    }
+    static void write32 ( char * dest_, std::uint32_t const value_ ) noexcept {
+        for ( int i = 0; i < 4; ++i )
+            dest_[ i ] = static_cast<char> ( value_ >> ( 8 * i ) );
+    }
+    static void write64 ( char * dest_, std::uint64_t const value_ ) noexcept {
+        write32 ( dest_, static_cast<std::uint32_t> ( value_ ) );
+        write32 ( dest_ + 4, static_cast<std::uint32_t> ( value_ >> 32 ) );
+    }
+};
+
+// Forwards to a stream buffer and counts what it writes, it tells the chunked archive where its chunks end.
+class ChunkCountingBuf final : public std::streambuf {
+    public:
+    explicit ChunkCountingBuf ( std::streambuf * sink_ ) noexcept : m_sink ( sink_ ) {}
+
+    [[nodiscard]] std::uint64_t count ( ) const noexcept { return m_count; }
+
+    protected:
+    [[nodiscard]] virtual int_type overflow ( int_type ch ) override {
+        if ( traits_type::eq_int_type ( ch, traits_type::eof ( ) ) )
+            return traits_type::not_eof ( ch );
+        if ( traits_type::eq_int_type ( m_sink->sputc ( traits_type::to_char_type ( ch ) ), traits_type::eof ( ) ) )
+            return traits_type::eof ( );
+        ++m_count;
+        return ch;
+    }
+
+    [[nodiscard]] virtual std::streamsize xsputn ( char_type const * s_, std::streamsize n_ ) override {
+        std::streamsize const written = m_sink->sputn ( s_, n_ );
+        m_count += static_cast<std::uint64_t> ( written );
+        return written;
+    }
+
+    [[nodiscard]] virtual int sync ( ) override { return m_sink->pubsync ( ); }
+
+    private:
+    std::streambuf * m_sink;
+    std::uint64_t m_count = 0u;
+};
+
+// A read-only stream buffer over the memory of one chunk.
+class ChunkSourceBuf final : public std::streambuf {
+    public:
+    ChunkSourceBuf ( char const * data_, std::size_t const size_ ) noexcept {
+        char * const data = const_cast<char *> ( data_ );
+        setg ( data, data, data + size_ );
+    }
+};
+
+// Writes records as self-contained chunks, each a frame of its own that starts on a record boundary, of up to chunk_records_
+// records. The chunk directory follows the last chunk. ChunkedInputArchive deserializes the chunks in parallel. Read
+// sequentially (one archive over all frames, the directory is skipped), the records follow each other as if written by one
+// archive.
+template<typename Codec>
+class ChunkedOutputArchive {
+    public:
+    using Options    = typename Codec::Options;
+    using Dictionary = typename Codec::Dictionary;
+
+    ChunkedOutputArchive ( std::ostream & stream_, std::size_t const chunk_records_ = 16u * 1024u,
+                           Options const & options_ = Options ( ) ) :
+        m_counter ( stream_.rdbuf ( ) ),
+        m_stream ( &m_counter ), m_options ( options_ ), m_chunk_records ( std::max<std::size_t> ( chunk_records_, 1u ) ) {}
+    ChunkedOutputArchive ( std::ostream & stream_, Dictionary const & dictionary_, std::size_t const chunk_records_ = 16u * 1024u,
+                           Options const & options_ = Options ( ) ) :
+        ChunkedOutputArchive ( stream_, chunk_records_, options_ ) {
+        m_dictionary = &dictionary_;
+    }
+    ChunkedOutputArchive ( ChunkedOutputArchive const & ) = delete;
+    ~ChunkedOutputArchive ( ) {
+        try {
+            close ( );
+        }
+        catch ( ... ) {
+        }
+    }
+
+    ChunkedOutputArchive & operator= ( ChunkedOutputArchive const & ) = delete;
+
+    template<typename T>
+    void add ( T const & record_ ) {
+        if ( not m_archive ) {
+            m_chunk_start = m_counter.count ( );
+            m_archive     = m_dictionary ? std::make_unique<CompressedOutputArchive<Codec>> ( m_stream, *m_dictionary, m_options )
+                                     : std::make_unique<CompressedOutputArchive<Codec>> ( m_stream, m_options );
+        }
+        ( *m_archive ) ( record_ );
+        if ( ++m_records == m_chunk_records )
+            end_chunk ( );
+    }
+
+    template<typename T, typename Allocator>
+    void add ( std::vector<T, Allocator> const & records_ ) {
+        for ( T const & record : records_ )
+            add ( record );
+    }
+
+    // Ends the last chunk and writes the directory, the destructor does this too, but can't report failure.
+    void close ( ) {
+        if ( m_is_open ) {
+            m_is_open = false;
+            if ( m_archive )
+                end_chunk ( );
+            std::vector<char> const directory = m_directory.serialize ( );
+            m_counter.sputn ( directory.data ( ), static_cast<std::streamsize> ( directory.size ( ) ) );
+            m_counter.pubsync ( );
+        }
+    }
+
+    private:
+    void end_chunk ( ) {
+        m_archive->close ( );
+        m_archive.reset ( );
+        m_directory.entries.push_back ( { m_counter.count ( ) - m_chunk_start, m_records } );
+        m_records = 0u;
+    }
+
+    ChunkCountingBuf m_counter;
+    std::ostream m_stream; // Over the counter.
+    Options m_options;
+    Dictionary const * m_dictionary = nullptr;
+    std::unique_ptr<CompressedOutputArchive<Codec>> m_archive; // Of the current chunk.
+    std::size_t m_chunk_records, m_records = 0u;               // Per chunk, and in the current chunk.
+    std::uint64_t m_chunk_start = 0u;
+    ChunkDirectory m_directory;
+    bool m_is_open = true;
+};
+
+// Reads a chunked archive from memory, or from a mapped file, in place. The archive must end where the memory ends (so it can
+// be the last of the frames appended to a file). The chunks are handed to threads, each deserializes its chunks with an archive
+// of its own, straight into their place in the result.
+template<typename Codec>
+class ChunkedInputArchive {
+    public:
+    using Options    = typename Codec::Options;
+    using Dictionary = typename Codec::Dictionary;
+
+    ChunkedInputArchive ( void const * data_, std::size_t const size_, Options const & options_ = Options ( ) ) :
+        m_options ( options_ ) {
+        locate ( static_cast<char const *> ( data_ ), size_ );
+    }
+    ChunkedInputArchive ( void const * data_, std::size_t const size_, Dictionary const & dictionary_,
+                          Options const & options_ = Options ( ) ) :
+        ChunkedInputArchive ( data_, size_, options_ ) {
+        m_dictionary = &dictionary_;
+    }
+    ChunkedInputArchive ( std::filesystem::path const & path_, Options const & options_ = Options ( ) ) :
+        m_mapping ( path_ ), m_options ( options_ ) {
+        locate ( m_mapping.data ( ), m_mapping.size ( ) );
+    }
+    ChunkedInputArchive ( std::filesystem::path const & path_, Dictionary const & dictionary_,
+                          Options const & options_ = Options ( ) ) :
+        ChunkedInputArchive ( path_, options_ ) {
+        m_dictionary = &dictionary_;
+    }
+
+    // The number of records.
+    [[nodiscard]] std::size_t size ( ) const noexcept { return m_records; }
+    [[nodiscard]] std::size_t chunks ( ) const noexcept { return m_directory.entries.size ( ); }
+
+    // Replaces the content of records_ by the records of the archive, spread over threads_ threads (0 ==
+    // std::thread::hardware_concurrency ( )). T must be default constructible.
+    template<typename T, typename Allocator>
+    void load ( std::vector<T, Allocator> & records_, unsigned int const threads_ = 0u ) const {
+        records_.clear ( );
+        records_.resize ( m_records );
+        std::size_t threads = threads_ ? threads_ : std::thread::hardware_concurrency ( );
+        threads             = std::max<std::size_t> ( std::min ( threads, chunks ( ) ), 1u );
+        // Chunks are taken in order as threads come free, which evens out chunks that take longer.
+        std::atomic<std::size_t> next{ 0u };
+        std::vector<std::exception_ptr> errors ( threads );
+        auto const work = [ & ] ( std::size_t const thread_ ) {
+            try {
+                for ( std::size_t chunk = next++; chunk < chunks ( ); chunk = next++ )
+                    load_chunk ( chunk, records_.data ( ) + m_first_records[ chunk ] );
+            }
+            catch ( ... ) {
+                errors[ thread_ ] = std::current_exception ( );
+                next              = chunks ( ); // The others stop too.
+            }
+        };
+        std::vector<std::thread> workers;
+        workers.reserve ( threads - 1u );
+        for ( std::size_t i = 1u; i < threads; ++i )
+            workers.emplace_back ( work, i );
+        work ( 0u );
+        for ( std::thread & worker : workers )
+            worker.join ( );
+        for ( std::exception_ptr const & error : errors )
+            if ( error )
+                std::rethrow_exception ( error );
+    }
+
+    private:
+    void locate ( char const * data_, std::size_t const size_ ) {
+        std::size_t const directory_size = m_directory.load ( data_, size_ );
+        std::uint64_t chunks_size = 0u, records = 0u;
+        for ( ChunkDirectory::Entry const & entry : m_directory.entries ) {
+            if ( entry.size > size_ - directory_size - chunks_size or
+                 entry.records > entry.size * ChunkDirectory::MAX_RECORDS_PER_BYTE )
+                throw std::runtime_error ( "Error during chunked archive loading, corrupt chunk directory" );
+            m_offsets.push_back ( static_cast<std::size_t> ( chunks_size ) );
+            m_first_records.push_back ( static_cast<std::size_t> ( records ) );
+            chunks_size += entry.size;
+            records += entry.records;
+        }
+        if ( records > std::numeric_limits<std::size_t>::max ( ) )
+            throw std::runtime_error ( "Error during chunked archive loading, corrupt chunk directory" );
+        m_records = static_cast<std::size_t> ( records );
+        m_data    = data_ + ( size_ - directory_size - chunks_size );
+    }
+
+    template<typename T>
+    void load_chunk ( std::size_t const chunk_, T * records_ ) const {
+        ChunkSourceBuf source ( m_data + m_offsets[ chunk_ ], static_cast<std::size_t> ( m_directory.entries[ chunk_ ].size ) );
+        std::istream stream ( &source );
+        auto const load = [ this, chunk_, records_ ] ( CompressedInputArchive<Codec> & archive_ ) {
+            for ( std::uint64_t i = 0u; i < m_directory.entries[ chunk_ ].records; ++i )
+                archive_ ( records_[ i ] );
+        };
+        if ( m_dictionary ) {
+            CompressedInputArchive<Codec> archive ( stream, *m_dictionary, m_options );
+            load ( archive );
+        }
+        else {
+            CompressedInputArchive<Codec> archive ( stream, m_options );
+            load ( archive );
+        }
+    }
+
+    LZ4MappedFile m_mapping; // Of an archive loaded from file.
+    char const * m_data = nullptr; // The first chunk.
+    Options m_options;
+    Dictionary const * m_dictionary = nullptr;
+    ChunkDirectory m_directory;
+    std::vector<std::size_t> m_offsets, m_first_records; // Per chunk.
+    std::size_t m_records = 0u;
+};
+
+using LZ4ChunkedOutputArchive  = ChunkedOutputArchive<LZ4FrameCodec>;
+using LZ4ChunkedInputArchive   = ChunkedInputArchive<LZ4FrameCodec>;
+using ZstdChunkedOutputArchive = ChunkedOutputArchive<ZstdCodec>;
+using ZstdChunkedInputArchive  = ChunkedInputArchive<ZstdCodec>;
+
+} // namespace sf
+
+namespace cereal {
+
+// The serialization functions of cereal/archives/binary.hpp.
+template<class Codec, class T>
+inline std::enable_if_t<std::is_arithmetic<T>::value> CEREAL_SAVE_FUNCTION_NAME ( sf::CompressedOutputArchive<Codec> & ar,
+                                                                                  T const & t ) {
+    ar.saveBinary ( std::addressof ( t ), sizeof ( t ) );
+}
+
+template<class Codec, class T>
+inline std::enable_if_t<std::is_arithmetic<T>::value> CEREAL_LOAD_FUNCTION_NAME ( sf::CompressedInputArchive<Codec> & ar,
+                                                                                  T & t ) {
+    ar.loadBinary ( std::addressof ( t ), sizeof ( t ) );
+}
+
+template<class Codec, class T>
+inline void CEREAL_SERIALIZE_FUNCTION_NAME ( sf::CompressedOutputArchive<Codec> & ar, NameValuePair<T> & t ) {
+    ar ( t.value );
+}
+
+template<class Codec, class T>
+inline void CEREAL_SERIALIZE_FUNCTION_NAME ( sf::CompressedInputArchive<Codec> & ar, NameValuePair<T> & t ) {
+    ar ( t.value );
+}
+
+template<class Codec, class T>
+inline void CEREAL_SERIALIZE_FUNCTION_NAME ( sf::CompressedOutputArchive<Codec> & ar, SizeTag<T> & t ) {
+    ar ( t.size );
+}
+
+template<class Codec, class T>
+inline void CEREAL_SERIALIZE_FUNCTION_NAME ( sf::CompressedInputArchive<Codec> & ar, SizeTag<T> & t ) {
+    ar ( t.size );
+}
+
+template<class Codec, class T>
+inline void CEREAL_SAVE_FUNCTION_NAME ( sf::CompressedOutputArchive<Codec> & ar, BinaryData<T> const & bd ) {
+    ar.saveBinary ( bd.data, static_cast<std::streamsize> ( bd.size ) );
+}
+
+template<class Codec, class T>
+inline void CEREAL_LOAD_FUNCTION_NAME ( sf::CompressedInputArchive<Codec> & ar, BinaryData<T> & bd ) {
+    ar.loadBinary ( bd.data, static_cast<std::streamsize> ( bd.size ) );
+}
+
+} // namespace cereal
+
+CEREAL_REGISTER_ARCHIVE ( sf::LZ4OutputArchive )
+CEREAL_REGISTER_ARCHIVE ( sf::LZ4InputArchive )
+CEREAL_REGISTER_ARCHIVE ( sf::ZstdOutputArchive )
+CEREAL_REGISTER_ARCHIVE ( sf::ZstdInputArchive )
+CEREAL_SETUP_ARCHIVE_TRAITS ( sf::LZ4InputArchive, sf::LZ4OutputArchive )
+CEREAL_SETUP_ARCHIVE_TRAITS ( sf::ZstdInputArchive, sf::ZstdOutputArchive )
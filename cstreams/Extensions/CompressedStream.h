@@ -0,0 +1,319 @@
+// MIT License
+//
+// Copyright (c) 2019 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstring>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace sf {
+
+// The buffering of a compressed stream, parameterized by a codec at compile time: the put (get) area, the bulk paths and
+// the position, on top of the codec's encoder (decoder). The codec is called directly, once per write area or read area,
+// there's no virtual dispatch. The encoder and the decoder own the areas, so they can swap them (for a background thread),
+// hand out their own (a decompressed block), or give them back while the stream is idle. A codec provides:
+//
+//     using Options    = ...; // Constructs the encoder and the decoder.
+//     using Dictionary = ...; // Optional, shared read-only by any number of streams.
+//     class Encoder {
+//         Encoder ( Options const & options_, Dictionary const * dictionary_, ... ); // Further arguments are the codec's.
+//         std::size_t write_area_size ( ) const noexcept;       // The write area holds one byte more, for overflow ( ).
+//         bool bulk ( ) const noexcept;                         // update ( ) takes the caller's buffer.
+//         char * write_area ( );                                // The write area to fill, after begin ( ) and sync ( ).
+//         void begin ( std::streambuf * sink_ );                // Starts a frame on sink_.
+//         char * compress ( std::size_t size_ );                // The first size_ bytes of the write area, returns the next.
+//         void update ( char const * data_, std::size_t size_ ); // At most write_area_size ( ) bytes, not in the write area.
+//         int sync ( );                                         // Writes out all buffered input, and syncs the sink.
+//         void end ( );                                         // Ends the frame and syncs the sink, throws on failure.
+//     };
+//     class Decoder {
+//         Decoder ( Options const & options_, Dictionary const * dictionary_, ... );
+//         std::size_t read_area_size ( ) const noexcept;        // Reads of at least this size go to decompress ( ).
+//         bool bulk ( ) const noexcept;                         // decompress ( ) can be used.
+//         void begin ( std::streambuf * source_ );
+//         char * next ( std::size_t & size_ );                  // The next decompressed bytes, size_ is 0 at the end.
+//         std::size_t decompress ( char * dest_, std::size_t capacity_ ); // Into dest_, returns 0 at the end.
+//         bool seekable ( std::uint64_t & size_ );              // The decompressed size, false if the source can't seek.
+//         bool seek ( std::uint64_t position_, std::uint64_t & start_ ); // To a position at or before position_.
+//     };
+//
+// What next ( ) and write_area ( ) return stays valid until the next call to the encoder (decoder). Concatenated frames are
+// read as one stream.
+template<typename Codec>
+class CompressedOStreamBuf final : public std::streambuf {
+    public:
+    using Options    = typename Codec::Options;
+    using Dictionary = typename Codec::Dictionary;
+    using Encoder    = typename Codec::Encoder;
+
+    template<typename... Arguments>
+    CompressedOStreamBuf ( std::streambuf * sink_, Options const & options_, Dictionary const * dictionary_ = nullptr,
+                           Arguments &&... arguments_ ) :
+        m_encoder ( options_, dictionary_, std::forward<Arguments> ( arguments_ )... ) {
+        m_encoder.begin ( sink_ );
+    }
+
+    CompressedOStreamBuf ( CompressedOStreamBuf const & ) = delete;
+    CompressedOStreamBuf & operator= ( CompressedOStreamBuf const & ) = delete;
+
+    virtual ~CompressedOStreamBuf ( ) {
+        // The errors of the sink and the encoder can't be reported from here, close ( ) reports them.
+        try {
+            close ( );
+        }
+        catch ( ... ) {
+        }
+    }
+
+    void close ( ) {
+        if ( m_is_open ) {
+            m_is_open = false; // Also when closing fails, the destructor must not throw again.
+            compress_buffer ( );
+            setp ( nullptr, nullptr );
+            m_encoder.end ( );
+        }
+    }
+
+    // Closes the current frame and starts a new one on sink_, keeping the encoder.
+    void reset ( std::streambuf * sink_ ) {
+        close ( );
+        m_is_open = true;
+        m_encoder.begin ( sink_ );
+    }
+
+    [[nodiscard]] Encoder & encoder ( ) noexcept { return m_encoder; }
+    [[nodiscard]] Encoder const & encoder ( ) const noexcept { return m_encoder; }
+
+    // Writes without virtual dispatch, for the owners of the buffer (the archives). What fits the write area is copied.
+    void write ( char const * s_, std::size_t const n_ ) {
+        if ( n_ and static_cast<std::ptrdiff_t> ( n_ ) <= epptr ( ) - pptr ( ) ) {
+            std::memcpy ( pptr ( ), s_, n_ );
+            pbump ( static_cast<int> ( n_ ) );
+        }
+        else
+            static_cast<void> ( CompressedOStreamBuf::xsputn ( s_, static_cast<std::streamsize> ( n_ ) ) );
+    }
+
+    protected:
+    [[nodiscard]] virtual int_type overflow ( int_type ch ) override {
+        if ( traits_type::eq_int_type ( ch, traits_type::eof ( ) ) ) {
+            compress_buffer ( );
+            return traits_type::not_eof ( ch );
+        }
+        if ( not pbase ( ) ) {
+            // The first write after begin ( ) or a flush.
+            set_write_area ( m_encoder.write_area ( ) );
+            *pptr ( ) = traits_type::to_char_type ( ch );
+            pbump ( 1 );
+            return ch;
+        }
+        *pptr ( ) = traits_type::to_char_type ( ch );
+        pbump ( 1 );
+        compress_buffer ( );
+        return ch;
+    }
+
+    // The stream is idle until the next write, the encoder may give the write area back.
+    [[nodiscard]] virtual int sync ( ) override {
+        compress_buffer ( );
+        setp ( nullptr, nullptr );
+        return m_encoder.sync ( );
+    }
+
+    [[nodiscard]] virtual std::streamsize xsputn ( char_type const * s_, std::streamsize n_ ) override {
+        if ( not pbase ( ) )
+            set_write_area ( m_encoder.write_area ( ) );
+        if ( n_ <= epptr ( ) - pptr ( ) ) {
+            std::memcpy ( pptr ( ), s_, n_ );
+            pbump ( static_cast<int> ( n_ ) );
+            return n_;
+        }
+        std::size_t const chunk_size = m_encoder.write_area_size ( );
+        if ( not m_encoder.bulk ( ) or static_cast<std::size_t> ( n_ ) < chunk_size )
+            return std::streambuf::xsputn ( s_, n_ );
+        // Bulk path, flush what is buffered and hand the caller's buffer to the codec directly, in write area sized chunks.
+        compress_buffer ( );
+        std::size_t size = static_cast<std::size_t> ( n_ );
+        while ( size >= chunk_size ) {
+            m_encoder.update ( s_, chunk_size );
+            s_ += chunk_size;
+            size -= chunk_size;
+        }
+        std::memcpy ( pptr ( ), s_, size );
+        pbump ( static_cast<int> ( size ) );
+        return n_;
+    }
+
+    private:
+    void set_write_area ( char * const area_ ) noexcept { setp ( area_, area_ + m_encoder.write_area_size ( ) ); }
+
+    void compress_buffer ( ) {
+        if ( pptr ( ) != pbase ( ) )
+            set_write_area ( m_encoder.compress ( static_cast<std::size_t> ( pptr ( ) - pbase ( ) ) ) );
+    }
+
+    Encoder m_encoder;
+    bool m_is_open = true;
+};
+
+template<typename Codec>
+class CompressedIStreamBuf final : public std::streambuf {
+    public:
+    using Options    = typename Codec::Options;
+    using Dictionary = typename Codec::Dictionary;
+    using Decoder    = typename Codec::Decoder;
+
+    template<typename... Arguments>
+    CompressedIStreamBuf ( std::streambuf * source_, Options const & options_, Dictionary const * dictionary_ = nullptr,
+                           Arguments &&... arguments_ ) :
+        m_decoder ( options_, dictionary_, std::forward<Arguments> ( arguments_ )... ) {
+        m_decoder.begin ( source_ );
+    }
+
+    CompressedIStreamBuf ( CompressedIStreamBuf const & ) = delete;
+    CompressedIStreamBuf & operator= ( CompressedIStreamBuf const & ) = delete;
+
+    // Starts reading source_, keeping the decoder.
+    void reset ( std::streambuf * source_ ) {
+        m_consumed = 0u;
+        setg ( nullptr, nullptr, nullptr );
+        m_decoder.reset ( source_ );
+    }
+
+    [[nodiscard]] Decoder & decoder ( ) noexcept { return m_decoder; }
+
+    // Reads without virtual dispatch, for the owners of the buffer (the archives), returns the number of bytes read.
+    [[nodiscard]] std::size_t read ( char * s_, std::size_t const n_ ) {
+        if ( n_ and static_cast<std::ptrdiff_t> ( n_ ) <= egptr ( ) - gptr ( ) ) {
+            std::memcpy ( s_, gptr ( ), n_ );
+            gbump ( static_cast<int> ( n_ ) );
+            return n_;
+        }
+        return static_cast<std::size_t> ( CompressedIStreamBuf::xsgetn ( s_, static_cast<std::streamsize> ( n_ ) ) );
+    }
+
+    protected:
+    [[nodiscard]] virtual int_type underflow ( ) override {
+        m_consumed += egptr ( ) - eback ( );
+        setg ( nullptr, nullptr, nullptr );
+        std::size_t size = 0u;
+        char * const area = m_decoder.next ( size );
+        if ( 0u == size )
+            return traits_type::eof ( );
+        setg ( area, area, area + size );
+        return traits_type::to_int_type ( *gptr ( ) );
+    }
+
+    [[nodiscard]] virtual std::streamsize xsgetn ( char_type * s_, std::streamsize n_ ) override {
+        std::streamsize read = std::min<std::streamsize> ( n_, egptr ( ) - gptr ( ) );
+        if ( read ) { // There's no get area before the first read.
+            std::memcpy ( s_, gptr ( ), read );
+            gbump ( static_cast<int> ( read ) );
+        }
+        // Bulk path, requests that don't fit the read area are decompressed straight into the caller's buffer.
+        if ( m_decoder.bulk ( ) and n_ - read >= static_cast<std::streamsize> ( m_decoder.read_area_size ( ) ) ) {
+            m_consumed += egptr ( ) - eback ( );
+            setg ( nullptr, nullptr, nullptr );
+            do {
+                std::size_t const dest_size = m_decoder.decompress ( s_ + read, static_cast<std::size_t> ( n_ - read ) );
+                if ( 0u == dest_size )
+                    return read;
+                m_consumed += dest_size;
+                read += dest_size;
+            } while ( n_ - read >= static_cast<std::streamsize> ( m_decoder.read_area_size ( ) ) );
+        }
+        if ( read < n_ )
+            read += std::streambuf::xsgetn ( s_ + read, n_ - read );
+        return read;
+    }
+
+    // Seeking needs a decoder that can seek, and a seekable source, only the current position can be told without.
+    [[nodiscard]] virtual pos_type seekoff ( off_type off_, std::ios_base::seekdir dir_,
+                                             std::ios_base::openmode which_ = std::ios_base::in ) override {
+        std::uint64_t const position = m_consumed + ( gptr ( ) - eback ( ) );
+        if ( std::ios_base::cur == dir_ and 0 == off_ )
+            return pos_type ( off_type ( position ) );
+        std::uint64_t size = 0u;
+        if ( not m_decoder.seekable ( size ) )
+            return pos_type ( off_type ( -1 ) );
+        switch ( dir_ ) {
+            case std::ios_base::cur: off_ += position; break;
+            case std::ios_base::end: off_ += size; break;
+            default: break;
+        }
+        return seekpos ( pos_type ( off_ ), which_ );
+    }
+
+    [[nodiscard]] virtual pos_type seekpos ( pos_type pos_, std::ios_base::openmode which_ = std::ios_base::in ) override {
+        off_type const target = off_type ( pos_ );
+        std::uint64_t size = 0u, start = 0u;
+        if ( not( which_ & std::ios_base::in ) or target < 0 or not m_decoder.seekable ( size ) or
+             static_cast<std::uint64_t> ( target ) > size or not m_decoder.seek ( static_cast<std::uint64_t> ( target ), start ) )
+            return pos_type ( off_type ( -1 ) );
+        setg ( nullptr, nullptr, nullptr );
+        m_consumed = start;
+        for ( std::uint64_t skip = target - start; skip; ) {
+            if ( gptr ( ) == egptr ( ) and traits_type::eq_int_type ( underflow ( ), traits_type::eof ( ) ) )
+                return pos_type ( off_type ( -1 ) );
+            std::size_t const size = static_cast<std::size_t> ( std::min<std::uint64_t> ( skip, egptr ( ) - gptr ( ) ) );
+            gbump ( static_cast<int> ( size ) );
+            skip -= size;
+        }
+        return pos_;
+    }
+
+    private:
+    Decoder m_decoder;
+    std::uint64_t m_consumed = 0u; // Decompressed offset of eback ( ).
+};
+
+template<typename Codec>
+struct CompressedOStream : public std::ostream {
+    using Options    = typename Codec::Options;
+    using Dictionary = typename Codec::Dictionary;
+
+    CompressedOStream ( std::ostream & stream_, Options const & options_ = Options ( ) ) :
+        std::ostream ( new CompressedOStreamBuf<Codec> ( stream_.rdbuf ( ), options_ ) ) {}
+    CompressedOStream ( std::ostream & stream_, Dictionary const & dictionary_, Options const & options_ = Options ( ) ) :
+        std::ostream ( new CompressedOStreamBuf<Codec> ( stream_.rdbuf ( ), options_, &dictionary_ ) ) {}
+    virtual ~CompressedOStream ( ) { delete rdbuf ( ); }
+    void close ( ) { static_cast<CompressedOStreamBuf<Codec> *> ( rdbuf ( ) )->close ( ); }
+};
+
+template<typename Codec>
+struct CompressedIStream : public std::istream {
+    using Options    = typename Codec::Options;
+    using Dictionary = typename Codec::Dictionary;
+
+    CompressedIStream ( std::istream & stream_, Options const & options_ = Options ( ) ) :
+        std::istream ( new CompressedIStreamBuf<Codec> ( stream_.rdbuf ( ), options_ ) ) {}
+    CompressedIStream ( std::istream & stream_, Dictionary const & dictionary_, Options const & options_ = Options ( ) ) :
+        std::istream ( new CompressedIStreamBuf<Codec> ( stream_.rdbuf ( ), options_, &dictionary_ ) ) {}
+    virtual ~CompressedIStream ( ) { delete rdbuf ( ); }
+};
+
+} // namespace sf
@@ -30,12 +30,29 @@
 #include <cassert>
 
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <type_traits>
 #include <vector>
 
+#ifndef LZ4F_STATIC_LINKING_ONLY
+#    define LZ4F_STATIC_LINKING_ONLY // LZ4F_CDict, LZ4F_decompress_usingDict, LZ4F_CustomMem.
+#endif
+#include <lz4.h>
 #include <lz4frame.h>
+#include <lz4hc.h>
+
+#include "CompressedStream.h"
 
-#ifndef SFML_EXTENSIONS_BUILD
+#if defined( _MSC_VER ) and not defined( SFML_EXTENSIONS_BUILD )
 #    ifdef _DEBUG
 #        pragma comment( lib, "lz4d.lib" )
 #    else
@@ -45,22 +62,196 @@
 
 namespace sf {
 
+// A read-only mapping of a whole file.
+struct LZ4MappedFile {
+    LZ4MappedFile ( ) noexcept              = default;
+    LZ4MappedFile ( LZ4MappedFile const & ) = delete;
+    LZ4MappedFile ( LZ4MappedFile && other_ ) noexcept;
+    LZ4MappedFile ( std::filesystem::path const & path_ );
+    ~LZ4MappedFile ( );
+    [[maybe_unused]] LZ4MappedFile & operator= ( LZ4MappedFile const & ) = delete;
+    [[maybe_unused]] LZ4MappedFile & operator                            = ( LZ4MappedFile && other_ ) noexcept;
+
+    [[nodiscard]] char const * data ( ) const noexcept { return static_cast<char const *> ( m_data ); }
+    [[nodiscard]] std::size_t size ( ) const noexcept { return m_size; }
+
+    private:
+    void unmap ( ) noexcept;
+    void * m_data      = nullptr;
+    std::size_t m_size = 0u;
+};
+
+// A dictionary holds both the raw bytes (for decompression) and the prepared compression dictionary, which is read-only
+// once loaded, so one instance can be shared by any number of concurrent streams.
 struct LZ4Dictionary {
     LZ4Dictionary ( ) noexcept              = default;
+    // The copy of a dictionary loaded from memory and the prepared dictionary are allocated from resource_, load with the
+    // load functions.
+    explicit LZ4Dictionary ( std::pmr::memory_resource * resource_ ) noexcept;
     LZ4Dictionary ( LZ4Dictionary const & ) = delete;
     LZ4Dictionary ( LZ4Dictionary && other_ ) noexcept;
+#ifdef _WIN32
     // Load from resource.
     LZ4Dictionary ( int name_ );
+#endif
+    // Load from file (mapped, not read).
+    LZ4Dictionary ( std::filesystem::path const & path_ );
+    // Load from memory (copied).
+    LZ4Dictionary ( void const * data_, std::size_t const size_ );
+    // Load from a mapped file.
+    LZ4Dictionary ( LZ4MappedFile && mapping_ );
     ~LZ4Dictionary ( );
     [[maybe_unused]] LZ4Dictionary const & operator= ( LZ4Dictionary const & ) = delete;
     [[maybe_unused]] LZ4Dictionary const & operator                            = ( LZ4Dictionary && other_ ) noexcept;
+#ifdef _WIN32
     void loadFromResource ( int name_ );
+#endif
+    void loadFromFile ( std::filesystem::path const & path_ );
+    void loadFromMemory ( void const * data_, std::size_t const size_ );
+    void loadFromMapping ( LZ4MappedFile && mapping_ );
+    // Written to the headers of the frames compressed with the dictionary, by which LZ4DictionaryRegistry finds it back. The ID
+    // of a dictionary in zstd's format (as trained by zstd --train or LZ4DictionaryTrainer), else a hash of the bytes.
+    [[nodiscard]] unsigned int dictID ( ) const noexcept;
+
+    private:
+    friend class LZ4ParallelCompressor;
+    friend class LZ4ParallelDecompressor;
+    friend struct LZ4FrameCodec;
+    friend class LZ4MessageWriter;
+    friend class LZ4MessageReader;
+    friend class LZ4BatchCompressor;
+    friend class LZ4BatchReader;
+    friend struct LZ4FrameSettings;
+    void prepare ( char const * bytes_, std::size_t const size_ );
+    void reset ( ) noexcept;
+    char const * bytes                   = nullptr; // Raw dictionary, used in place by decompression.
+    std::size_t size                     = 0u;
+    LZ4F_CDict * cdict                   = nullptr; // Prepared dictionary, used by compression.
+    char * storage                       = nullptr; // Owns bytes loaded from memory (size bytes, from the resource).
+    LZ4MappedFile mapping;                          // Owns bytes loaded from file.
+    std::pmr::memory_resource * resource = nullptr; // Of storage and cdict, nullptr == the global heap.
+    unsigned int dict_id                 = 0u;
+};
+
+// Collects samples of the data to be compressed, from buffers or from the traffic of streams (LZ4OStream::setSampler), and
+// trains a dictionary on them (in zstd's format, as zstd --train does). Samples are added from any thread, once the samples
+// size exceeds max_samples_size_ the oldest samples are dropped.
+class LZ4DictionaryTrainer {
+    public:
+    explicit LZ4DictionaryTrainer ( std::size_t const max_samples_size_ = 16u * 1024u * 1024u );
+    void addSample ( void const * data_, std::size_t const size_ );
+    [[nodiscard]] std::size_t samples ( ) const;
+    [[nodiscard]] std::size_t samplesSize ( ) const;
+    void clear ( );
+    // Throws if there are too few samples, a few hundred (of some kilobytes) is a good start. LZ4 only uses the last 64 KB
+    // of a dictionary.
+    [[nodiscard]] LZ4Dictionary train ( std::size_t const capacity_ = 64u * 1024u ) const;
+
+    private:
+    mutable std::mutex m_mutex;
+    std::deque<std::vector<char>> m_samples;
+    std::size_t m_samples_size = 0u;
+    std::size_t m_max_samples_size;
+};
+
+// The dictionaries known to a reader, by ID. LZ4IStream looks up the dictionary of every frame by the ID in its header.
+// Dictionaries are added from any thread, and must outlive the registry, unless the registry owns them.
+class LZ4DictionaryRegistry {
+    public:
+    void add ( LZ4Dictionary const & dictionary_ );
+    void add ( LZ4Dictionary && dictionary_ );
+    // nullptr if unknown.
+    [[nodiscard]] LZ4Dictionary const * find ( unsigned int const dict_id_ ) const;
 
     private:
-    friend class LZ4OStreamBuf;
-    friend class LZ4IStreamBuf;
-    void * data      = nullptr;
-    std::size_t size = 0u;
+    mutable std::mutex m_mutex;
+    std::map<unsigned int, LZ4Dictionary const *> m_dictionaries;
+    std::vector<std::unique_ptr<LZ4Dictionary>> m_owned;
+};
+
+// Block-parallel compression, the input is cut into independent blocks that are compressed on a pool of worker threads. The
+// output is a standard LZ4 frame (without content checksum). On the input side, the blocks of independent-block frames are
+// decompressed on a pool of worker threads, ahead of the reader.
+struct LZ4ParallelOptions {
+    unsigned int threads      = 0u;                  // 0 == std::thread::hardware_concurrency ( ).
+    std::size_t max_in_flight = 64u * 1024u * 1024u; // Bound on the uncompressed bytes queued or being compressed.
+};
+
+// The frame preferences and the buffer sizes of LZ4OStream and LZ4IStream, the defaults are those of the plain constructors.
+struct LZ4Options {
+    int compression_level           = 0; // 0 == default, >= 3 == high compression.
+    LZ4F_blockSizeID_t block_size   = LZ4F_max256KB;
+    LZ4F_blockMode_t block_mode     = LZ4F_blockLinked;
+    bool block_checksum             = false;
+    bool content_checksum           = false; // Not with LZ4SeekableOStream, which throws.
+    unsigned long long content_size = 0u;    // Recorded in the frame header, 0 == unknown, close ( ) throws on a mismatch.
+                                             // Not with LZ4SeekableOStream, which throws.
+    bool favor_dec_speed            = false; // Applies to compression levels >= 10.
+    std::size_t buffer_size         = 0u;    // Write area (0 == one block), or read area and source buffer (0 == 4096 bytes).
+    // Output only, the number of write areas (>= 2) of the asynchronous mode, 0 == synchronous. The writer fills one write
+    // area while a background thread compresses the others and writes them to the sink. Not used in parallel mode.
+    unsigned int async_buffers = 0u;
+    // Input only, the number of decompressed buffers a background thread keeps ready ahead of the reader, 0 == off. Not
+    // used in parallel mode.
+    unsigned int read_ahead = 0u;
+    // Holds the buffers only while they hold data: they are allocated (or taken from the pool) on first use, and go back
+    // when the output stream is flushed, or when the input stream has used up its source buffer. The write area is one
+    // block, LZ4F holds no block of its own. Per-stream memory is then bounded by block_size (chosen by the writer) and
+    // buffer_size (of the reader). Not used in the parallel, asynchronous and read-ahead modes.
+    bool compact = false;
+    // The buffers and the (de)compression context are allocated from memory_resource, nullptr == the global heap. It's only
+    // used on the thread of the stream, so it needn't be thread-safe: the worker threads of the parallel modes and the context
+    // of the read-ahead mode allocate from the global heap. Not used by the streams of a pool, they allocate from the pool's.
+    std::pmr::memory_resource * memory_resource = nullptr;
+    // Output only, blocks estimated (from a sample of their bytes) to compress to more than this fraction of their size are
+    // stored uncompressed, without running LZ4 on them, 0 == off. Compressed or encrypted data then costs a copy instead of a
+    // compression pass, which is most of the time spent at the high compression levels. Needs independent blocks (as in the
+    // parallel and seekable modes), LZ4F can't store a linked block uncompressed: a writer of linked blocks throws.
+    double incompressible_ratio = 0.0;
+};
+
+// The counters of one stream, attached with setStats ( ). Nothing is counted or timed while no counters are attached.
+struct LZ4Stats {
+    std::uint64_t uncompressed_bytes = 0u; // Written to the output stream, or decompressed by the input stream.
+    std::uint64_t compressed_bytes   = 0u; // Written to the sink, or read from the source.
+    std::uint64_t buffer_calls       = 0u; // Write areas compressed, or read areas refilled.
+    std::uint64_t syncs              = 0u; // Flushes of the output stream.
+    std::chrono::nanoseconds lz4_time{ 0 }; // Inside LZ4, summed over the worker threads in parallel mode.
+    std::chrono::nanoseconds io_time{ 0 };  // Blocked on the sink or the source.
+    // Called on sync ( ) and close ( ) of the output stream, and at the end of the source of the input stream.
+    std::function<void ( LZ4Stats const & )> report;
+
+    // Uncompressed over compressed size.
+    [[nodiscard]] double ratio ( ) const noexcept;
+};
+
+// Keeps the (de)compression contexts and the buffers of closed streams, for reuse by the next stream. Creating many short-lived
+// streams then no longer allocates, and a pool can be shared between threads.
+struct LZ4ContextPool {
+    LZ4ContextPool ( ) = default;
+    // The contexts and the buffers are allocated from resource_, which must be thread-safe if the pool is shared between
+    // threads (e.g. std::pmr::synchronized_pool_resource), and outlive the pool.
+    explicit LZ4ContextPool ( std::pmr::memory_resource * resource_ ) noexcept;
+    LZ4ContextPool ( LZ4ContextPool const & ) = delete;
+    ~LZ4ContextPool ( );
+
+    LZ4ContextPool & operator= ( LZ4ContextPool const & ) = delete;
+
+    private:
+    friend struct LZ4FrameCodec;
+
+    [[nodiscard]] LZ4F_cctx * acquireCompressionContext ( );
+    [[nodiscard]] LZ4F_dctx * acquireDecompressionContext ( );
+    [[nodiscard]] std::pmr::vector<char> acquireBuffer ( std::size_t const size_ );
+    void release ( LZ4F_cctx * context_ );
+    void release ( LZ4F_dctx * context_ );
+    void release ( std::pmr::vector<char> && buffer_ );
+
+    std::mutex m_mutex;
+    std::pmr::memory_resource * m_resource = nullptr; // nullptr == the global heap.
+    std::vector<LZ4F_cctx *> m_compression_contexts;
+    std::vector<LZ4F_dctx *> m_decompression_contexts;
+    std::vector<std::pmr::vector<char>> m_buffers;
 };
 
 struct LZ4OStream : public std::ostream {
@@ -70,88 +261,523 @@ struct LZ4OStream : public std::ostream {
     LZ4OStream ( std::ostream & stream_, int const compression_level = DEFAULT_COMPRESSION_LEVEL );
     LZ4OStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_,
                  int const compression_level_ = DEFAULT_COMPRESSION_LEVEL );
+    LZ4OStream ( std::ostream & stream_, LZ4ParallelOptions const & parallel_,
+                 int const compression_level_ = DEFAULT_COMPRESSION_LEVEL );
+    LZ4OStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_, LZ4ParallelOptions const & parallel_,
+                 int const compression_level_ = DEFAULT_COMPRESSION_LEVEL );
+    LZ4OStream ( std::ostream & stream_, LZ4ContextPool & pool_, int const compression_level_ = DEFAULT_COMPRESSION_LEVEL );
+    LZ4OStream ( std::ostream & stream_, LZ4Options const & options_ );
+    LZ4OStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_, LZ4Options const & options_ );
+    LZ4OStream ( std::ostream & stream_, LZ4Options const & options_, LZ4ParallelOptions const & parallel_ );
+    LZ4OStream ( std::ostream & stream_, LZ4ContextPool & pool_, LZ4Options const & options_ );
     virtual ~LZ4OStream ( );
     void close ( );
+    // Closes the current frame and starts a new one on stream_, keeping the context and the buffers.
+    void reset ( std::ostream & stream_ );
+    // Counts into stats_ from now on, stats_ must outlive the stream or be detached with nullptr.
+    void setStats ( LZ4Stats * stats_ );
+    // The bytes held by the stream, the context's are estimated. The worker threads of the parallel mode are not counted.
+    [[nodiscard]] std::size_t memoryUsage ( ) const;
+    // Hands about fraction_ of the written data (in whole write areas) to trainer_ from now on, trainer_ must outlive the
+    // stream or be detached with nullptr.
+    void setSampler ( LZ4DictionaryTrainer * trainer_, double const fraction_ = 0.01 );
+
+    protected:
+    LZ4OStream ( std::streambuf * buffer_ );
 };
 
+// Writes a frame of independent blocks, followed by a skippable frame holding the offsets of the blocks, which lets LZ4IStream
+// seek to any position by decompressing only the block that holds it.
+struct LZ4SeekableOStream : public LZ4OStream {
+    LZ4SeekableOStream ( std::ostream & stream_, int const compression_level_ = DEFAULT_COMPRESSION_LEVEL );
+    LZ4SeekableOStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_,
+                         int const compression_level_ = DEFAULT_COMPRESSION_LEVEL );
+    LZ4SeekableOStream ( std::ostream & stream_, LZ4ParallelOptions const & parallel_,
+                         int const compression_level_ = DEFAULT_COMPRESSION_LEVEL );
+    // The blocks are independent and the write area is one block, whatever the options say. Throws if the options ask for a
+    // content size or checksum, a reader that seeks can't verify them.
+    LZ4SeekableOStream ( std::ostream & stream_, LZ4Options const & options_ );
+};
+
+// Seeks (on a seekable source) in streams written by LZ4SeekableOStream, the stream must start at the start of the frame.
+// Concatenated frames (as appended to a file) are read as one stream, skippable frames are skipped. Seeking is limited to the
+// first frame.
 struct LZ4IStream : public std::istream {
     LZ4IStream ( std::istream & stream_ );
     LZ4IStream ( std::istream & stream_, LZ4Dictionary const & dictionary_ );
+    LZ4IStream ( std::istream & stream_, LZ4ParallelOptions const & parallel_ );
+    LZ4IStream ( std::istream & stream_, LZ4Dictionary const & dictionary_, LZ4ParallelOptions const & parallel_ );
+    LZ4IStream ( std::istream & stream_, LZ4ContextPool & pool_ );
+    LZ4IStream ( std::istream & stream_, LZ4Options const & options_ );
+    LZ4IStream ( std::istream & stream_, LZ4Dictionary const & dictionary_, LZ4Options const & options_ );
+    LZ4IStream ( std::istream & stream_, LZ4ContextPool & pool_, LZ4Options const & options_ );
+    // Every frame is decompressed with the dictionary of the ID in its header, looked up in registry_ (which must outlive the
+    // stream), frames without an ID without one. Throws on an unknown ID.
+    LZ4IStream ( std::istream & stream_, LZ4DictionaryRegistry const & registry_ );
+    LZ4IStream ( std::istream & stream_, LZ4DictionaryRegistry const & registry_, LZ4Options const & options_ );
+    // Decompresses in place, from memory or from a read-only mapping of the file, without staging the compressed data.
+    LZ4IStream ( void const * data_, std::size_t const size_ );
+    LZ4IStream ( void const * data_, std::size_t const size_, LZ4Dictionary const & dictionary_ );
+    LZ4IStream ( std::filesystem::path const & path_ );
+    LZ4IStream ( std::filesystem::path const & path_, LZ4Dictionary const & dictionary_ );
     virtual ~LZ4IStream ( );
+    // Starts reading stream_, keeping the context and the buffers.
+    void reset ( std::istream & stream_ );
+    // The content size recorded in the header of the current frame, 0 if unknown. Reads the header if no data was read yet.
+    [[nodiscard]] unsigned long long contentSize ( );
+    // Counts into stats_ from now on, stats_ must outlive the stream or be detached with nullptr.
+    void setStats ( LZ4Stats * stats_ );
+    // The bytes held by the stream, the context's are estimated. The worker threads of the parallel mode are not counted.
+    [[nodiscard]] std::size_t memoryUsage ( );
 };
 
-class LZ4OutputStream : public std::ostream {
-    public:
-    LZ4OutputStream ( std::ostream & sink, const int compression_level_ = 4 ) :
-        std::ostream ( new LZ4OutputBuffer ( sink, compression_level_ ) ),
-        buffer_ ( static_cast<LZ4OutputBuffer *> ( rdbuf ( ) ) ) {
-        assert ( buffer_ );
+// One-shot compression of a trivially copyable object, or a vector of them, into one frame with the content size in the
+// header, read back by LZ4IStream like any other frame. There's no streaming state, the context and the buffers are kept
+// per thread. Loading reads exactly the frame, and throws if the content size doesn't match the object.
+struct LZ4Frame {
+    template<typename T>
+    static std::enable_if_t<std::is_trivially_copyable_v<T>> save ( std::ostream & stream_, T const & t_,
+                                                                    int const compression_level_ = 0 ) {
+        compress ( stream_, std::addressof ( t_ ), sizeof ( T ), compression_level_ );
+    }
+    template<typename T, typename Allocator>
+    static std::enable_if_t<std::is_trivially_copyable_v<T>> save ( std::ostream & stream_, std::vector<T, Allocator> const & t_,
+                                                                    int const compression_level_ = 0 ) {
+        compress ( stream_, t_.data ( ), t_.size ( ) * sizeof ( T ), compression_level_ );
     }
+    // Writes a skippable frame holding data_, of the magic number LZ4F_MAGIC_SKIPPABLE_START + id_ (< 16, 0xE is taken by the
+    // block index of LZ4SeekableOStream). Readers skip it, LZ4FrameScanner exposes it.
+    static void saveSkippable ( std::ostream & stream_, void const * data_, std::size_t const size_, unsigned int const id_ = 0u );
 
-    ~LZ4OutputStream ( ) {
-        close ( );
-        delete buffer_;
+    template<typename T>
+    static std::enable_if_t<std::is_trivially_copyable_v<T>> load ( std::istream & stream_, T & t_ ) {
+        decompress (
+            stream_,
+            [] ( void * object_, unsigned long long const content_size_ ) -> void * {
+                return sizeof ( T ) == content_size_ ? object_ : nullptr;
+            },
+            std::addressof ( t_ ) );
     }
+    template<typename T, typename Allocator>
+    static std::enable_if_t<std::is_trivially_copyable_v<T>> load ( std::istream & stream_, std::vector<T, Allocator> & t_ ) {
+        decompress (
+            stream_,
+            [] ( void * object_, unsigned long long const content_size_ ) -> void * {
+                auto & vector = *static_cast<std::vector<T, Allocator> *> ( object_ );
+                if ( content_size_ % sizeof ( T ) )
+                    return nullptr;
+                vector.resize ( static_cast<std::size_t> ( content_size_ / sizeof ( T ) ) );
+                return vector.empty ( ) ? object_ : vector.data ( ); // Nothing is written to an empty vector.
+            },
+            std::addressof ( t_ ) );
+    }
+
+    private:
+    static void compress ( std::ostream & stream_, void const * data_, std::size_t const size_, int const compression_level_ );
+    // Reads the frame header (skipping skippable frames), asks destination_ for the memory of the content (nullptr if the size
+    // doesn't fit the object), and decompresses the frame into it. A frame without a content size (written by LZ4OStream) is
+    // decompressed first, and its size asked for after.
+    static void decompress ( std::istream & stream_, void * ( *destination_ ) ( void *, unsigned long long const ),
+                             void * object_ );
+};
 
-    void close ( ) { buffer_->close ( ); }
+// A frame of a source of concatenated frames, as found by LZ4FrameScanner.
+struct LZ4FrameInfo {
+    std::uint64_t offset       = 0u; // Source position of the magic number.
+    std::uint64_t size         = 0u; // In the source, from the magic number up to and including the end mark and checksum.
+    std::uint64_t content_size = 0u; // As recorded in the frame header, 0 if unknown, or the data size of a skippable frame.
+    std::uint32_t magic        = 0u; // LZ4F_MAGICNUMBER, or LZ4F_MAGIC_SKIPPABLE_START + 0x0 ... 0xF.
+
+    [[nodiscard]] bool skippable ( ) const noexcept { return LZ4F_MAGICNUMBER != magic; }
+};
+
+// Walks the frames of a source of concatenated frames without decompressing them, from the frame headers and the block
+// headers. Blocks are skipped by seeking, or read and dropped if the source can't seek. A frame is read by positioning the
+// source at its offset, and reading it with LZ4IStream (up to the end of the source) or LZ4Frame::load ( ) (just the frame).
+class LZ4FrameScanner {
+    public:
+    // Starts at the current position of the source of stream_, offsets are counted from there if it can't tell its position.
+    explicit LZ4FrameScanner ( std::istream & stream_ );
+
+    // Moves past the next frame and describes it in frame_, returns false at the end of the source, throws if the frame is
+    // corrupt or the source ends half-way. The data of a skippable frame is read into skippable_data_, if given.
+    [[nodiscard]] bool next ( LZ4FrameInfo & frame_, std::vector<char> * skippable_data_ = nullptr );
+
+    // All frames from the current position of stream_ on.
+    [[nodiscard]] static std::vector<LZ4FrameInfo> list ( std::istream & stream_ );
 
     private:
-    class LZ4OutputBuffer : public std::streambuf {
-        public:
-        LZ4OutputBuffer ( std::ostream & sink, const int compression_level_ );
-        ~LZ4OutputBuffer ( );
+    void read ( char * dest_, std::size_t const size_ );
+    void skip ( std::uint64_t const size_ );
+
+    std::streambuf * m_source;
+    std::uint64_t m_position = 0u;
+    std::uint64_t m_end      = 0u; // Of a seekable source.
+    bool m_seekable          = false;
+};
 
-        LZ4OutputBuffer ( const LZ4OutputBuffer & ) = delete;
-        LZ4OutputBuffer & operator= ( const LZ4OutputBuffer & ) = delete;
-        void close ( );
+// Low-latency compression of a stream of small messages, with the LZ4 block streaming API. Each message is compressed as one
+// block, which refers to the messages before it (kept in a ring buffer), and is written to the sink and flushed right away.
+// A message is its compressed size (a varint) followed by the block, there's no frame, the stream starts with an 8 byte
+// header. Only LZ4MessageReader reads the format.
+class LZ4MessageWriter {
+    public:
+    // A larger maximum message size takes more memory, on both sides, the acceleration trades ratio for speed (1 == default).
+    LZ4MessageWriter ( std::ostream & stream_, std::size_t const max_message_size_ = 64u * 1024u, int const acceleration_ = 1 );
+    LZ4MessageWriter ( std::ostream & stream_, LZ4Dictionary const & dictionary_, std::size_t const max_message_size_ = 64u * 1024u,
+                       int const acceleration_ = 1 );
+    LZ4MessageWriter ( LZ4MessageWriter const & ) = delete;
+    ~LZ4MessageWriter ( );
 
-        private:
-        int_type overflow ( int_type ch ) override;
-        int_type sync ( ) override;
-        void compressAndWrite ( );
-        void writeHeader ( );
-        void writeFooter ( );
-
-        std::ostream & sink_;
-        std::array<char, 256> src_buf_;
-        std::vector<char> dest_buf_;
-        LZ4F_compressionContext_t ctx_;
-        LZ4F_preferences_t preferences_;
-        bool closed_;
-    };
+    LZ4MessageWriter & operator= ( LZ4MessageWriter const & ) = delete;
 
-    LZ4OutputBuffer * buffer_;
+    // Compresses the message, writes it to the sink and flushes the sink, throws if it exceeds the maximum message size.
+    void write ( void const * data_, std::size_t const size_ );
+
+    private:
+    std::streambuf * m_sink;
+    LZ4_stream_t * m_context = nullptr;
+    std::vector<char> m_ring;   // The message being compressed and the history of the ones before it.
+    std::vector<char> m_buffer; // The size of the compressed message, followed by the message.
+    std::size_t m_max_message_size, m_position = 0u;
+    int m_acceleration;
 };
 
-class LZ4InputStream : public std::istream {
+// Reads the messages written by LZ4MessageWriter, the dictionary (if any) must be the one of the writer.
+class LZ4MessageReader {
     public:
-    LZ4InputStream ( std::istream & source ) :
-        std::istream ( new LZ4InputBuffer ( source ) ), buffer_ ( static_cast<LZ4InputBuffer *> ( rdbuf ( ) ) ) {
-        assert ( buffer_ );
-    }
+    explicit LZ4MessageReader ( std::istream & stream_ );
+    LZ4MessageReader ( std::istream & stream_, LZ4Dictionary const & dictionary_ );
+    LZ4MessageReader ( LZ4MessageReader const & ) = delete;
+    ~LZ4MessageReader ( );
+
+    LZ4MessageReader & operator= ( LZ4MessageReader const & ) = delete;
 
-    ~LZ4InputStream ( ) { delete buffer_; }
+    // Returns the next message, which stays valid until the next call, nullptr at the end of the source. Throws if the source
+    // is corrupt or ends half-way a message.
+    [[nodiscard]] char const * read ( std::size_t & size_ );
 
     private:
-    class LZ4InputBuffer : public std::streambuf {
+    [[nodiscard]] bool read_header ( );
+
+    std::streambuf * m_source;
+    LZ4_streamDecode_t * m_context = nullptr;
+    LZ4Dictionary const * m_dictionary;
+    std::vector<char> m_ring, m_buffer; // Sized by the header.
+    std::size_t m_max_message_size = 0u, m_position = 0u;
+};
+
+// Snapshots of an evolving state (its serialized bytes, the same object saved over and over), each compressed against the one
+// before it. A snapshot is cut into 32 KB blocks, each compressed with the 64 KB of the previous snapshot that end where the
+// block ends as its dictionary, so content that stayed in place (or moved by less than a block) costs next to nothing. Blocks
+// that didn't change at all are not compressed, just marked. The first snapshot, and every key_interval_-th after it, is a
+// base, compressed on its own. Only LZ4SnapshotReader reads the format.
+class LZ4SnapshotWriter {
+    public:
+    // Levels >= 3 use LZ4 HC, key_interval_ == 0 makes the first snapshot the only base.
+    LZ4SnapshotWriter ( std::ostream & stream_, int const compression_level_ = 0, std::size_t const key_interval_ = 0u );
+    LZ4SnapshotWriter ( LZ4SnapshotWriter const & ) = delete;
+    ~LZ4SnapshotWriter ( );
+
+    LZ4SnapshotWriter & operator= ( LZ4SnapshotWriter const & ) = delete;
+
+    // Compresses the snapshot (as a delta of the one before it, or as a base) and writes it to the sink, in one go, after its
+    // header (which holds its compressed size).
+    void write ( void const * data_, std::size_t const size_ );
+
+    private:
+    std::streambuf * m_sink;
+    LZ4_stream_t * m_context      = nullptr;
+    LZ4_streamHC_t * m_hc_context = nullptr;
+    std::vector<char> m_previous; // The dictionary of the next snapshot.
+    std::vector<char> m_buffer;   // One compressed block.
+    std::vector<char> m_output;   // One compressed snapshot.
+    int m_level;
+    std::size_t m_key_interval, m_count = 0u;
+};
+
+// Reads the snapshots written by LZ4SnapshotWriter, applying each delta to the snapshot before it. The source must start at a
+// base (e.g. at the start of the stream).
+class LZ4SnapshotReader {
+    public:
+    explicit LZ4SnapshotReader ( std::istream & stream_ );
+
+    // Returns the next snapshot, which stays valid until the next snapshot is read, nullptr at the end of the source. Throws if
+    // the source is corrupt or ends half-way a snapshot.
+    [[nodiscard]] char const * read ( std::size_t & size_ );
+    // Whether the last snapshot read is a base.
+    [[nodiscard]] bool isBase ( ) const noexcept { return m_is_base; }
+    // Positions the source at the last base, skipping the snapshots before it (and the deltas after it) from their headers,
+    // without decompressing them. Reading on replays the last base and the deltas after it only. Returns false if the source
+    // can't seek (it's left where it was) or holds no base (it's left at the end).
+    bool seekLastBase ( );
+
+    private:
+    std::streambuf * m_source;
+    std::vector<char> m_current, m_previous; // The last snapshot read, and its dictionary (swapped).
+    std::vector<char> m_buffer;              // One compressed block.
+    bool m_has_base = false, m_is_base = false;
+};
+
+// A payload of the batch API, a view of the caller's memory.
+struct LZ4Payload {
+    void const * data = nullptr;
+    std::size_t size  = 0u;
+};
+
+class LZ4BatchPool; // The worker threads of the batch API.
+
+// Compresses many small independent payloads in one call, spread over LZ4ParallelOptions::threads threads (in-flight bound
+// unused). A call only uses threads if there's enough input for them. The worker threads (started by the first call that
+// uses them), the contexts, the prepared dictionary and the buffers are kept from call to call, so one compressor serves many
+// batches.
+class LZ4BatchCompressor {
+    public:
+    explicit LZ4BatchCompressor ( int const compression_level_ = 0, LZ4ParallelOptions const & parallel_ = { } );
+    LZ4BatchCompressor ( LZ4Dictionary const & dictionary_, int const compression_level_ = 0,
+                         LZ4ParallelOptions const & parallel_ = { } );
+    LZ4BatchCompressor ( LZ4BatchCompressor const & ) = delete;
+    ~LZ4BatchCompressor ( );
+
+    LZ4BatchCompressor & operator= ( LZ4BatchCompressor const & ) = delete;
+
+    // Each payload into a frame of its own, with the content size in the header, read back by LZ4Frame::load ( ) or
+    // LZ4IStream.
+    [[nodiscard]] std::vector<std::vector<char>> compress ( LZ4Payload const * payloads_, std::size_t const count_ );
+    // All payloads into one container, of LZ4 blocks behind a table of their offsets, read by LZ4BatchReader. There's no
+    // frame per payload, a payload that doesn't compress is stored as is.
+    void pack ( LZ4Payload const * payloads_, std::size_t const count_, std::vector<char> & container_ );
+
+    private:
+    struct State;
+
+    // The threads of a batch, with a state each.
+    [[nodiscard]] std::size_t threads ( LZ4Payload const * payloads_, std::size_t const count_ );
+
+    int m_level;
+    LZ4Dictionary const * m_dictionary;
+    LZ4ParallelOptions m_parallel;
+    std::unique_ptr<State> m_prepared;            // The dictionary, prepared for the block API on first use.
+    std::vector<std::unique_ptr<State>> m_states; // One per thread.
+    std::unique_ptr<LZ4BatchPool> m_pool;
+};
+
+// Random access to the payloads of a container written by LZ4BatchCompressor::pack ( ), the dictionary (if any) must be the
+// one of the compressor. The container is used in place, and must outlive the reader.
+class LZ4BatchReader {
+    public:
+    // Throws if the container is corrupt.
+    LZ4BatchReader ( void const * data_, std::size_t const size_ );
+    LZ4BatchReader ( void const * data_, std::size_t const size_, LZ4Dictionary const & dictionary_ );
+
+    // The number of payloads.
+    [[nodiscard]] std::size_t size ( ) const noexcept { return m_count; }
+    [[nodiscard]] std::size_t payloadSize ( std::size_t const index_ ) const;
+    // Decompresses payload index_ into dest_, which holds at least payloadSize ( index_ ) bytes.
+    void read ( std::size_t const index_, void * dest_ ) const;
+    [[nodiscard]] std::vector<char> read ( std::size_t const index_ ) const;
+    // All payloads, spread over LZ4ParallelOptions::threads threads (the worker threads are shared by all readers).
+    [[nodiscard]] std::vector<std::vector<char>> readAll ( LZ4ParallelOptions const & parallel_ = { } ) const;
+
+    private:
+    char const * m_table;  // Block offsets (count + 1, 64 bits), then payload sizes (count, 32 bits), little endian.
+    char const * m_blocks; // Offsets are relative to the first block.
+    std::size_t m_count;
+    LZ4Dictionary const * m_dictionary = nullptr;
+};
+
+// The reads and writes of LZ4FileOStream and LZ4FileIStream.
+struct LZ4FileOptions {
+    std::size_t block_size   = 1024u * 1024u; // Of one read or write, rounded up to a multiple of 4096 bytes.
+    unsigned int queue_depth = 4u;            // The number of blocks in flight (>= 1).
+    // Bypasses the page cache (O_DIRECT, FILE_FLAG_NO_BUFFERING), so writing or reading a large file doesn't evict the cached
+    // pages of everything else.
+    bool direct = false;
+};
+
+// A file written in whole blocks, up to queue_depth of them in flight while the next one is filled, the sink of a compressed
+// stream (LZ4OStream lz4 ( file )). On Linux (5.6 or later) the writes are queued on an io_uring, elsewhere (or if the kernel
+// refuses a ring) they're synchronous. flush ( ) writes the partly filled block too (padded for direct I/O, the padding is
+// cut by close ( )), and waits for the writes in flight.
+struct LZ4FileOStream : public std::ostream {
+    LZ4FileOStream ( std::filesystem::path const & path_, LZ4FileOptions const & options_ = LZ4FileOptions ( ) );
+    virtual ~LZ4FileOStream ( );
+    // Writes the last block and closes the file, the destructor does this too, but can't report failure.
+    void close ( );
+};
+
+// A file read ahead in whole blocks, up to queue_depth of them in flight, the source of a compressed stream
+// (LZ4IStream lz4 ( file )). The reads are queued like the writes of LZ4FileOStream. Seeking outside the current block drops
+// the blocks read ahead.
+struct LZ4FileIStream : public std::istream {
+    LZ4FileIStream ( std::filesystem::path const & path_, LZ4FileOptions const & options_ = LZ4FileOptions ( ) );
+    virtual ~LZ4FileIStream ( );
+};
+
+// The frame settings of the LZ4F writers (LZ4FrameCodec, in all the modes of LZ4OStream), built from the options in one
+// place, and the calls that apply them.
+struct LZ4FrameSettings {
+    LZ4FrameSettings ( LZ4Options const & options_, LZ4Dictionary const * dictionary_ ) noexcept;
+    // Applies the incompressible ratio of the options, once the block mode is final (throws if the blocks are linked).
+    void finalize ( LZ4Options const & options_ );
+    // Writes the frame header to dest_, returns its size.
+    [[nodiscard]] std::size_t begin ( LZ4F_cctx * context_, char * dest_, std::size_t const capacity_ ) const;
+    // Compresses src_ to dest_, or stores it as is if it's incompressible, returns the size written.
+    [[nodiscard]] std::size_t update ( LZ4F_cctx * context_, char * dest_, std::size_t const capacity_, char const * src_,
+                                       std::size_t const size_ ) const;
+
+    LZ4F_preferences_t preferences;
+    LZ4Dictionary const * dictionary;
+    double incompressible_ratio = 0.0; // Not 0.0 only with independent blocks.
+};
+
+class LZ4ParallelCompressor;
+class LZ4ParallelDecompressor;
+class LZ4MemoryBuf;
+struct LZ4BlockIndex;
+
+// The LZ4 frame format as a codec of the generic streams (CompressedStream.h), on which LZ4OStream, LZ4IStream and the LZ4
+// archives run. The engine does the buffering, the encoder and the decoder add the modes of LZ4Options and the layers passed
+// after the dictionary: the parallel compressor (decompressor), the block index of a seekable stream, the context pool, the
+// dictionary registry and the in place decompression of memory.
+struct LZ4FrameCodec {
+    using Options    = LZ4Options;
+    using Dictionary = LZ4Dictionary;
+
+    class Encoder {
         public:
-        LZ4InputBuffer ( std::istream & source );
-        ~LZ4InputBuffer ( );
+        Encoder ( Options const & options_, Dictionary const * dictionary_, LZ4ParallelOptions const * parallel_ = nullptr,
+                  bool const seekable_ = false, LZ4ContextPool * pool_ = nullptr );
+        Encoder ( Encoder const & ) = delete;
+        ~Encoder ( );
 
-        int_type underflow ( ) override;
-        LZ4InputBuffer ( const LZ4InputBuffer & ) = delete;
-        LZ4InputBuffer & operator= ( const LZ4InputBuffer & ) = delete;
+        Encoder & operator= ( Encoder const & ) = delete;
+
+        [[nodiscard]] std::size_t write_area_size ( ) const noexcept { return m_write_area_size - 1u; }
+        // The parallel compressor and the background thread own their input, so they always take a copy.
+        [[nodiscard]] bool bulk ( ) const noexcept { return not m_parallel and not m_async; }
+        [[nodiscard]] char * write_area ( );
+        void begin ( std::streambuf * sink_ );
+        [[nodiscard]] char * compress ( std::size_t const size_ );
+        void update ( char const * data_, std::size_t const size_ );
+        [[nodiscard]] int sync ( );
+        void end ( );
+
+        void set_stats ( LZ4Stats * stats_ );
+        void set_sampler ( LZ4DictionaryTrainer * trainer_, double const fraction_ );
+        // The buffers, an estimate of the memory of the context and the buffers of the asynchronous mode.
+        [[nodiscard]] std::size_t memory_usage ( ) const;
 
         private:
-        std::istream & source_;
-        std::array<char, 64 * 1024> src_buf_;
-        std::array<char, 64 * 1024> dest_buf_;
-        std::size_t offset_;
-        std::size_t src_buf_size_;
-        LZ4F_decompressionContext_t ctx_;
+        struct Async; // The state shared with the background thread of the asynchronous mode.
+
+        void initialize_stream ( );
+        void acquire_buffers ( );
+        void release_buffers ( );
+        std::size_t compress_range ( char const * src_, std::size_t const size_ );
+        void sample ( char const * src_, std::size_t const size_ );
+        void submit_async ( std::size_t const size_ );
+        void wait_async ( );
+        void compress_async ( );
+        std::size_t write ( char const * data_, std::size_t const size_ );
+        int sync_sink ( );
+
+        std::streambuf * m_sink = nullptr;
+        LZ4F_cctx * m_compression_ctx;
+        LZ4FrameSettings m_settings;
+        std::pmr::memory_resource * m_resource; // Of the buffers, the pool's if there's a pool.
+        std::pmr::vector<char> m_write_area;
+        std::pmr::vector<char> m_compression_buffer;
+        std::size_t m_write_area_size, m_compression_buffer_size; // The write area holds one byte for overflow ( ).
+        LZ4DictionaryTrainer * m_sampler = nullptr;
+        double m_sample_fraction = 0.0, m_sample_credit = 0.0;
+        std::unique_ptr<LZ4ParallelCompressor> m_parallel;
+        std::unique_ptr<LZ4BlockIndex> m_index; // Of a seekable stream.
+        LZ4ContextPool * m_pool;
+        std::uint64_t m_submitted = 0u; // To the parallel compressor, in the current frame.
+        LZ4Stats * m_stats        = nullptr;
+        bool m_compact            = false;
+        std::unique_ptr<Async> m_async;
     };
 
-    LZ4InputBuffer * buffer_;
+    class Decoder {
+        public:
+        Decoder ( Options const & options_, Dictionary const * dictionary_, LZ4ParallelOptions const * parallel_ = nullptr,
+                  LZ4ContextPool * pool_ = nullptr, LZ4DictionaryRegistry const * registry_ = nullptr );
+        // Decompresses in place from memory_, the source of the stream, without a source buffer.
+        Decoder ( Options const & options_, Dictionary const * dictionary_, std::unique_ptr<LZ4MemoryBuf> memory_ );
+        Decoder ( Decoder const & ) = delete;
+        ~Decoder ( );
+
+        Decoder & operator= ( Decoder const & ) = delete;
+
+        [[nodiscard]] std::size_t read_area_size ( ) const noexcept { return m_buffer_size; }
+        [[nodiscard]] bool bulk ( ) const noexcept { return not m_parallel and not m_read_ahead; }
+        void begin ( std::streambuf * source_ );
+        [[nodiscard]] char * next ( std::size_t & size_ );
+        [[nodiscard]] std::size_t decompress ( char * const dest_, std::size_t const capacity_ );
+        // Seeking needs the block index of a seekable stream (written by LZ4SeekableOStream) and a seekable source.
+        [[nodiscard]] bool seekable ( std::uint64_t & size_ );
+        [[nodiscard]] bool seek ( std::uint64_t const position_, std::uint64_t & start_ );
+        // Starts reading a new source, reusing the context and the buffers.
+        void reset ( std::streambuf * source_ );
+
+        // The content size of the current frame, decodes its header if nothing was decompressed yet, 0 if unknown.
+        [[nodiscard]] unsigned long long content_size ( );
+        void set_stats ( LZ4Stats * stats_ );
+        // The buffers, an estimate of the memory of the context and the buffers of the read-ahead mode.
+        [[nodiscard]] std::size_t memory_usage ( );
+
+        private:
+        struct ReadAhead; // The state shared with the background thread of the read-ahead mode.
+        class ReadAheadPause;
+
+        void decompress_ahead ( );
+        [[nodiscard]] char * next_read_ahead ( std::size_t & size_ );
+        [[nodiscard]] char * end_of_source ( );
+        [[nodiscard]] std::size_t read_source ( char * dest_, std::size_t const size_ );
+        [[nodiscard]] std::pmr::vector<char> acquire_buffer ( std::size_t const size_ );
+        void acquire_buffers ( );
+        void release_buffers ( );
+        [[nodiscard]] bool load_index ( );
+        [[nodiscard]] bool restore ( std::streamoff const position_ );
+        [[nodiscard]] bool frame_info ( LZ4F_frameInfo_t & info_ );
+        void select_dictionary ( unsigned int const dict_id_ );
+        void start_frame ( );
+        [[nodiscard]] std::size_t decode ( char * dest_, std::size_t const dest_capacity_ );
+
+        std::unique_ptr<LZ4MemoryBuf> m_memory; // Source of in place decompression.
+        std::streambuf * m_source = nullptr;
+        LZ4F_dctx * m_context;
+        LZ4Dictionary const * m_dictionary; // Of the current frame, if there's a registry.
+        LZ4DictionaryRegistry const * m_registry = nullptr;
+        bool m_frame_start                       = true; // The header of the current frame is not decoded yet.
+        std::pmr::memory_resource * m_resource; // Of the buffers, the pool's if there's a pool.
+        std::pmr::vector<char> m_src_buffer;
+        std::pmr::vector<char> m_read_area;
+        std::size_t m_src_offset = 0u;
+        std::size_t m_src_size   = 0u;
+        std::unique_ptr<LZ4ParallelDecompressor> m_parallel;
+        std::streamoff m_base; // Source position of the start of the frame.
+        std::unique_ptr<LZ4BlockIndex> m_index;
+        std::vector<char> m_header; // Of the frame, when seekable.
+        LZ4ContextPool * m_pool = nullptr;
+        LZ4Stats * m_stats      = nullptr;
+        std::unique_ptr<ReadAhead> m_read_ahead;
+        std::size_t m_buffer_size; // Of the source buffer and the read area.
+        bool m_compact = false;
+    };
+};
+
+// The streams of compressed_streams, on the generic engine with the LZ4 frame codec.
+class LZ4OutputStream : public CompressedOStream<LZ4FrameCodec> {
+    public:
+    LZ4OutputStream ( std::ostream & sink, const int compression_level_ = 4 );
+};
+
+class LZ4InputStream : public CompressedIStream<LZ4FrameCodec> {
+    public:
+    LZ4InputStream ( std::istream & source );
 };
 
 } // namespace sf
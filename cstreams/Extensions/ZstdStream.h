@@ -0,0 +1,131 @@
+// MIT License
+//
+// Copyright (c) 2019 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include <zstd.h>
+
+#include "CompressedStream.h"
+
+namespace sf {
+
+// The zstd frame parameters and the buffer sizes of ZstdOStream and ZstdIStream.
+struct ZstdOptions {
+    int compression_level           = 0;  // 0 == ZSTD_CLEVEL_DEFAULT, negative levels are faster.
+    unsigned int workers            = 0u; // Compression threads, 0 == compress on the writing thread.
+    bool content_checksum           = false;
+    unsigned long long content_size = 0u; // Recorded in the frame header, 0 == unknown, close ( ) throws on a mismatch.
+    std::size_t buffer_size         = 0u; // Write area, or source buffer, 0 == the sizes zstd recommends.
+};
+
+// A dictionary (as trained by zstd --train) prepared for both compression and decompression, which is read-only once
+// loaded, so one instance can be shared by any number of concurrent streams. Compression uses the level the dictionary was
+// prepared with.
+struct ZstdDictionary {
+    ZstdDictionary ( ) noexcept               = default;
+    ZstdDictionary ( ZstdDictionary const & ) = delete;
+    ZstdDictionary ( ZstdDictionary && other_ ) noexcept;
+    // Load from file.
+    ZstdDictionary ( std::filesystem::path const & path_, int const compression_level_ = 0 );
+    // Load from memory (copied).
+    ZstdDictionary ( void const * data_, std::size_t const size_, int const compression_level_ = 0 );
+    ~ZstdDictionary ( );
+    [[maybe_unused]] ZstdDictionary const & operator= ( ZstdDictionary const & ) = delete;
+    [[maybe_unused]] ZstdDictionary const & operator                             = ( ZstdDictionary && other_ ) noexcept;
+    void loadFromFile ( std::filesystem::path const & path_, int const compression_level_ = 0 );
+    void loadFromMemory ( void const * data_, std::size_t const size_, int const compression_level_ = 0 );
+
+    private:
+    friend struct ZstdCodec;
+    void reset ( ) noexcept;
+    ZSTD_CDict * cdict = nullptr;
+    ZSTD_DDict * ddict = nullptr;
+};
+
+// The zstd frame format as a codec of the generic streams (CompressedStream.h).
+struct ZstdCodec {
+    using Options    = ZstdOptions;
+    using Dictionary = ZstdDictionary;
+
+    class Encoder {
+        public:
+        Encoder ( Options const & options_, Dictionary const * dictionary_ );
+        Encoder ( Encoder const & ) = delete;
+        ~Encoder ( );
+
+        Encoder & operator= ( Encoder const & ) = delete;
+
+        [[nodiscard]] std::size_t write_area_size ( ) const noexcept { return m_write_area.size ( ) - 1u; }
+        [[nodiscard]] bool bulk ( ) const noexcept { return true; }
+        [[nodiscard]] char * write_area ( ) noexcept { return m_write_area.data ( ); }
+        void begin ( std::streambuf * sink_ ) noexcept { m_sink = sink_; } // The header is written with the first output.
+        [[nodiscard]] char * compress ( std::size_t const size_ );
+        void update ( char const * data_, std::size_t const size_ );
+        [[nodiscard]] int sync ( );
+        void end ( );
+
+        private:
+        void compress ( char const * data_, std::size_t const size_, ZSTD_EndDirective const directive_ );
+
+        std::streambuf * m_sink = nullptr;
+        ZSTD_CCtx * m_context   = nullptr;
+        std::vector<char> m_write_area;
+        std::vector<char> m_buffer;
+    };
+
+    class Decoder {
+        public:
+        Decoder ( Options const & options_, Dictionary const * dictionary_ );
+        Decoder ( Decoder const & ) = delete;
+        ~Decoder ( );
+
+        Decoder & operator= ( Decoder const & ) = delete;
+
+        [[nodiscard]] std::size_t read_area_size ( ) const noexcept { return m_read_area.size ( ); }
+        [[nodiscard]] bool bulk ( ) const noexcept { return true; }
+        void begin ( std::streambuf * source_ ) noexcept;
+        [[nodiscard]] char * next ( std::size_t & size_ );
+        [[nodiscard]] std::size_t decompress ( char * const dest_, std::size_t const capacity_ );
+        // There's no index to seek with, only the position can be told.
+        [[nodiscard]] bool seekable ( std::uint64_t & ) const noexcept { return false; }
+        [[nodiscard]] bool seek ( std::uint64_t const, std::uint64_t & ) const noexcept { return false; }
+
+        private:
+        std::streambuf * m_source = nullptr;
+        ZSTD_DCtx * m_context     = nullptr;
+        std::vector<char> m_src_buffer;
+        std::vector<char> m_read_area;
+        char const *m_src, *m_src_end; // The unread part of the source buffer.
+        bool m_pending = false;
+    };
+};
+
+using ZstdOStream = CompressedOStream<ZstdCodec>;
+using ZstdIStream = CompressedIStream<ZstdCodec>;
+
+} // namespace sf
@@ -27,40 +27,163 @@
 
 #include "Extensions/LZ4Stream.h"
 
-#include <Windows.h>
+#ifdef _WIN32
+#    include <Windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    ifdef __linux__
+#        include <linux/io_uring.h>
+#        include <sys/syscall.h>
+#    endif
+#endif
 
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#ifndef LZ4_HC_STATIC_LINKING_ONLY
+#    define LZ4_HC_STATIC_LINKING_ONLY // LZ4_attach_dictionary, LZ4_attach_HC_dictionary, the fast reset functions.
+#endif
+#include <lz4.h>
 #include <lz4frame.h>
+#include <lz4hc.h>
+#include <zdict.h>
 
 namespace sf {
 
-LZ4Dictionary::LZ4Dictionary ( LZ4Dictionary && other_ ) noexcept {
-    data        = other_.data;
-    size        = other_.size;
-    other_.data = nullptr;
-    other_.size = 0u;
+// LZ4F's allocation hooks over a memory resource. LZ4F frees without telling the size, so every allocation is prefixed by it.
+struct LZ4ResourceMemory {
+    static constexpr std::size_t PREFIX_SIZE = alignof ( std::max_align_t );
+
+    [[nodiscard]] static void * allocate ( void * resource_, std::size_t const size_ ) noexcept {
+        try {
+            char * const memory = static_cast<char *> (
+                static_cast<std::pmr::memory_resource *> ( resource_ )->allocate ( PREFIX_SIZE + size_, PREFIX_SIZE ) );
+            std::memcpy ( memory, &size_, sizeof ( size_ ) );
+            return memory + PREFIX_SIZE;
+        }
+        catch ( ... ) {
+            return nullptr; // LZ4F reports the failure.
+        }
+    }
+
+    [[nodiscard]] static void * allocate_zeroed ( void * resource_, std::size_t const size_ ) noexcept {
+        void * const memory = allocate ( resource_, size_ );
+        if ( memory )
+            std::memset ( memory, 0, size_ );
+        return memory;
+    }
+
+    static void free ( void * resource_, void * address_ ) noexcept {
+        if ( not address_ )
+            return;
+        char * const memory = static_cast<char *> ( address_ ) - PREFIX_SIZE;
+        std::size_t size    = 0u;
+        std::memcpy ( &size, memory, sizeof ( size ) );
+        static_cast<std::pmr::memory_resource *> ( resource_ )->deallocate ( memory, PREFIX_SIZE + size, PREFIX_SIZE );
+    }
+
+    [[nodiscard]] static LZ4F_CustomMem hooks ( std::pmr::memory_resource * resource_ ) noexcept {
+        return { &allocate, &allocate_zeroed, &free, resource_ };
+    }
+};
+
+// The resource of the buffers, nullptr == the global heap.
+[[nodiscard]] static std::pmr::memory_resource * buffer_resource ( std::pmr::memory_resource * resource_ ) noexcept {
+    return resource_ ? resource_ : std::pmr::new_delete_resource ( );
 }
 
-LZ4Dictionary::LZ4Dictionary ( int name_ ) { loadFromResource ( name_ ); }
+// Contexts allocated from resource_, nullptr == the global heap.
+[[nodiscard]] static LZ4F_cctx * create_compression_context ( std::pmr::memory_resource * resource_ ) {
+    LZ4F_cctx * context = nullptr;
+    if ( resource_ )
+        context = LZ4F_createCompressionContext_advanced ( LZ4ResourceMemory::hooks ( resource_ ), LZ4F_VERSION );
+    else if ( LZ4F_isError ( LZ4F_createCompressionContext ( &context, LZ4F_VERSION ) ) )
+        context = nullptr;
+    if ( not context )
+        throw std::runtime_error ( "Error during LZ4 stream creation" );
+    return context;
+}
+
+[[nodiscard]] static LZ4F_dctx * create_decompression_context ( std::pmr::memory_resource * resource_ ) {
+    LZ4F_dctx * context = nullptr;
+    if ( resource_ )
+        context = LZ4F_createDecompressionContext_advanced ( LZ4ResourceMemory::hooks ( resource_ ), LZ4F_VERSION );
+    else if ( LZ4F_isError ( LZ4F_createDecompressionContext ( &context, LZ4F_VERSION ) ) )
+        context = nullptr;
+    if ( not context )
+        throw std::runtime_error ( "Error during LZ4 istream creation" );
+    return context;
+}
 
-LZ4Dictionary::~LZ4Dictionary ( ) {
-    if ( nullptr != data )
-        LZ4F_freeCDict ( ( LZ4F_CDict * ) data );
+// The ID of a dictionary in zstd's format (magic number 0xEC30A437, ID), else the (non-zero) FNV-1a hash of the bytes.
+[[nodiscard]] static unsigned int dictionary_id ( char const * bytes_, std::size_t const size_ ) noexcept {
+    unsigned char const * const bytes = reinterpret_cast<unsigned char const *> ( bytes_ );
+    auto const le32                   = [ bytes ] ( std::size_t const offset_ ) {
+        return std::uint32_t{ bytes[ offset_ ] } | std::uint32_t{ bytes[ offset_ + 1 ] } << 8 |
+               std::uint32_t{ bytes[ offset_ + 2 ] } << 16 | std::uint32_t{ bytes[ offset_ + 3 ] } << 24;
+    };
+    if ( size_ >= 8u and 0xEC30A437u == le32 ( 0u ) and le32 ( 4u ) )
+        return le32 ( 4u );
+    std::uint32_t hash = 2166136261u;
+    for ( std::size_t i = 0u; i < size_; ++i )
+        hash = ( hash ^ bytes[ i ] ) * 16777619u;
+    return hash ? hash : 1u;
 }
 
+LZ4Dictionary::LZ4Dictionary ( std::pmr::memory_resource * resource_ ) noexcept : resource ( resource_ ) {}
+
+LZ4Dictionary::LZ4Dictionary ( LZ4Dictionary && other_ ) noexcept { *this = std::move ( other_ ); }
+
+#ifdef _WIN32
+LZ4Dictionary::LZ4Dictionary ( int name_ ) { loadFromResource ( name_ ); }
+#endif
+
+LZ4Dictionary::LZ4Dictionary ( std::filesystem::path const & path_ ) { loadFromFile ( path_ ); }
+
+LZ4Dictionary::LZ4Dictionary ( void const * data_, std::size_t const size_ ) { loadFromMemory ( data_, size_ ); }
+
+LZ4Dictionary::LZ4Dictionary ( LZ4MappedFile && mapping_ ) { loadFromMapping ( std::move ( mapping_ ) ); }
+
+LZ4Dictionary::~LZ4Dictionary ( ) { reset ( ); }
+
 [[maybe_unused]] LZ4Dictionary const & LZ4Dictionary::operator= ( LZ4Dictionary && other_ ) noexcept {
-    data        = other_.data;
-    size        = other_.size;
-    other_.data = nullptr;
-    other_.size = 0u;
+    if ( this != &other_ ) {
+        reset ( );
+        bytes          = other_.bytes;
+        size           = other_.size;
+        cdict          = other_.cdict;
+        storage        = other_.storage;
+        mapping        = std::move ( other_.mapping );
+        resource       = other_.resource;
+        dict_id        = other_.dict_id;
+        other_.bytes   = nullptr;
+        other_.size    = 0u;
+        other_.cdict   = nullptr;
+        other_.storage = nullptr;
+        other_.dict_id = 0u;
+    }
     return *this;
 }
 
+#ifdef _WIN32
 void LZ4Dictionary::loadFromResource ( int name_ ) {
     HRSRC rsrc_data = FindResource ( NULL, MAKEINTRESOURCE ( name_ ), L"FILEDATA" );
     if ( not rsrc_data )
@@ -68,19 +191,288 @@ void LZ4Dictionary::loadFromResource ( int name_ ) {
     DWORD rsrc_data_size = SizeofResource ( NULL, rsrc_data );
     if ( rsrc_data_size <= 0 )
         throw std::runtime_error ( "Size of resource is 0." );
-    else
-        size = ( std::size_t ) rsrc_data_size;
     HGLOBAL grsrc_data = LoadResource ( NULL, rsrc_data );
     if ( not grsrc_data )
         throw std::runtime_error ( "Failed to load resource." );
     LPVOID first_byte = LockResource ( grsrc_data );
     if ( not first_byte )
         throw std::runtime_error ( "Failed to lock resource." );
-    data = LZ4F_createCDict ( first_byte, size );
-    if ( not data )
+    // Resources live as long as the module, no need to own them.
+    reset ( );
+    prepare ( static_cast<char const *> ( first_byte ), ( std::size_t ) rsrc_data_size );
+}
+#endif
+
+void LZ4Dictionary::loadFromFile ( std::filesystem::path const & path_ ) { loadFromMapping ( LZ4MappedFile ( path_ ) ); }
+
+void LZ4Dictionary::loadFromMemory ( void const * data_, std::size_t const size_ ) {
+    if ( 0u == size_ )
+        throw std::runtime_error ( "Size of LZ4-dictionary is 0." );
+    char * const copy = static_cast<char *> ( buffer_resource ( resource )->allocate ( size_, 1u ) );
+    std::memcpy ( copy, data_, size_ );
+    reset ( );
+    storage = copy;
+    prepare ( storage, size_ );
+}
+
+void LZ4Dictionary::loadFromMapping ( LZ4MappedFile && mapping_ ) {
+    reset ( );
+    mapping = std::move ( mapping_ );
+    prepare ( mapping.data ( ), mapping.size ( ) );
+}
+
+void LZ4Dictionary::prepare ( char const * bytes_, std::size_t const size_ ) {
+    if ( 0u == size_ )
+        throw std::runtime_error ( "Size of LZ4-dictionary is 0." );
+    bytes   = bytes_;
+    size    = size_;
+    dict_id = dictionary_id ( bytes_, size_ );
+    cdict   = resource ? LZ4F_createCDict_advanced ( LZ4ResourceMemory::hooks ( resource ), bytes, size )
+                     : LZ4F_createCDict ( bytes, size );
+    if ( not cdict )
         throw std::runtime_error ( "Failed to load LZ4-dictionary." );
 }
 
+void LZ4Dictionary::reset ( ) noexcept {
+    if ( nullptr != cdict )
+        LZ4F_freeCDict ( cdict );
+    if ( nullptr != storage )
+        buffer_resource ( resource )->deallocate ( storage, size, 1u );
+    bytes   = nullptr;
+    size    = 0u;
+    cdict   = nullptr;
+    storage = nullptr;
+    dict_id = 0u;
+    mapping = LZ4MappedFile ( );
+}
+
+unsigned int LZ4Dictionary::dictID ( ) const noexcept { return dict_id; }
+
+LZ4DictionaryTrainer::LZ4DictionaryTrainer ( std::size_t const max_samples_size_ ) : m_max_samples_size ( max_samples_size_ ) {}
+
+void LZ4DictionaryTrainer::addSample ( void const * data_, std::size_t const size_ ) {
+    if ( 0u == size_ )
+        return;
+    char const * const data = static_cast<char const *> ( data_ );
+    std::vector<char> sample ( data, data + std::min ( size_, m_max_samples_size ) );
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    m_samples_size += sample.size ( );
+    m_samples.push_back ( std::move ( sample ) );
+    while ( m_samples_size > m_max_samples_size ) {
+        m_samples_size -= m_samples.front ( ).size ( );
+        m_samples.pop_front ( );
+    }
+}
+
+std::size_t LZ4DictionaryTrainer::samples ( ) const {
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    return m_samples.size ( );
+}
+
+std::size_t LZ4DictionaryTrainer::samplesSize ( ) const {
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    return m_samples_size;
+}
+
+void LZ4DictionaryTrainer::clear ( ) {
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    m_samples.clear ( );
+    m_samples_size = 0u;
+}
+
+LZ4Dictionary LZ4DictionaryTrainer::train ( std::size_t const capacity_ ) const {
+    std::vector<char> samples;
+    std::vector<std::size_t> sizes;
+    {
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        samples.reserve ( m_samples_size );
+        sizes.reserve ( m_samples.size ( ) );
+        for ( std::vector<char> const & sample : m_samples ) {
+            samples.insert ( samples.end ( ), sample.begin ( ), sample.end ( ) );
+            sizes.push_back ( sample.size ( ) );
+        }
+    }
+    std::vector<char> dictionary ( capacity_ );
+    std::size_t const size = ZDICT_trainFromBuffer ( dictionary.data ( ), dictionary.size ( ), samples.data ( ), sizes.data ( ),
+                                                     static_cast<unsigned int> ( sizes.size ( ) ) );
+    if ( ZDICT_isError ( size ) )
+        throw std::runtime_error ( "Failed to train LZ4-dictionary." );
+    return LZ4Dictionary ( dictionary.data ( ), size );
+}
+
+void LZ4DictionaryRegistry::add ( LZ4Dictionary const & dictionary_ ) {
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    m_dictionaries[ dictionary_.dictID ( ) ] = &dictionary_;
+}
+
+void LZ4DictionaryRegistry::add ( LZ4Dictionary && dictionary_ ) {
+    std::unique_ptr<LZ4Dictionary> owned = std::make_unique<LZ4Dictionary> ( std::move ( dictionary_ ) );
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    m_dictionaries[ owned->dictID ( ) ] = owned.get ( );
+    m_owned.push_back ( std::move ( owned ) );
+}
+
+LZ4Dictionary const * LZ4DictionaryRegistry::find ( unsigned int const dict_id_ ) const {
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    auto const found = m_dictionaries.find ( dict_id_ );
+    return m_dictionaries.end ( ) == found ? nullptr : found->second;
+}
+
+LZ4MappedFile::LZ4MappedFile ( std::filesystem::path const & path_ ) {
+#ifdef _WIN32
+    HANDLE file =
+        CreateFileW ( path_.c_str ( ), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if ( INVALID_HANDLE_VALUE == file )
+        throw std::runtime_error ( "Failed to open file." );
+    LARGE_INTEGER file_size;
+    if ( not GetFileSizeEx ( file, &file_size ) ) {
+        CloseHandle ( file );
+        throw std::runtime_error ( "Failed to get file size." );
+    }
+    m_size = ( std::size_t ) file_size.QuadPart;
+    if ( m_size ) {
+        HANDLE mapping = CreateFileMappingW ( file, NULL, PAGE_READONLY, 0, 0, NULL );
+        CloseHandle ( file );
+        if ( not mapping )
+            throw std::runtime_error ( "Failed to map file." );
+        // The view keeps the mapping alive.
+        m_data = MapViewOfFile ( mapping, FILE_MAP_READ, 0, 0, 0 );
+        CloseHandle ( mapping );
+        if ( not m_data )
+            throw std::runtime_error ( "Failed to map file." );
+    }
+    else
+        CloseHandle ( file );
+#else
+    int const file = ::open ( path_.c_str ( ), O_RDONLY );
+    if ( -1 == file )
+        throw std::runtime_error ( "Failed to open file." );
+    struct stat file_status;
+    if ( -1 == ::fstat ( file, &file_status ) ) {
+        ::close ( file );
+        throw std::runtime_error ( "Failed to get file size." );
+    }
+    m_size = ( std::size_t ) file_status.st_size;
+    if ( m_size ) {
+        // The mapping keeps the file alive.
+        m_data = ::mmap ( nullptr, m_size, PROT_READ, MAP_SHARED, file, 0 );
+        ::close ( file );
+        if ( MAP_FAILED == m_data ) {
+            m_data = nullptr;
+            throw std::runtime_error ( "Failed to map file." );
+        }
+        ::madvise ( m_data, m_size, MADV_SEQUENTIAL );
+    }
+    else
+        ::close ( file );
+#endif
+}
+
+LZ4MappedFile::LZ4MappedFile ( LZ4MappedFile && other_ ) noexcept : m_data ( other_.m_data ), m_size ( other_.m_size ) {
+    other_.m_data = nullptr;
+    other_.m_size = 0u;
+}
+
+LZ4MappedFile::~LZ4MappedFile ( ) { unmap ( ); }
+
+[[maybe_unused]] LZ4MappedFile & LZ4MappedFile::operator= ( LZ4MappedFile && other_ ) noexcept {
+    if ( this != &other_ ) {
+        unmap ( );
+        m_data        = other_.m_data;
+        m_size        = other_.m_size;
+        other_.m_data = nullptr;
+        other_.m_size = 0u;
+    }
+    return *this;
+}
+
+void LZ4MappedFile::unmap ( ) noexcept {
+    if ( nullptr != m_data ) {
+#ifdef _WIN32
+        UnmapViewOfFile ( m_data );
+#else
+        ::munmap ( m_data, m_size );
+#endif
+        m_data = nullptr;
+        m_size = 0u;
+    }
+}
+
+LZ4ContextPool::LZ4ContextPool ( std::pmr::memory_resource * resource_ ) noexcept : m_resource ( resource_ ) {}
+
+LZ4ContextPool::~LZ4ContextPool ( ) {
+    for ( LZ4F_cctx * context : m_compression_contexts )
+        LZ4F_freeCompressionContext ( context );
+    for ( LZ4F_dctx * context : m_decompression_contexts )
+        LZ4F_freeDecompressionContext ( context );
+}
+
+LZ4F_cctx * LZ4ContextPool::acquireCompressionContext ( ) {
+    {
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        if ( not m_compression_contexts.empty ( ) ) {
+            LZ4F_cctx * context = m_compression_contexts.back ( );
+            m_compression_contexts.pop_back ( );
+            return context;
+        }
+    }
+    return create_compression_context ( m_resource );
+}
+
+LZ4F_dctx * LZ4ContextPool::acquireDecompressionContext ( ) {
+    {
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        if ( not m_decompression_contexts.empty ( ) ) {
+            LZ4F_dctx * context = m_decompression_contexts.back ( );
+            m_decompression_contexts.pop_back ( );
+            return context;
+        }
+    }
+    return create_decompression_context ( m_resource );
+}
+
+std::pmr::vector<char> LZ4ContextPool::acquireBuffer ( std::size_t const size_ ) {
+    std::pmr::vector<char> buffer ( buffer_resource ( m_resource ) );
+    {
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        // Prefer a buffer of the exact size (no zeroing), else any buffer that is large enough (no allocation).
+        auto it = std::find_if ( m_buffers.begin ( ), m_buffers.end ( ),
+                                 [ size_ ] ( std::pmr::vector<char> const & buffer_ ) { return buffer_.size ( ) == size_; } );
+        if ( m_buffers.end ( ) == it )
+            it = std::find_if ( m_buffers.begin ( ), m_buffers.end ( ),
+                                [ size_ ] ( std::pmr::vector<char> const & buffer_ ) { return buffer_.capacity ( ) >= size_; } );
+        if ( m_buffers.end ( ) != it ) {
+            buffer = std::move ( *it );
+            *it    = std::move ( m_buffers.back ( ) );
+            m_buffers.pop_back ( );
+        }
+    }
+    buffer.resize ( size_ );
+    return buffer;
+}
+
+void LZ4ContextPool::release ( LZ4F_cctx * context_ ) {
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    m_compression_contexts.push_back ( context_ );
+}
+
+void LZ4ContextPool::release ( LZ4F_dctx * context_ ) {
+    LZ4F_resetDecompressionContext ( context_ );
+    std::lock_guard<std::mutex> lock ( m_mutex );
+    m_decompression_contexts.push_back ( context_ );
+}
+
+void LZ4ContextPool::release ( std::pmr::vector<char> && buffer_ ) {
+    if ( buffer_.capacity ( ) ) {
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        m_buffers.push_back ( std::move ( buffer_ ) );
+    }
+}
+
+double LZ4Stats::ratio ( ) const noexcept {
+    return compressed_bytes ? static_cast<double> ( uncompressed_bytes ) / compressed_bytes : 0.0;
+}
+
 static constexpr LZ4F_preferences_t DEFAULT_PREFERENCES = {
     { LZ4F_max256KB, LZ4F_blockLinked, LZ4F_noContentChecksum, LZ4F_frame, 0 /* unknown content size */, 0 /* no dictID */,
       LZ4F_noBlockChecksum },
@@ -90,281 +482,3083 @@ static constexpr LZ4F_preferences_t DEFAULT_PREFERENCES = {
     { 0, 0, 0 }, /* reserved, must be set to 0 */
 };
 
-class LZ4OStreamBuf final : public std::streambuf {
+// The header of the message streams of LZ4MessageWriter: magic, maximum message size, both 32 bits little endian.
+static constexpr std::uint32_t MESSAGE_STREAM_MAGIC = 0x4D345A4Cu; // "LZ4M".
+
+// The ring buffer of a message stream keeps at least the 64 KB of history a block can refer to. Both sides wrap around at
+// the same positions, so the history of the reader is where the writer had it.
+[[nodiscard]] static constexpr std::size_t message_ring_size ( std::size_t const max_message_size_ ) noexcept {
+    return 64u * 1024u + max_message_size_;
+}
+
+[[nodiscard]] static LZ4Options level_options ( int const compression_level_,
+                                                LZ4F_blockSizeID_t const block_size_ = LZ4F_max256KB ) noexcept {
+    LZ4Options options;
+    options.compression_level = compression_level_;
+    options.block_size        = block_size_;
+    return options;
+}
+
+[[nodiscard]] static LZ4Options buffer_options ( std::size_t const buffer_size_ ) noexcept {
+    LZ4Options options;
+    options.buffer_size = buffer_size_;
+    return options;
+}
+
+// Returns the maximum block size in bytes, for a block size id.
+[[nodiscard]] static constexpr std::size_t block_size ( LZ4F_blockSizeID_t const id_ ) noexcept {
+    return LZ4F_default == id_ ? block_size ( LZ4F_max64KB ) : std::size_t{ 1 } << ( 8 + 2 * id_ );
+}
+
+// The memory LZ4F allocates in a compression context (as of lz4 1.9): the match finder state, the block being filled (not
+// with autoFlush) and the history of linked blocks.
+[[nodiscard]] static std::size_t compression_context_size ( LZ4F_preferences_t const & preferences_ ) noexcept {
+    std::size_t const state =
+        preferences_.compressionLevel < LZ4HC_CLEVEL_MIN ? sizeof ( LZ4_stream_t ) : sizeof ( LZ4_streamHC_t );
+    std::size_t const history = LZ4F_blockLinked == preferences_.frameInfo.blockMode ? 64u * 1024u : 0u;
+    return state + ( preferences_.autoFlush ? history : block_size ( preferences_.frameInfo.blockSizeID ) + 2u * history );
+}
+
+// The memory LZ4F allocates in a decompression context (as of lz4 1.9), once the frame header is read: the staging buffers of
+// the compressed and the decompressed block, and the history of linked blocks.
+[[nodiscard]] static std::size_t decompression_context_size ( LZ4F_frameInfo_t const & info_ ) noexcept {
+    std::size_t const block = block_size ( info_.blockSizeID );
+    return 2u * block + 4u + ( LZ4F_blockLinked == info_.blockMode ? 128u * 1024u : 0u );
+}
+
+[[nodiscard]] static std::uint32_t read_le32 ( char const * src_ ) noexcept {
+    unsigned char const * const p = reinterpret_cast<unsigned char const *> ( src_ );
+    return std::uint32_t{ p[ 0 ] } | std::uint32_t{ p[ 1 ] } << 8 | std::uint32_t{ p[ 2 ] } << 16 | std::uint32_t{ p[ 3 ] } << 24;
+}
+
+[[nodiscard]] static std::uint64_t read_le64 ( char const * src_ ) noexcept {
+    return std::uint64_t{ read_le32 ( src_ ) } | std::uint64_t{ read_le32 ( src_ + 4 ) } << 32;
+}
+
+static void write_le32 ( char * dest_, std::uint32_t const value_ ) noexcept {
+    for ( int i = 0; i < 4; ++i )
+        dest_[ i ] = static_cast<char> ( value_ >> ( 8 * i ) );
+}
+
+static void write_le64 ( char * dest_, std::uint64_t const value_ ) noexcept {
+    write_le32 ( dest_, static_cast<std::uint32_t> ( value_ ) );
+    write_le32 ( dest_ + 4, static_cast<std::uint32_t> ( value_ >> 32 ) );
+}
+
+// Whether LZ4 can't shrink [ data_, data_ + size_ ) to ratio_ of its size (LZ4Options::incompressible_ratio). The order-0
+// entropy of up to 64 samples of 64 bytes, spread over the range, lets most data through at next to no cost. Only data of
+// high entropy, which may still be made of repeats (the samples can't tell), gets a trial compression at the fastest level,
+// into a buffer of the target size: LZ4 stops as soon as it's full, and skips through data without matches in big steps.
+// Ranges too small to sample are always compressed.
+[[nodiscard]] static bool incompressible ( char const * data_, std::size_t const size_, double const ratio_ ) {
+    constexpr std::size_t SAMPLE = 64u;
+    if ( ratio_ <= 0.0 or size_ < 16u * SAMPLE or size_ > LZ4_MAX_INPUT_SIZE )
+        return false;
+    std::size_t const samples = std::min<std::size_t> ( size_ / SAMPLE, 64u );
+    std::array<std::uint32_t, 256> frequencies{ };
+    for ( std::size_t i = 0u; i < samples; ++i ) {
+        unsigned char const * const sample =
+            reinterpret_cast<unsigned char const *> ( data_ ) + i * ( size_ - SAMPLE ) / ( samples - 1u );
+        for ( std::size_t j = 0u; j < SAMPLE; ++j )
+            ++frequencies[ sample[ j ] ];
+    }
+    double const count = static_cast<double> ( samples * SAMPLE );
+    double entropy     = 0.0;
+    for ( std::uint32_t const frequency : frequencies )
+        if ( frequency )
+            entropy -= frequency / count * std::log2 ( frequency / count );
+    if ( entropy / 8.0 <= ratio_ )
+        return false;
+    thread_local std::vector<char> trial;
+    trial.resize ( static_cast<std::size_t> ( ratio_ * static_cast<double> ( size_ ) ) );
+    return 0 == LZ4_compress_fast ( data_, trial.data ( ), static_cast<int> ( size_ ), static_cast<int> ( trial.size ( ) ), 1 );
+}
+
+LZ4FrameSettings::LZ4FrameSettings ( LZ4Options const & options_, LZ4Dictionary const * dictionary_ ) noexcept :
+    preferences ( DEFAULT_PREFERENCES ), dictionary ( dictionary_ ) {
+    preferences.frameInfo.blockSizeID         = options_.block_size;
+    preferences.frameInfo.blockMode           = options_.block_mode;
+    preferences.frameInfo.contentChecksumFlag = static_cast<LZ4F_contentChecksum_t> ( options_.content_checksum );
+    preferences.frameInfo.blockChecksumFlag   = static_cast<LZ4F_blockChecksum_t> ( options_.block_checksum );
+    preferences.frameInfo.contentSize         = options_.content_size;
+    preferences.frameInfo.dictID              = dictionary ? dictionary->dict_id : 0u;
+    preferences.compressionLevel              = options_.compression_level;
+    preferences.favorDecSpeed                 = options_.favor_dec_speed;
+}
+
+void LZ4FrameSettings::finalize ( LZ4Options const & options_ ) {
+    // LZ4F can't store a linked block uncompressed, the option would silently do nothing.
+    if ( options_.incompressible_ratio > 0.0 and LZ4F_blockIndependent != preferences.frameInfo.blockMode )
+        throw std::runtime_error ( "Error during LZ4 stream creation, incompressible blocks need independent blocks" );
+    incompressible_ratio = options_.incompressible_ratio;
+}
+
+std::size_t LZ4FrameSettings::begin ( LZ4F_cctx * context_, char * dest_, std::size_t const capacity_ ) const {
+    std::size_t const header_size =
+        dictionary ? LZ4F_compressBegin_usingCDict ( context_, dest_, capacity_, dictionary->cdict, &preferences )
+                   : LZ4F_compressBegin ( context_, dest_, capacity_, &preferences );
+    if ( LZ4F_isError ( header_size ) )
+        throw std::runtime_error ( "Error during LZ4 stream initialization" );
+    return header_size;
+}
+
+std::size_t LZ4FrameSettings::update ( LZ4F_cctx * context_, char * dest_, std::size_t const capacity_, char const * src_,
+                                       std::size_t const size_ ) const {
+    std::size_t const compressed_size = incompressible ( src_, size_, incompressible_ratio )
+                                            ? LZ4F_uncompressedUpdate ( context_, dest_, capacity_, src_, size_, nullptr )
+                                            : LZ4F_compressUpdate ( context_, dest_, capacity_, src_, size_, nullptr );
+    if ( LZ4F_isError ( compressed_size ) )
+        throw std::runtime_error ( "Error during LZ4 stream writing" );
+    return compressed_size;
+}
+
+// The container of LZ4BatchCompressor::pack ( ):
+//
+//     magic (BATCH_MAGIC), payload count, block offsets ( count + 1 ), payload sizes ( count ), blocks ...
+//
+// Offsets are 64 bits and relative to the first block, all other fields 32 bits, all little endian. A block of the size of its
+// payload is the payload itself, compressed blocks are only stored if they are smaller.
+static constexpr std::uint32_t BATCH_MAGIC = 0x50345A4Cu; // "LZ4P".
+
+// A snapshot of LZ4SnapshotWriter:
+//
+//     magic (SNAPSHOT_MAGIC), kind (0 == base, 1 == delta), size, compressed size, blocks ( block size, block ) ...
+//
+// The sizes are 64 bits, all other fields 32 bits, all little endian. The compressed size is that of the blocks (and their
+// sizes), a reader skips a snapshot without decompressing it. A snapshot has ceil ( size / SNAPSHOT_BLOCK ) blocks,
+// the block size of a raw block has SNAPSHOT_RAW set, that of a block equal to the same bytes of the previous snapshot is 0
+// (and there's no block).
+static constexpr std::uint32_t SNAPSHOT_MAGIC = 0x44345A4Cu; // "LZ4D".
+static constexpr std::uint32_t SNAPSHOT_RAW   = 0x80000000u;
+static constexpr std::size_t SNAPSHOT_HEADER  = 24u;
+// With the dictionary ending where the block ends, content that stayed in place is SNAPSHOT_BLOCK bytes back, within reach
+// of an LZ4 match (< 64 KB).
+static constexpr std::size_t SNAPSHOT_BLOCK      = 32u * 1024u;
+static constexpr std::size_t SNAPSHOT_DICTIONARY = 64u * 1024u;
+
+// A batch starts a thread per this much input at most.
+static constexpr std::size_t BATCH_THREAD_INPUT = 64u * 1024u;
+
+// The threads a batch is spread over: as configured, but no more than one per item and one per BATCH_THREAD_INPUT bytes.
+[[nodiscard]] static std::size_t batch_threads ( unsigned int const threads_, std::size_t const count_,
+                                                 std::size_t const input_size_ ) noexcept {
+    std::size_t const threads = threads_ ? threads_ : std::thread::hardware_concurrency ( );
+    return std::max<std::size_t> ( std::min ( { threads, count_, input_size_ / BATCH_THREAD_INPUT } ), 1u );
+}
+
+// The worker threads of the batch API, started once and kept for the batches to come. The parts of a batch are queued, the
+// calling thread takes the first part itself and waits for the others. Batches of several threads may share a pool, their
+// parts are taken in the order they were queued.
+class LZ4BatchPool final {
     public:
-    LZ4OStreamBuf ( std::streambuf * buffer, int const compression_level_ ) :
-        m_sink ( buffer ), m_preferences ( DEFAULT_PREFERENCES ), m_dictionary ( nullptr ) {
-        std::size_t ctx_creation = LZ4F_createCompressionContext ( &m_compression_ctx, LZ4F_VERSION );
-        if ( LZ4F_isError ( ctx_creation ) )
-            throw std::runtime_error ( "Error during LZ4 stream creation" );
-        m_preferences.compressionLevel = compression_level_;
-        // Setup buffers.
-        std::size_t internal_buffer_size_ = LZ4F_compressBound ( 0, &m_preferences );
-        internal_buffer_size_             = std::max<std::size_t> ( internal_buffer_size_, LZ4F_HEADER_SIZE_MAX ) + 1;
-        m_write_area.resize ( internal_buffer_size_ );
-        m_compression_buffer.resize ( internal_buffer_size_ );
-        // Setup the write are buffer. Last byte is for the overflow operation.
-        setp ( &m_write_area.front ( ), &m_write_area.front ( ) + m_write_area.size ( ) - 1 );
-        initialize_stream ( );
-    }
-    LZ4OStreamBuf ( std::streambuf * buffer, int const compression_level_, LZ4Dictionary const & dictionary_ ) :
-        m_sink ( buffer ), m_preferences ( DEFAULT_PREFERENCES ), m_dictionary ( &dictionary_ ) {
-        std::size_t ctx_creation = LZ4F_createCompressionContext ( &m_compression_ctx, LZ4F_VERSION );
-        if ( LZ4F_isError ( ctx_creation ) )
-            throw std::runtime_error ( "Error during LZ4 stream creation" );
-        m_preferences.compressionLevel = compression_level_;
-        // Setup buffers.
-        std::size_t internal_buffer_size_ = LZ4F_compressBound ( 0, &m_preferences );
-        internal_buffer_size_             = std::max<std::size_t> ( internal_buffer_size_, LZ4F_HEADER_SIZE_MAX ) + 1;
-        m_write_area.resize ( internal_buffer_size_ );
-        m_compression_buffer.resize ( internal_buffer_size_ );
-        // Setup the write are buffer. Last byte is for the overflow operation.
-        setp ( &m_write_area.front ( ), &m_write_area.front ( ) + m_write_area.size ( ) - 1 );
-        initialize_stream ( );
-    }
-
-    virtual ~LZ4OStreamBuf ( ) {
-        close ( );
-        LZ4F_freeCompressionContext ( m_compression_ctx );
+    explicit LZ4BatchPool ( std::size_t const workers_ ) {
+        m_workers.reserve ( workers_ );
+        for ( std::size_t i = 0u; i < workers_; ++i )
+            m_workers.emplace_back ( &LZ4BatchPool::work, this );
     }
 
-    void close ( ) {
-        static bool is_open = true;
-        if ( is_open ) {
-            compress_buffer ( );
-            m_sink->pubsync ( );
-            std::size_t compressed_size =
-                LZ4F_compressEnd ( m_compression_ctx, m_compression_buffer.data ( ), m_compression_buffer.size ( ), nullptr );
-            if ( LZ4F_isError ( compressed_size ) )
-                throw std::runtime_error ( "Error during LZ4 stream finalization" );
-            m_sink->sputn ( m_compression_buffer.data ( ), compressed_size );
-            is_open = false;
+    ~LZ4BatchPool ( ) {
+        {
+            std::lock_guard<std::mutex> lock ( m_mutex );
+            m_stop = true;
         }
+        m_task_available.notify_all ( );
+        for ( std::thread & worker : m_workers )
+            worker.join ( );
     }
 
-    protected:
-    [[nodiscard]] virtual int_type overflow ( int_type ch ) override {
-        *pptr ( ) = traits_type::to_char_type ( ch );
-        pbump ( 1 );
-        compress_buffer ( );
-        return ch;
-    }
+    LZ4BatchPool ( LZ4BatchPool const & ) = delete;
+    LZ4BatchPool & operator= ( LZ4BatchPool const & ) = delete;
 
-    [[nodiscard]] virtual int sync ( ) override {
-        compress_buffer ( );
-        return m_sink->pubsync ( );
+    // Runs function_ ( thread, begin, end ) for threads_ parts, the first on the calling thread. Part t takes the items
+    // [ count_ * t / threads_, count_ * ( t + 1 ) / threads_ ). Rethrows the exception of the first part that failed.
+    template<typename Function>
+    void run ( std::size_t const threads_, std::size_t const count_, Function const & function_ ) {
+        std::vector<std::exception_ptr> errors ( threads_ );
+        Batch batch;
+        batch.part = [ & ] ( std::size_t const thread_ ) {
+            try {
+                function_ ( thread_, count_ * thread_ / threads_, count_ * ( thread_ + 1u ) / threads_ );
+            }
+            catch ( ... ) {
+                errors[ thread_ ] = std::current_exception ( );
+            }
+        };
+        batch.remaining = threads_ - 1u;
+        {
+            std::lock_guard<std::mutex> lock ( m_mutex );
+            for ( std::size_t i = 1u; i < threads_; ++i )
+                m_tasks.push_back ( { &batch, i } );
+        }
+        m_task_available.notify_all ( );
+        batch.part ( 0u );
+        // Takes queued parts too, of any batch, there may be fewer workers than parts (or none).
+        std::unique_lock<std::mutex> lock ( m_mutex );
+        while ( batch.remaining ) {
+            if ( m_tasks.empty ( ) )
+                m_batch_done.wait ( lock );
+            else
+                run_front ( lock );
+        }
+        lock.unlock ( );
+        for ( std::exception_ptr const & error : errors )
+            if ( error )
+                std::rethrow_exception ( error );
     }
 
     private:
-    void initialize_stream ( ) {
-        std::size_t header_size = 0u;
-        if ( m_dictionary )
-            header_size =
-                LZ4F_compressBegin_usingCDict ( m_compression_ctx, m_compression_buffer.data ( ), m_compression_buffer.size ( ),
-                                                ( LZ4F_CDict const * ) m_dictionary->data, &m_preferences );
-        else
-            header_size = LZ4F_compressBegin ( m_compression_ctx, m_compression_buffer.data ( ), m_compression_buffer.size ( ),
-                                               &m_preferences );
-        if ( LZ4F_isError ( header_size ) )
-            throw std::runtime_error ( "Error during LZ4 stream initialization" );
-        m_sink->sputn ( m_compression_buffer.data ( ), header_size );
+    struct Batch {
+        std::function<void ( std::size_t )> part; // Doesn't throw.
+        std::size_t remaining;                    // The queued parts not done yet.
+    };
+    struct Task {
+        Batch * batch;
+        std::size_t thread;
+    };
+
+    // Runs the oldest queued part, unlocked.
+    void run_front ( std::unique_lock<std::mutex> & lock_ ) {
+        Task const task = m_tasks.front ( );
+        m_tasks.pop_front ( );
+        lock_.unlock ( );
+        task.batch->part ( task.thread );
+        lock_.lock ( );
+        if ( 0u == --task.batch->remaining )
+            m_batch_done.notify_all ( );
     }
 
-    void finalize_stream ( ) {
-        compress_buffer ( );
-        std::size_t compressed_size =
-            LZ4F_compressEnd ( m_compression_ctx, m_compression_buffer.data ( ), m_compression_buffer.size ( ), nullptr );
-        if ( LZ4F_isError ( compressed_size ) )
-            throw std::runtime_error ( "Error during LZ4 stream finalization" );
-        m_sink->sputn ( m_compression_buffer.data ( ), compressed_size );
+    void work ( ) {
+        std::unique_lock<std::mutex> lock ( m_mutex );
+        while ( true ) {
+            m_task_available.wait ( lock, [ this ] { return m_stop or not m_tasks.empty ( ); } );
+            if ( m_tasks.empty ( ) )
+                break;
+            run_front ( lock );
+        }
     }
 
-    [[maybe_unused]] std::size_t compress_buffer ( ) {
-        std::size_t num_bytes       = std::distance ( pbase ( ), pptr ( ) );
-        std::size_t compressed_size = LZ4F_compressUpdate ( m_compression_ctx, m_compression_buffer.data ( ),
-                                                            m_compression_buffer.size ( ), pbase ( ), num_bytes, nullptr );
-        if ( LZ4F_isError ( compressed_size ) )
-            throw std::runtime_error ( "Error during LZ4 stream writing" );
-        setp ( &m_write_area.front ( ), &m_write_area.front ( ) + m_write_area.size ( ) - 1 );
-        return m_sink->sputn ( m_compression_buffer.data ( ), compressed_size );
+    std::deque<Task> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_task_available, m_batch_done;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+};
+
+// The pool of the batches of no compressor (LZ4BatchReader::readAll ( )), of a worker per hardware thread but one (the
+// calling thread).
+[[nodiscard]] static LZ4BatchPool & shared_batch_pool ( ) {
+    static LZ4BatchPool pool ( std::max ( std::thread::hardware_concurrency ( ), 1u ) - 1u );
+    return pool;
+}
+
+// Runs a batch of threads_ parts on pool_, or of one part on the calling thread (pool_ may then be nullptr).
+template<typename Function>
+static void run_batch ( LZ4BatchPool * pool_, std::size_t const threads_, std::size_t const count_, Function const & function_ ) {
+    if ( threads_ > 1u )
+        pool_->run ( threads_, count_, function_ );
+    else
+        function_ ( 0u, 0u, count_ );
+}
+
+// Adds the time it lives to a duration, if there is one.
+class LZ4ScopedTimer final {
+    public:
+    explicit LZ4ScopedTimer ( std::chrono::nanoseconds * duration_ ) noexcept :
+        m_duration ( duration_ ) {
+        if ( m_duration )
+            m_start = std::chrono::steady_clock::now ( );
+    }
+    ~LZ4ScopedTimer ( ) {
+        if ( m_duration )
+            *m_duration += std::chrono::duration_cast<std::chrono::nanoseconds> ( std::chrono::steady_clock::now ( ) - m_start );
     }
 
-    private : std::streambuf * m_sink;
-    LZ4F_cctx * m_compression_ctx;
-    LZ4F_preferences_t m_preferences;
-    LZ4Dictionary const * m_dictionary;
-    std::vector<char> m_write_area;
-    std::vector<char> m_compression_buffer;
+    LZ4ScopedTimer ( LZ4ScopedTimer const & ) = delete;
+    LZ4ScopedTimer & operator= ( LZ4ScopedTimer const & ) = delete;
+
+    private:
+    std::chrono::nanoseconds * m_duration;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// The frame descriptor flags that matter for splitting a frame into its blocks.
+struct LZ4FrameHeader {
+    std::size_t block_size = 0u;
+    bool linked = false, block_checksum = false, content_checksum = false;
+    std::uint64_t content_size = 0u;
+    unsigned int dict_id       = 0u;
+};
+
+// Parses a complete frame header (magic number included).
+[[nodiscard]] static LZ4FrameHeader parse_frame_header ( std::vector<char> const & header_ ) {
+    unsigned char const flags         = static_cast<unsigned char> ( header_[ 4 ] );
+    unsigned char const block_size_id = ( static_cast<unsigned char> ( header_[ 5 ] ) >> 4 ) & 0x07u;
+    if ( block_size_id < LZ4F_max64KB )
+        throw std::runtime_error ( "Error during LZ4 decompression, corrupt frame header" );
+    LZ4FrameHeader header;
+    header.block_size       = block_size ( static_cast<LZ4F_blockSizeID_t> ( block_size_id ) );
+    header.linked           = not( flags & 0x20u );
+    header.block_checksum   = flags & 0x10u;
+    header.content_checksum = flags & 0x04u;
+    if ( flags & 0x08u )
+        header.content_size = read_le64 ( header_.data ( ) + 6 );
+    if ( flags & 0x01u )
+        header.dict_id = read_le32 ( header_.data ( ) + ( flags & 0x08u ? 14 : 6 ) );
+    return header;
+}
+
+// Reads the rest of a frame header, of which the magic number was read into header_ already.
+static void read_frame_header ( std::streambuf * source_, std::vector<char> & header_ ) {
+    header_.resize ( LZ4F_HEADER_SIZE_MAX );
+    if ( 1 != source_->sgetn ( header_.data ( ) + 4u, 1u ) )
+        throw std::runtime_error ( "Error during LZ4 decompression, truncated source" );
+    std::size_t const header_size = LZ4F_headerSize ( header_.data ( ), 5u );
+    if ( LZ4F_isError ( header_size ) )
+        throw std::runtime_error ( "Error during LZ4 decompression, corrupt frame header" );
+    std::streamsize const rest = static_cast<std::streamsize> ( header_size - 5u );
+    if ( rest != source_->sgetn ( header_.data ( ) + 5u, rest ) )
+        throw std::runtime_error ( "Error during LZ4 decompression, truncated source" );
+    header_.resize ( header_size );
+}
+
+// The block index of a seekable frame, it's written after the frame, in a skippable frame of the layout:
+//
+//     magic (SEEK_INDEX_FRAME_MAGIC), frame size, entries ( compressed offset, uncompressed offset ) ... , entry count,
+//     SEEK_INDEX_MAGIC
+//
+// Offsets are 64 bits, all other fields 32 bits, all little endian. Offsets are relative to the start of the frame, entry i
+// is the start of block i, the last entry is the end of the last block (the position of the end mark and the content size).
+struct LZ4BlockIndex {
+    static constexpr std::uint32_t SEEK_INDEX_FRAME_MAGIC = LZ4F_MAGIC_SKIPPABLE_START + 0xEu;
+    static constexpr std::uint32_t SEEK_INDEX_MAGIC       = 0x53345A4Cu; // "LZ4S".
+
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> entries;
+
+    void append ( std::size_t const compressed_size_, std::size_t const uncompressed_size_ ) {
+        entries.emplace_back ( entries.back ( ).first + compressed_size_, entries.back ( ).second + uncompressed_size_ );
+    }
+
+    [[nodiscard]] std::vector<char> serialize ( ) const {
+        std::vector<char> frame ( 8u + 16u * entries.size ( ) + 8u );
+        write_le32 ( frame.data ( ), SEEK_INDEX_FRAME_MAGIC );
+        write_le32 ( frame.data ( ) + 4, static_cast<std::uint32_t> ( frame.size ( ) - 8u ) );
+        char * p = frame.data ( ) + 8;
+        for ( auto const & entry : entries ) {
+            write_le64 ( p, entry.first );
+            write_le64 ( p + 8, entry.second );
+            p += 16;
+        }
+        write_le32 ( p, static_cast<std::uint32_t> ( entries.size ( ) ) );
+        write_le32 ( p + 4, SEEK_INDEX_MAGIC );
+        return frame;
+    }
+
+    // Loads the index of the frame at frame_start_ from the end of the source, returns false if there is none (or the source
+    // can't seek). The index of a later frame, appended to the source, is not taken.
+    [[nodiscard]] bool load ( std::streambuf * source_, std::streamoff const frame_start_ ) {
+        std::streamoff const end = source_->pubseekoff ( 0, std::ios_base::end, std::ios_base::in );
+        if ( end < 16 + 16 )
+            return false;
+        char footer[ 8 ];
+        if ( std::streamoff ( -1 ) == source_->pubseekpos ( end - 8, std::ios_base::in ) or 8 != source_->sgetn ( footer, 8 ) or
+             SEEK_INDEX_MAGIC != read_le32 ( footer + 4 ) )
+            return false;
+        std::uint64_t const count      = read_le32 ( footer );
+        std::uint64_t const frame_size = 8u + 16u * count + 8u;
+        if ( 0u == count or static_cast<std::uint64_t> ( end ) < frame_size )
+            return false;
+        std::vector<char> frame ( frame_size - 8u );
+        if ( std::streamoff ( -1 ) == source_->pubseekpos ( end - static_cast<std::streamoff> ( frame_size ), std::ios_base::in ) or
+             static_cast<std::streamsize> ( frame.size ( ) ) != source_->sgetn ( frame.data ( ), frame.size ( ) ) or
+             SEEK_INDEX_FRAME_MAGIC != read_le32 ( frame.data ( ) ) or frame_size - 8u != read_le32 ( frame.data ( ) + 4 ) )
+            return false;
+        entries.resize ( count );
+        char const * p = frame.data ( ) + 8;
+        for ( auto & entry : entries ) {
+            entry = { read_le64 ( p ), read_le64 ( p + 8 ) };
+            p += 16;
+        }
+        // The index directly follows the end mark of its frame.
+        if ( static_cast<std::uint64_t> ( end - frame_start_ ) - frame_size != entries.back ( ).first + 4u ) {
+            entries.clear ( );
+            return false;
+        }
+        return true;
+    }
 };
 
-class LZ4IStreamBuf final : public std::streambuf {
+// Compresses independent blocks on a pool of worker threads and writes them to the sink in submission order. Each worker
+// starts a single-block frame and keeps only the block itself (the frame header is dropped), so the blocks written make up
+// the body of one standard LZ4 frame, of which the header and end mark are written by the owning stream buffer. The input
+// buffers are allocated (and freed) on the writing thread, from the resource of the write area.
+class LZ4ParallelCompressor final {
     public:
-    LZ4IStreamBuf ( std::streambuf * source_, std::size_t const internal_buffer_size_ = 4096u ) :
-        m_source ( source_ ), m_context ( nullptr ), m_dictionary ( nullptr ), m_src_buffer ( internal_buffer_size_ ),
-        m_read_area ( internal_buffer_size_ ), m_src_offset ( 0 ), m_src_size ( 0 ) {
-        std::size_t status = LZ4F_createDecompressionContext ( &m_context, LZ4F_VERSION );
-        if ( LZ4F_isError ( status ) )
-            throw std::runtime_error ( "Error during LZ4 istream creation" );
-        setg ( &m_read_area.front ( ), &m_read_area.front ( ), &m_read_area.front ( ) );
+    LZ4ParallelCompressor ( std::streambuf * sink_, LZ4FrameSettings const & settings_, LZ4ParallelOptions const & options_,
+                            LZ4BlockIndex * index_, std::pmr::memory_resource * resource_ ) :
+        m_sink ( sink_ ),
+        m_settings ( settings_ ), m_index ( index_ ), m_resource ( resource_ ), m_max_in_flight ( options_.max_in_flight ) {
+        // Every block is flushed by the update, the frame is never ended by the workers.
+        m_settings.preferences.autoFlush                     = 1;
+        m_settings.preferences.frameInfo.contentChecksumFlag = LZ4F_noContentChecksum;
+        m_settings.preferences.frameInfo.contentSize         = 0;
+        unsigned int threads = options_.threads ? options_.threads : std::thread::hardware_concurrency ( );
+        threads              = std::max ( threads, 1u );
+        m_workers.reserve ( threads );
+        for ( unsigned int i = 0u; i < threads; ++i )
+            m_workers.emplace_back ( &LZ4ParallelCompressor::work, this );
     }
-    LZ4IStreamBuf ( std::streambuf * source_, LZ4Dictionary const & dictionary_, std::size_t const internal_buffer_size_ = 4096u ) :
-        m_source ( source_ ), m_context ( nullptr ), m_dictionary ( &dictionary_ ), m_src_buffer ( internal_buffer_size_ ),
-        m_read_area ( internal_buffer_size_ ), m_src_offset ( 0 ), m_src_size ( 0 ) {
-        std::size_t status = LZ4F_createDecompressionContext ( &m_context, LZ4F_VERSION );
-        if ( LZ4F_isError ( status ) )
-            throw std::runtime_error ( "Error during LZ4 istream creation" );
-        setg ( &m_read_area.front ( ), &m_read_area.front ( ), &m_read_area.front ( ) );
+
+    ~LZ4ParallelCompressor ( ) {
+        {
+            std::lock_guard<std::mutex> lock ( m_mutex );
+            m_stop = true;
+        }
+        m_work_available.notify_all ( );
+        for ( std::thread & worker : m_workers )
+            worker.join ( );
     }
 
-    virtual ~LZ4IStreamBuf ( ) { LZ4F_freeDecompressionContext ( m_context ); }
+    LZ4ParallelCompressor ( LZ4ParallelCompressor const & ) = delete;
+    LZ4ParallelCompressor & operator= ( LZ4ParallelCompressor const & ) = delete;
 
-    protected:
-    [[nodiscard]] virtual int_type underflow ( ) override {
+    // Queues the first size_ bytes of block_ for compression, block_ is swapped for a buffer of the same size to fill next.
+    void submit ( std::pmr::vector<char> & block_, std::size_t const size_ ) {
+        std::unique_lock<std::mutex> lock ( m_mutex );
+        std::unique_ptr<Job> job;
+        if ( m_free_jobs.empty ( ) )
+            job = std::make_unique<Job> ( m_resource );
+        else {
+            job = std::move ( m_free_jobs.back ( ) );
+            m_free_jobs.pop_back ( );
+        }
+        job->input.swap ( block_ );
+        job->size     = size_;
+        job->lz4_time = std::chrono::nanoseconds ( 0 );
+        job->done     = false;
+        block_.resize ( job->input.size ( ) );
+        m_in_flight += size_;
+        m_pending.push_back ( job.get ( ) );
+        m_jobs.push_back ( std::move ( job ) );
+        m_work_available.notify_one ( );
+        write_completed ( lock, false );
+        while ( m_in_flight > m_max_in_flight )
+            write_front ( lock );
+    }
+
+    // Waits for all queued blocks and writes them to the sink.
+    void flush ( ) {
+        std::unique_lock<std::mutex> lock ( m_mutex );
+        write_completed ( lock, true );
+    }
+
+    // Writes to a new sink, after a flush.
+    void reset ( std::streambuf * sink_ ) noexcept { m_sink = sink_; }
+
+    void set_stats ( LZ4Stats * stats_ ) {
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        m_stats = stats_;
+    }
+
+    private:
+    struct Job {
+        explicit Job ( std::pmr::memory_resource * resource_ ) : input ( resource_ ) {}
+        std::pmr::vector<char> input; // Swapped with the write area.
+        std::vector<char> output;
+        std::size_t size = 0u, output_size = 0u;
+        std::chrono::nanoseconds lz4_time{ 0 };
+        bool done = false;
+    };
+
+    void work ( ) {
+        LZ4F_cctx * context      = nullptr;
+        std::size_t ctx_creation = LZ4F_createCompressionContext ( &context, LZ4F_VERSION );
+        std::unique_lock<std::mutex> lock ( m_mutex );
         while ( true ) {
-            if ( m_src_offset == m_src_size ) {
-                m_src_size   = m_source->sgetn ( &m_src_buffer.front ( ), m_src_buffer.size ( ) );
-                m_src_offset = 0;
+            m_work_available.wait ( lock, [ this ] { return m_stop or not m_pending.empty ( ); } );
+            if ( m_pending.empty ( ) )
+                break;
+            Job & job = *m_pending.front ( );
+            m_pending.pop_front ( );
+            bool const timed = m_stats;
+            lock.unlock ( );
+            std::exception_ptr error;
+            try {
+                if ( LZ4F_isError ( ctx_creation ) )
+                    throw std::runtime_error ( "Error during LZ4 stream creation" );
+                LZ4ScopedTimer timer ( timed ? &job.lz4_time : nullptr );
+                compress ( context, job );
             }
-            if ( m_src_size == 0 )
-                return traits_type::eof ( );
-            std::size_t src_avalable = m_src_size - m_src_offset;
-            std::size_t dest_size    = m_read_area.size ( );
-            std::size_t ret          = 0u;
-            if ( m_dictionary )
-                ret = LZ4F_decompress_usingDict ( m_context, &m_read_area.front ( ), &dest_size,
-                                                  &m_src_buffer.front ( ) + m_src_offset, &src_avalable, m_dictionary->data,
-                                                  m_dictionary->size, nullptr );
-            else
-                ret = LZ4F_decompress ( m_context, &m_read_area.front ( ), &dest_size, &m_src_buffer.front ( ) + m_src_offset,
-                                        &src_avalable, nullptr );
-            m_src_offset += src_avalable;
-            if ( LZ4F_isError ( ret ) != 0 )
-                throw std::runtime_error ( "Error during LZ4 decompression" );
-            if ( dest_size > 0 ) {
-                setg ( &m_read_area.front ( ), &m_read_area.front ( ), &m_read_area.front ( ) + dest_size );
-                return traits_type::to_int_type ( *gptr ( ) );
+            catch ( ... ) {
+                error = std::current_exception ( );
             }
+            lock.lock ( );
+            if ( error and not m_error )
+                m_error = error;
+            job.done = true;
+            m_job_done.notify_all ( );
         }
-        return traits_type::eof ( );
+        lock.unlock ( );
+        LZ4F_freeCompressionContext ( context );
     }
 
-    private:
-    std::streambuf * m_source;
-    LZ4F_dctx * m_context;
-    LZ4Dictionary const * m_dictionary;
-    std::vector<char> m_src_buffer;
-    std::vector<char> m_read_area;
-    std::size_t m_src_offset;
-    std::size_t m_src_size;
-};
-
-LZ4OStream::LZ4OStream ( std::ostream & stream_, int const compression_level_ ) :
-    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), compression_level_ ) ) {}
-LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_, int const compression_level_ ) :
-    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), compression_level_, dictionary_ ) ) {}
-LZ4OStream::~LZ4OStream ( ) { delete rdbuf ( ); }
-void LZ4OStream::close ( ) { dynamic_cast<LZ4OStreamBuf *> ( rdbuf ( ) )->close ( ); }
+    void compress ( LZ4F_cctx * context_, Job & job_ ) const {
+        job_.output.resize ( LZ4F_HEADER_SIZE_MAX + LZ4F_compressBound ( job_.size, &m_settings.preferences ) );
+        static_cast<void> ( m_settings.begin ( context_, job_.output.data ( ), job_.output.size ( ) ) );
+        // The block overwrites the frame header, which is not needed.
+        job_.output_size =
+            m_settings.update ( context_, job_.output.data ( ), job_.output.size ( ), job_.input.data ( ), job_.size );
+    }
 
-LZ4IStream::LZ4IStream ( std::istream & stream_ ) : std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ) ) ) {}
-LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4Dictionary const & dictionary_ ) :
-    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), dictionary_ ) ) {}
-LZ4IStream::~LZ4IStream ( ) { delete rdbuf ( ); }
+    // Writes the oldest job to the sink, waiting for it to be done.
+    void write_front ( std::unique_lock<std::mutex> & lock_ ) {
+        m_job_done.wait ( lock_, [ this ] { return m_jobs.front ( )->done; } );
+        if ( m_error )
+            std::rethrow_exception ( m_error );
+        std::unique_ptr<Job> job = std::move ( m_jobs.front ( ) );
+        m_jobs.pop_front ( );
+        lock_.unlock ( );
+        if ( m_stats ) {
+            LZ4ScopedTimer timer ( &m_stats->io_time );
+            m_sink->sputn ( job->output.data ( ), job->output_size );
+            m_stats->compressed_bytes += job->output_size;
+            m_stats->lz4_time += job->lz4_time;
+        }
+        else
+            m_sink->sputn ( job->output.data ( ), job->output_size );
+        if ( m_index )
+            m_index->append ( job->output_size, job->size );
+        lock_.lock ( );
+        m_in_flight -= job->size;
+        m_free_jobs.push_back ( std::move ( job ) );
+    }
 
-LZ4OutputStream::LZ4OutputBuffer::LZ4OutputBuffer ( std::ostream & sink, const int compression_level_ ) :
-    sink_ ( sink ), src_buf_ ( ), preferences_ ( LZ4F_INIT_PREFERENCES ), closed_ ( false ) {
-    char * base = &src_buf_.front ( );
-    setp ( base, base + src_buf_.size ( ) - 1 );
-    std::size_t ret = LZ4F_createCompressionContext ( &ctx_, LZ4F_VERSION );
-    if ( LZ4F_isError ( ret ) != 0 )
-        throw std::runtime_error ( std::string ( "Failed to create LZ4 compression context: " ) + LZ4F_getErrorName ( ret ) );
-    preferences_.compressionLevel = compression_level_;
-    // TODO: No need to recalculate the dest_buf_ size on each construction
-    dest_buf_.resize ( LZ4F_compressBound ( src_buf_.size ( ), &preferences_ ) );
-    writeHeader ( );
-}
+    // Writes the jobs that are done, in order, or all jobs if wait_ is true.
+    void write_completed ( std::unique_lock<std::mutex> & lock_, bool const wait_ ) {
+        while ( not m_jobs.empty ( ) and ( wait_ or m_jobs.front ( )->done ) )
+            write_front ( lock_ );
+        if ( m_error )
+            std::rethrow_exception ( m_error );
+    }
 
-LZ4OutputStream::LZ4OutputBuffer::~LZ4OutputBuffer ( ) { close ( ); }
+    std::streambuf * m_sink;
+    LZ4FrameSettings m_settings;
+    LZ4BlockIndex * m_index;
+    std::pmr::memory_resource * m_resource;
+    LZ4Stats * m_stats = nullptr; // Written under the lock.
+    std::size_t m_max_in_flight, m_in_flight = 0u;
+    std::deque<std::unique_ptr<Job>> m_jobs; // In submission order.
+    std::deque<Job *> m_pending;             // Not yet claimed by a worker.
+    std::vector<std::unique_ptr<Job>> m_free_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_work_available, m_job_done;
+    std::exception_ptr m_error;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+};
 
-LZ4OutputStream::int_type LZ4OutputStream::LZ4OutputBuffer::overflow ( int_type ch ) {
-    assert ( std::less_equal<char *> ( ) ( pptr ( ), epptr ( ) ) );
-    *pptr ( ) = static_cast<LZ4OutputStream::char_type> ( ch );
-    pbump ( 1 );
-    compressAndWrite ( );
-    return ch;
-}
+// The state shared with the background thread of the asynchronous mode.
+struct LZ4FrameCodec::Encoder::Async {
+    std::mutex mutex;
+    std::condition_variable filled_available, done;
+    std::deque<std::pair<std::pmr::vector<char>, std::size_t>> filled; // Write areas and their sizes, in order.
+    std::vector<std::pmr::vector<char>> free;
+    bool busy = false, stop = false;
+    std::exception_ptr error;
+    std::thread thread;
+};
 
-LZ4OutputStream::int_type LZ4OutputStream::LZ4OutputBuffer::sync ( ) {
-    compressAndWrite ( );
-    return 0;
+LZ4FrameCodec::Encoder::Encoder ( Options const & options_, Dictionary const * dictionary_,
+                                  LZ4ParallelOptions const * parallel_, bool const seekable_, LZ4ContextPool * pool_ ) :
+    m_settings ( options_, dictionary_ ),
+    m_resource ( buffer_resource ( pool_ ? pool_->m_resource : options_.memory_resource ) ), m_write_area ( m_resource ),
+    m_compression_buffer ( m_resource ), m_pool ( pool_ ) {
+    // A reader that starts half-way can't verify the content size or checksum (the index holds the size).
+    if ( seekable_ and ( options_.content_size or options_.content_checksum ) )
+        throw std::runtime_error ( "Error during LZ4 stream creation, a seekable stream has no content size or checksum" );
+    // Blocks of the parallel and seekable modes must be decodable on their own.
+    if ( parallel_ or seekable_ )
+        m_settings.preferences.frameInfo.blockMode = LZ4F_blockIndependent;
+    m_settings.finalize ( options_ );
+    if ( m_pool )
+        m_compression_ctx = m_pool->acquireCompressionContext ( );
+    else
+        m_compression_ctx = create_compression_context ( options_.memory_resource );
+    // Setup buffers.
+    std::size_t internal_buffer_size_ = options_.buffer_size;
+    if ( not internal_buffer_size_ )
+        internal_buffer_size_ = std::max<std::size_t> ( LZ4F_compressBound ( 0, &m_settings.preferences ), LZ4F_HEADER_SIZE_MAX );
+    ++internal_buffer_size_;
+    if ( parallel_ ) {
+        // The content checksum would need the whole content on one thread.
+        m_settings.preferences.frameInfo.contentChecksumFlag = LZ4F_noContentChecksum;
+        // One write area is one block.
+        internal_buffer_size_ = block_size ( m_settings.preferences.frameInfo.blockSizeID );
+    }
+    if ( seekable_ ) {
+        // Every block must start at a known offset. One write area, or one bulk chunk, is one block, flushed as soon as it's
+        // compressed.
+        m_settings.preferences.autoFlush = 1;
+        internal_buffer_size_            = block_size ( m_settings.preferences.frameInfo.blockSizeID );
+        m_index                          = std::make_unique<LZ4BlockIndex> ( );
+    }
+    m_compact = options_.compact and not parallel_ and not options_.async_buffers;
+    if ( m_compact ) {
+        // LZ4F holds no block of its own (the write area is one block), the buffers are held while there's data.
+        m_settings.preferences.autoFlush = 1;
+        if ( not options_.buffer_size )
+            internal_buffer_size_ = block_size ( m_settings.preferences.frameInfo.blockSizeID ) + 1u;
+    }
+    m_write_area_size = internal_buffer_size_;
+    // Must hold the compressed output of a full write area (the bulk path hands LZ4 chunks of that size).
+    m_compression_buffer_size =
+        std::max<std::size_t> ( LZ4F_compressBound ( internal_buffer_size_, &m_settings.preferences ), LZ4F_HEADER_SIZE_MAX );
+    if ( not m_compact )
+        acquire_buffers ( );
+    // The sink is set by begin ( ).
+    if ( parallel_ )
+        m_parallel = std::make_unique<LZ4ParallelCompressor> ( nullptr, m_settings, *parallel_, m_index.get ( ), m_resource );
+    else if ( options_.async_buffers ) {
+        // The write area is the first of the buffers.
+        m_async = std::make_unique<Async> ( );
+        for ( unsigned int i = 1u; i < std::max ( options_.async_buffers, 2u ); ++i )
+            m_async->free.push_back ( m_pool ? m_pool->acquireBuffer ( internal_buffer_size_ )
+                                             : std::pmr::vector<char> ( internal_buffer_size_, m_resource ) );
+        m_async->thread = std::thread ( &Encoder::compress_async, this );
+    }
 }
 
-void LZ4OutputStream::LZ4OutputBuffer::compressAndWrite ( ) {
-    assert ( !closed_ );
-    std::ptrdiff_t orig_size = pptr ( ) - pbase ( );
-    pbump ( -orig_size );
-    std::size_t comp_size = LZ4F_compressUpdate ( ctx_, &dest_buf_.front ( ), dest_buf_.size ( ), pbase ( ), orig_size, nullptr );
-    sink_.write ( &dest_buf_.front ( ), comp_size );
+LZ4FrameCodec::Encoder::~Encoder ( ) {
+    // The engine has ended the frame, what's left in the worker threads and the background thread is dropped.
+    m_parallel.reset ( );
+    if ( m_async ) {
+        {
+            std::lock_guard<std::mutex> lock ( m_async->mutex );
+            m_async->stop = true;
+        }
+        m_async->filled_available.notify_one ( );
+        m_async->thread.join ( );
+    }
+    if ( m_pool ) {
+        m_pool->release ( m_compression_ctx );
+        release_buffers ( );
+        if ( m_async )
+            for ( std::pmr::vector<char> & buffer : m_async->free )
+                m_pool->release ( std::move ( buffer ) );
+    }
+    else
+        LZ4F_freeCompressionContext ( m_compression_ctx );
 }
 
-void LZ4OutputStream::LZ4OutputBuffer::writeHeader ( ) {
-    assert ( !closed_ );
-    std::size_t ret = LZ4F_compressBegin ( ctx_, &dest_buf_.front ( ), dest_buf_.size ( ), &preferences_ );
-    if ( LZ4F_isError ( ret ) != 0 )
-        throw std::runtime_error ( std::string ( "Failed to start LZ4 compression: " ) + LZ4F_getErrorName ( ret ) );
-    sink_.write ( &dest_buf_.front ( ), ret );
+char * LZ4FrameCodec::Encoder::write_area ( ) {
+    if ( m_write_area.empty ( ) )
+        acquire_buffers ( ); // Compact mode, the first write after an idle period.
+    return m_write_area.data ( );
 }
 
-void LZ4OutputStream::LZ4OutputBuffer::writeFooter ( ) {
-    assert ( !closed_ );
-    std::size_t ret = LZ4F_compressEnd ( ctx_, &dest_buf_.front ( ), dest_buf_.size ( ), nullptr );
-    if ( LZ4F_isError ( ret ) != 0 )
-        throw std::runtime_error ( std::string ( "Failed to end LZ4 compression: " ) + LZ4F_getErrorName ( ret ) );
-    sink_.write ( &dest_buf_.front ( ), ret );
+// Starts a frame on sink_, after the previous one has ended, reusing the context and the buffers.
+void LZ4FrameCodec::Encoder::begin ( std::streambuf * sink_ ) {
+    m_sink      = sink_;
+    m_submitted = 0u;
+    if ( m_parallel )
+        m_parallel->reset ( m_sink );
+    if ( m_index )
+        m_index->entries.clear ( );
+    initialize_stream ( );
 }
 
-void LZ4OutputStream::LZ4OutputBuffer::close ( ) {
-    if ( closed_ )
-        return;
-    sync ( );
-    writeFooter ( );
-    LZ4F_freeCompressionContext ( ctx_ );
-    closed_ = true;
+char * LZ4FrameCodec::Encoder::compress ( std::size_t const size_ ) {
+    if ( m_stats )
+        ++m_stats->buffer_calls;
+    sample ( m_write_area.data ( ), size_ );
+    if ( m_parallel ) {
+        m_parallel->submit ( m_write_area, size_ );
+        m_submitted += size_;
+        if ( m_stats )
+            m_stats->uncompressed_bytes += size_;
+    }
+    else if ( m_async )
+        submit_async ( size_ );
+    else
+        compress_range ( m_write_area.data ( ), size_ );
+    return m_write_area.data ( );
 }
 
-LZ4InputStream::LZ4InputBuffer::LZ4InputBuffer ( std::istream & source ) :
-    source_ ( source ), src_buf_ ( ), dest_buf_ ( ), offset_ ( 0 ), src_buf_size_ ( 0 ), ctx_ ( nullptr ) {
-    std::size_t ret = LZ4F_createDecompressionContext ( &ctx_, LZ4F_VERSION );
-    if ( LZ4F_isError ( ret ) != 0 )
-        throw std::runtime_error ( std::string ( "Failed to create LZ4 decompression context: " ) + LZ4F_getErrorName ( ret ) );
-    setg ( &src_buf_.front ( ), &src_buf_.front ( ), &src_buf_.front ( ) );
+void LZ4FrameCodec::Encoder::update ( char const * data_, std::size_t const size_ ) {
+    sample ( data_, size_ );
+    compress_range ( data_, size_ );
 }
 
-LZ4InputStream::int_type LZ4InputStream::LZ4InputBuffer::underflow ( ) {
-    size_t written_size = 0;
-    while ( written_size == 0 ) {
-        if ( offset_ == src_buf_size_ ) {
-            source_.read ( &src_buf_.front ( ), src_buf_.size ( ) );
-            src_buf_size_ = static_cast<size_t> ( source_.gcount ( ) );
-            offset_       = 0;
+int LZ4FrameCodec::Encoder::sync ( ) {
+    if ( m_parallel )
+        m_parallel->flush ( );
+    wait_async ( );
+    // Without autoFlush LZ4F holds back the rest of a block, which is written as a block of its own, so all that was written
+    // can be read back.
+    if ( not m_parallel and not m_settings.preferences.autoFlush ) {
+        std::size_t const compressed_size =
+            LZ4F_flush ( m_compression_ctx, m_compression_buffer.data ( ), m_compression_buffer.size ( ), nullptr );
+        if ( LZ4F_isError ( compressed_size ) )
+            throw std::runtime_error ( "Error during LZ4 stream writing" );
+        write ( m_compression_buffer.data ( ), compressed_size );
+    }
+    int const result = sync_sink ( );
+    if ( m_stats ) {
+        ++m_stats->syncs;
+        if ( m_stats->report )
+            m_stats->report ( *m_stats );
+    }
+    // The stream is idle until the next write.
+    if ( m_compact )
+        release_buffers ( );
+    return result;
+}
+
+void LZ4FrameCodec::Encoder::end ( ) {
+    if ( m_write_area.empty ( ) )
+        acquire_buffers ( );
+    if ( m_parallel )
+        m_parallel->flush ( );
+    wait_async ( );
+    std::size_t compressed_size = 0u;
+    if ( m_parallel ) {
+        // The context saw none of the content, the end mark is written here (there's no content checksum).
+        std::size_t const content_size = m_settings.preferences.frameInfo.contentSize;
+        if ( content_size and content_size != m_submitted )
+            throw std::runtime_error ( "Error during LZ4 stream finalization" );
+        compressed_size = LZ4F_BLOCK_HEADER_SIZE;
+        write_le32 ( m_compression_buffer.data ( ), 0u );
+    }
+    else
+        compressed_size =
+            LZ4F_compressEnd ( m_compression_ctx, m_compression_buffer.data ( ), m_compression_buffer.size ( ), nullptr );
+    if ( LZ4F_isError ( compressed_size ) )
+        throw std::runtime_error ( "Error during LZ4 stream finalization" );
+    write ( m_compression_buffer.data ( ), compressed_size );
+    if ( m_index ) {
+        std::vector<char> const index = m_index->serialize ( );
+        write ( index.data ( ), index.size ( ) );
+    }
+    sync_sink ( );
+    if ( m_stats and m_stats->report )
+        m_stats->report ( *m_stats );
+    if ( m_compact )
+        release_buffers ( );
+}
+
+void LZ4FrameCodec::Encoder::set_stats ( LZ4Stats * stats_ ) {
+    wait_async ( );
+    m_stats = stats_;
+    if ( m_parallel )
+        m_parallel->set_stats ( stats_ );
+}
+
+void LZ4FrameCodec::Encoder::set_sampler ( LZ4DictionaryTrainer * trainer_, double const fraction_ ) {
+    m_sampler         = fraction_ > 0.0 ? trainer_ : nullptr;
+    m_sample_fraction = std::min ( fraction_, 1.0 );
+    m_sample_credit   = 1.0 - m_sample_fraction; // The next write area is sampled.
+}
+
+std::size_t LZ4FrameCodec::Encoder::memory_usage ( ) const {
+    std::size_t usage =
+        m_write_area.capacity ( ) + m_compression_buffer.capacity ( ) + compression_context_size ( m_settings.preferences );
+    if ( m_async ) {
+        std::lock_guard<std::mutex> lock ( m_async->mutex );
+        for ( std::pmr::vector<char> const & buffer : m_async->free )
+            usage += buffer.capacity ( );
+        for ( auto const & buffer : m_async->filled )
+            usage += buffer.first.capacity ( );
+    }
+    return usage;
+}
+
+void LZ4FrameCodec::Encoder::initialize_stream ( ) {
+    std::array<char, LZ4F_HEADER_SIZE_MAX> header; // The buffers may not be held (compact mode).
+    std::size_t const header_size = m_settings.begin ( m_compression_ctx, header.data ( ), header.size ( ) );
+    write ( header.data ( ), header_size );
+    if ( m_index )
+        m_index->entries.emplace_back ( header_size, 0u );
+}
+
+void LZ4FrameCodec::Encoder::acquire_buffers ( ) {
+    m_write_area         = m_pool ? m_pool->acquireBuffer ( m_write_area_size )
+                                  : std::pmr::vector<char> ( m_write_area_size, m_resource );
+    m_compression_buffer = m_pool ? m_pool->acquireBuffer ( m_compression_buffer_size )
+                                  : std::pmr::vector<char> ( m_compression_buffer_size, m_resource );
+}
+
+// Back to the pool, or freed, the write area must be empty.
+void LZ4FrameCodec::Encoder::release_buffers ( ) {
+    if ( m_pool ) {
+        m_pool->release ( std::move ( m_write_area ) );
+        m_pool->release ( std::move ( m_compression_buffer ) );
+    }
+    m_write_area         = std::pmr::vector<char> ( m_resource );
+    m_compression_buffer = std::pmr::vector<char> ( m_resource );
+}
+
+std::size_t LZ4FrameCodec::Encoder::compress_range ( char const * src_, std::size_t const size_ ) {
+    std::size_t compressed_size = 0u;
+    {
+        LZ4ScopedTimer timer ( m_stats ? &m_stats->lz4_time : nullptr );
+        compressed_size =
+            m_settings.update ( m_compression_ctx, m_compression_buffer.data ( ), m_compression_buffer.size ( ), src_, size_ );
+    }
+    if ( m_index and size_ )
+        m_index->append ( compressed_size, size_ );
+    if ( m_stats )
+        m_stats->uncompressed_bytes += size_;
+    return write ( m_compression_buffer.data ( ), compressed_size );
+}
+
+// Hands one in so many write areas (or bulk chunks) to the sampler, on the writing thread.
+void LZ4FrameCodec::Encoder::sample ( char const * src_, std::size_t const size_ ) {
+    if ( not m_sampler or 0u == size_ )
+        return;
+    m_sample_credit += m_sample_fraction;
+    if ( m_sample_credit < 1.0 )
+        return;
+    m_sample_credit -= 1.0;
+    m_sampler->addSample ( src_, size_ );
+}
+
+// Hands the write area to the background thread, and takes a free buffer as the next write area.
+void LZ4FrameCodec::Encoder::submit_async ( std::size_t const size_ ) {
+    std::unique_lock<std::mutex> lock ( m_async->mutex );
+    m_async->done.wait ( lock, [ this ] { return not m_async->free.empty ( ); } );
+    if ( m_async->error )
+        std::rethrow_exception ( m_async->error );
+    m_async->filled.emplace_back ( std::move ( m_write_area ), size_ );
+    m_write_area = std::move ( m_async->free.back ( ) );
+    m_async->free.pop_back ( );
+    m_async->filled_available.notify_one ( );
+}
+
+// Waits until the background thread has written everything handed to it.
+void LZ4FrameCodec::Encoder::wait_async ( ) {
+    if ( not m_async )
+        return;
+    std::unique_lock<std::mutex> lock ( m_async->mutex );
+    m_async->done.wait ( lock, [ this ] { return m_async->filled.empty ( ) and not m_async->busy; } );
+    if ( m_async->error )
+        std::rethrow_exception ( m_async->error );
+}
+
+// The background thread, compresses the filled buffers in order with the frame's context and writes them to the sink.
+void LZ4FrameCodec::Encoder::compress_async ( ) {
+    std::unique_lock<std::mutex> lock ( m_async->mutex );
+    while ( true ) {
+        m_async->filled_available.wait ( lock, [ this ] { return m_async->stop or not m_async->filled.empty ( ); } );
+        if ( m_async->filled.empty ( ) )
+            break;
+        std::pair<std::pmr::vector<char>, std::size_t> buffer = std::move ( m_async->filled.front ( ) );
+        m_async->filled.pop_front ( );
+        m_async->busy = true;
+        bool const failed = static_cast<bool> ( m_async->error );
+        lock.unlock ( );
+        std::exception_ptr error;
+        if ( not failed ) {
+            try {
+                compress_range ( buffer.first.data ( ), buffer.second );
+            }
+            catch ( ... ) {
+                error = std::current_exception ( );
+            }
         }
+        lock.lock ( );
+        if ( error )
+            m_async->error = error;
+        m_async->free.push_back ( std::move ( buffer.first ) );
+        m_async->busy = false;
+        m_async->done.notify_one ( );
+    }
+}
 
-        if ( src_buf_size_ == 0 ) {
-            return traits_type::eof ( );
+std::size_t LZ4FrameCodec::Encoder::write ( char const * data_, std::size_t const size_ ) {
+    if ( not m_stats )
+        return m_sink->sputn ( data_, size_ );
+    LZ4ScopedTimer timer ( &m_stats->io_time );
+    m_stats->compressed_bytes += size_;
+    return m_sink->sputn ( data_, size_ );
+}
+
+int LZ4FrameCodec::Encoder::sync_sink ( ) {
+    LZ4ScopedTimer timer ( m_stats ? &m_stats->io_time : nullptr );
+    return m_sink->pubsync ( );
+}
+
+// Decompresses the blocks of independent-block frames on a pool of worker threads, ahead of the reader. The source is parsed
+// on the reading thread. A job is the frame header followed by one block, decoded by a freshly reset context. Frames with
+// linked blocks are decoded on the reading thread, one block at a time, by a context that lives as long as the frame. The
+// content checksum of independent-block frames is not verified (block checksums are).
+class LZ4ParallelDecompressor final {
+    public:
+    LZ4ParallelDecompressor ( std::streambuf * source_, LZ4Dictionary const * dictionary_, LZ4ParallelOptions const & options_ ) :
+        m_source ( source_ ), m_dictionary ( dictionary_ ), m_max_in_flight ( options_.max_in_flight ) {
+        std::size_t status = LZ4F_createDecompressionContext ( &m_linked_context, LZ4F_VERSION );
+        if ( LZ4F_isError ( status ) )
+            throw std::runtime_error ( "Error during LZ4 istream creation" );
+        unsigned int threads = options_.threads ? options_.threads : std::thread::hardware_concurrency ( );
+        threads              = std::max ( threads, 1u );
+        m_workers.reserve ( threads );
+        for ( unsigned int i = 0u; i < threads; ++i )
+            m_workers.emplace_back ( &LZ4ParallelDecompressor::work, this );
+    }
+
+    ~LZ4ParallelDecompressor ( ) {
+        {
+            std::lock_guard<std::mutex> lock ( m_mutex );
+            m_stop = true;
+            m_pending.clear ( );
+        }
+        m_work_available.notify_all ( );
+        for ( std::thread & worker : m_workers )
+            worker.join ( );
+        LZ4F_freeDecompressionContext ( m_linked_context );
+    }
+
+    LZ4ParallelDecompressor ( LZ4ParallelDecompressor const & ) = delete;
+    LZ4ParallelDecompressor & operator= ( LZ4ParallelDecompressor const & ) = delete;
+
+    // Drops everything in flight, the source is about to be positioned at a block of the frame with the given header.
+    void restart ( std::vector<char> const & header_ ) {
+        drop ( );
+        m_header     = header_;
+        m_source_end = false;
+        start_frame ( );
+    }
+
+    // Drops everything in flight, and starts reading a new source.
+    void reset ( std::streambuf * source_ ) {
+        drop ( );
+        m_source     = source_;
+        m_source_end = false;
+        m_header.clear ( );
+    }
+
+    void set_stats ( LZ4Stats * stats_ ) {
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        m_stats = stats_;
+    }
+
+    // The content size of the frame being parsed, reads the next frame header in between frames, 0 if unknown.
+    [[nodiscard]] unsigned long long content_size ( ) {
+        if ( m_header.empty ( ) and not m_source_end )
+            m_source_end = not read_frame_header ( );
+        return m_header.empty ( ) ? 0u : m_frame.content_size;
+    }
+
+    // Returns the next decompressed block, which stays valid until the next call, nullptr at the end of the source.
+    [[nodiscard]] char * next ( std::size_t & size_ ) {
+        std::unique_lock<std::mutex> lock ( m_mutex );
+        if ( m_current ) {
+            m_in_flight -= m_current->output.size ( );
+            m_free_jobs.push_back ( std::move ( m_current ) );
+        }
+        lock.unlock ( );
+        fill ( );
+        lock.lock ( );
+        if ( m_jobs.empty ( ) ) {
+            size_ = 0u;
+            return nullptr;
+        }
+        m_job_done.wait ( lock, [ this ] { return m_jobs.front ( )->done; } );
+        if ( m_error )
+            std::rethrow_exception ( m_error );
+        m_current = std::move ( m_jobs.front ( ) );
+        m_jobs.pop_front ( );
+        size_ = m_current->output_size;
+        if ( m_stats ) {
+            m_stats->uncompressed_bytes += size_;
+            m_stats->lz4_time += m_current->lz4_time;
+        }
+        return m_current->output.data ( );
+    }
+
+    private:
+    struct Job {
+        std::vector<char> input, output;
+        std::size_t output_size = 0u;
+        std::chrono::nanoseconds lz4_time{ 0 };
+        bool done = false;
+    };
+
+    void work ( ) {
+        LZ4F_dctx * context = nullptr;
+        std::size_t status  = LZ4F_createDecompressionContext ( &context, LZ4F_VERSION );
+        std::unique_lock<std::mutex> lock ( m_mutex );
+        while ( true ) {
+            m_work_available.wait ( lock, [ this ] { return m_stop or not m_pending.empty ( ); } );
+            if ( m_pending.empty ( ) )
+                break;
+            Job & job = *m_pending.front ( );
+            m_pending.pop_front ( );
+            bool const timed = m_stats;
+            lock.unlock ( );
+            std::exception_ptr error;
+            try {
+                if ( LZ4F_isError ( status ) )
+                    throw std::runtime_error ( "Error during LZ4 istream creation" );
+                LZ4ScopedTimer timer ( timed ? &job.lz4_time : nullptr );
+                LZ4F_resetDecompressionContext ( context );
+                job.output_size = job.output.size ( );
+                decompress ( context, job.input.data ( ), job.input.size ( ), job.output.data ( ), job.output_size );
+            }
+            catch ( ... ) {
+                error = std::current_exception ( );
+            }
+            lock.lock ( );
+            if ( error and not m_error )
+                m_error = error;
+            job.done = true;
+            m_job_done.notify_all ( );
         }
+        lock.unlock ( );
+        LZ4F_freeDecompressionContext ( context );
+    }
 
-        size_t src_size  = src_buf_size_ - offset_;
-        size_t dest_size = dest_buf_.size ( );
-        size_t ret = LZ4F_decompress ( ctx_, &dest_buf_.front ( ), &dest_size, &src_buf_.front ( ) + offset_, &src_size, nullptr );
-        if ( LZ4F_isError ( ret ) != 0 ) {
-            throw std::runtime_error ( std::string ( "LZ4 decompression failed: " ) + LZ4F_getErrorName ( ret ) );
+    // Feeds all of src_ to the context, dest_size_ is the capacity of dest_ on entry and the decompressed size on return.
+    void decompress ( LZ4F_dctx * context_, char const * src_, std::size_t src_size_, char * dest_,
+                      std::size_t & dest_size_ ) const {
+        std::size_t const capacity = dest_size_;
+        dest_size_                 = 0u;
+        while ( src_size_ ) {
+            std::size_t src_size = src_size_, dest_size = capacity - dest_size_;
+            std::size_t ret      = 0u;
+            if ( m_dictionary )
+                ret = LZ4F_decompress_usingDict ( context_, dest_ + dest_size_, &dest_size, src_, &src_size, m_dictionary->bytes,
+                                                  m_dictionary->size, nullptr );
+            else
+                ret = LZ4F_decompress ( context_, dest_ + dest_size_, &dest_size, src_, &src_size, nullptr );
+            if ( LZ4F_isError ( ret ) != 0 )
+                throw std::runtime_error ( "Error during LZ4 decompression" );
+            if ( 0u == src_size and 0u == dest_size )
+                throw std::runtime_error ( "Error during LZ4 decompression, block exceeds the maximum block size" );
+            src_ += src_size;
+            src_size_ -= src_size;
+            dest_size_ += dest_size;
         }
-        written_size = dest_size;
-        offset_ += src_size;
     }
-    setg ( &dest_buf_.front ( ), &dest_buf_.front ( ), &dest_buf_.front ( ) + written_size );
-    return traits_type::to_int_type ( *gptr ( ) );
+
+    void decompress_linked ( char const * src_, std::size_t const src_size_ ) {
+        char none           = 0;
+        std::size_t nothing = 0u;
+        decompress ( m_linked_context, src_, src_size_, &none, nothing );
+    }
+
+    [[nodiscard]] std::unique_ptr<Job> make_job ( ) {
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        if ( m_free_jobs.empty ( ) )
+            return std::make_unique<Job> ( );
+        std::unique_ptr<Job> job = std::move ( m_free_jobs.back ( ) );
+        m_free_jobs.pop_back ( );
+        job->lz4_time = std::chrono::nanoseconds ( 0 );
+        job->done     = false;
+        return job;
+    }
+
+    // Reads size_ bytes from the source, returns false if the source is at its end, throws if it ends half-way.
+    [[nodiscard]] bool read ( char * dest_, std::size_t const size_ ) {
+        std::size_t read_size = 0u;
+        {
+            LZ4ScopedTimer timer ( m_stats ? &m_stats->io_time : nullptr );
+            read_size = static_cast<std::size_t> ( m_source->sgetn ( dest_, size_ ) );
+        }
+        if ( m_stats )
+            m_stats->compressed_bytes += read_size;
+        if ( 0u == read_size and size_ )
+            return false;
+        if ( read_size != size_ )
+            throw std::runtime_error ( "Error during LZ4 decompression, truncated source" );
+        return true;
+    }
+
+    void read_or_throw ( char * dest_, std::size_t const size_ ) {
+        if ( not read ( dest_, size_ ) )
+            throw std::runtime_error ( "Error during LZ4 decompression, truncated source" );
+    }
+
+    // Reads the next frame header, skipping skippable frames, returns false at the end of the source.
+    [[nodiscard]] bool read_frame_header ( ) {
+        m_header.resize ( LZ4F_HEADER_SIZE_MAX );
+        while ( true ) {
+            if ( not read ( m_header.data ( ), 4u ) ) {
+                m_header.clear ( );
+                return false;
+            }
+            std::uint32_t const magic = read_le32 ( m_header.data ( ) );
+            if ( LZ4F_MAGICNUMBER == magic )
+                break;
+            if ( LZ4F_MAGIC_SKIPPABLE_START != ( magic & 0xFFFFFFF0u ) )
+                throw std::runtime_error ( "Error during LZ4 decompression, unknown frame" );
+            read_or_throw ( m_header.data ( ), 4u );
+            for ( std::size_t skip = read_le32 ( m_header.data ( ) ); skip; ) {
+                std::size_t const size = std::min ( skip, m_header.size ( ) );
+                read_or_throw ( m_header.data ( ), size );
+                skip -= size;
+            }
+        }
+        {
+            LZ4ScopedTimer timer ( m_stats ? &m_stats->io_time : nullptr );
+            sf::read_frame_header ( m_source, m_header );
+        }
+        if ( m_stats )
+            m_stats->compressed_bytes += m_header.size ( ) - 4u;
+        start_frame ( );
+        return true;
+    }
+
+    void start_frame ( ) {
+        m_frame = parse_frame_header ( m_header );
+        if ( m_frame.linked ) {
+            LZ4F_resetDecompressionContext ( m_linked_context );
+            decompress_linked ( m_header.data ( ), m_header.size ( ) );
+        }
+    }
+
+    // Parses the source and queues blocks, until the in-flight bound is reached or the source is exhausted.
+    void fill ( ) {
+        while ( not m_source_end ) {
+            {
+                std::lock_guard<std::mutex> lock ( m_mutex );
+                if ( not m_jobs.empty ( ) and m_in_flight >= m_max_in_flight )
+                    return;
+            }
+            if ( m_header.empty ( ) ) {
+                m_source_end = not read_frame_header ( );
+                continue;
+            }
+            char block_header[ LZ4F_BLOCK_HEADER_SIZE ];
+            read_or_throw ( block_header, sizeof ( block_header ) );
+            std::uint32_t const block_word = read_le32 ( block_header );
+            if ( 0u == block_word ) {
+                // End mark, followed by the content checksum.
+                char checksum[ 4 ];
+                if ( m_frame.content_checksum )
+                    read_or_throw ( checksum, sizeof ( checksum ) );
+                if ( m_frame.linked ) {
+                    decompress_linked ( block_header, sizeof ( block_header ) );
+                    if ( m_frame.content_checksum )
+                        decompress_linked ( checksum, sizeof ( checksum ) );
+                }
+                m_header.clear ( );
+                continue;
+            }
+            if ( ( block_word & 0x7FFFFFFFu ) > m_frame.block_size )
+                throw std::runtime_error ( "Error during LZ4 decompression, corrupt block header" );
+            std::size_t const block_size = ( block_word & 0x7FFFFFFFu ) + ( m_frame.block_checksum ? 4u : 0u );
+            std::size_t const prefix     = m_frame.linked ? 0u : m_header.size ( );
+            std::unique_ptr<Job> job     = make_job ( );
+            job->input.resize ( prefix + sizeof ( block_header ) + block_size );
+            std::memcpy ( job->input.data ( ), m_header.data ( ), prefix );
+            std::memcpy ( job->input.data ( ) + prefix, block_header, sizeof ( block_header ) );
+            read_or_throw ( job->input.data ( ) + prefix + sizeof ( block_header ), block_size );
+            job->output.resize ( m_frame.block_size );
+            if ( m_frame.linked ) {
+                LZ4ScopedTimer timer ( m_stats ? &job->lz4_time : nullptr );
+                job->output_size = job->output.size ( );
+                decompress ( m_linked_context, job->input.data ( ), job->input.size ( ), job->output.data ( ), job->output_size );
+                job->done = true;
+            }
+            std::lock_guard<std::mutex> lock ( m_mutex );
+            m_in_flight += job->output.size ( );
+            if ( not m_frame.linked ) {
+                m_pending.push_back ( job.get ( ) );
+                m_work_available.notify_one ( );
+            }
+            m_jobs.push_back ( std::move ( job ) );
+        }
+    }
+
+    // Drops everything in flight.
+    void drop ( ) {
+        std::unique_lock<std::mutex> lock ( m_mutex );
+        // Unclaimed jobs are dropped, claimed ones are waited for.
+        for ( Job * job : m_pending )
+            job->done = true;
+        m_pending.clear ( );
+        for ( std::unique_ptr<Job> & job : m_jobs ) {
+            m_job_done.wait ( lock, [ &job ] { return job->done; } );
+            m_free_jobs.push_back ( std::move ( job ) );
+        }
+        m_jobs.clear ( );
+        if ( m_current )
+            m_free_jobs.push_back ( std::move ( m_current ) );
+        m_in_flight = 0u;
+        if ( m_error )
+            std::rethrow_exception ( m_error );
+    }
+
+    std::streambuf * m_source;
+    LZ4Dictionary const * m_dictionary;
+    LZ4F_dctx * m_linked_context = nullptr;
+    std::vector<char> m_header; // Of the current frame, empty in between frames.
+    LZ4FrameHeader m_frame;
+    bool m_source_end = false;
+    LZ4Stats * m_stats = nullptr; // Written under the lock.
+    std::size_t m_max_in_flight, m_in_flight = 0u;
+    std::deque<std::unique_ptr<Job>> m_jobs; // In source order.
+    std::deque<Job *> m_pending;             // Not yet claimed by a worker.
+    std::vector<std::unique_ptr<Job>> m_free_jobs;
+    std::unique_ptr<Job> m_current; // Handed out by next ( ).
+    std::mutex m_mutex;
+    std::condition_variable m_work_available, m_job_done;
+    std::exception_ptr m_error;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+};
+
+// A read-only stream buffer over a memory region, optionally owning the file mapping that holds the region. The region is
+// exposed, so the compressed data can be decompressed in place.
+class LZ4MemoryBuf final : public std::streambuf {
+    public:
+    LZ4MemoryBuf ( char const * data_, std::size_t const size_ ) noexcept {
+        char * const data = const_cast<char *> ( data_ );
+        setg ( data, data, data + size_ );
+    }
+    LZ4MemoryBuf ( LZ4MappedFile && mapping_ ) noexcept : LZ4MemoryBuf ( mapping_.data ( ), mapping_.size ( ) ) {
+        m_mapping = std::move ( mapping_ );
+    }
+
+    [[nodiscard]] char const * data ( ) const noexcept { return gptr ( ); }
+    [[nodiscard]] std::size_t available ( ) const noexcept { return egptr ( ) - gptr ( ); }
+    void consume ( std::size_t const size_ ) noexcept { setg ( eback ( ), gptr ( ) + size_, egptr ( ) ); }
+
+    protected:
+    [[nodiscard]] virtual pos_type seekoff ( off_type off_, std::ios_base::seekdir dir_,
+                                             std::ios_base::openmode which_ = std::ios_base::in ) override {
+        char * const base = std::ios_base::beg == dir_ ? eback ( ) : std::ios_base::cur == dir_ ? gptr ( ) : egptr ( );
+        if ( not( which_ & std::ios_base::in ) or off_ < eback ( ) - base or off_ > egptr ( ) - base )
+            return pos_type ( off_type ( -1 ) );
+        setg ( eback ( ), base + off_, egptr ( ) );
+        return pos_type ( off_type ( gptr ( ) - eback ( ) ) );
+    }
+
+    [[nodiscard]] virtual pos_type seekpos ( pos_type pos_, std::ios_base::openmode which_ = std::ios_base::in ) override {
+        return seekoff ( off_type ( pos_ ), std::ios_base::beg, which_ );
+    }
+
+    private:
+    LZ4MappedFile m_mapping;
+};
+
+// The state shared with the background thread of the read-ahead mode.
+struct LZ4FrameCodec::Decoder::ReadAhead {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::pair<std::pmr::vector<char>, std::size_t>> ready; // Decompressed buffers and their sizes, in order.
+    std::vector<std::pmr::vector<char>> free;
+    bool end = false, paused = false, busy = false, stop = false;
+    std::exception_ptr error;
+    std::thread thread;
+};
+
+// Stops the background thread of the read-ahead mode for as long as it lives, the context and the source are then owned by
+// the reading thread. What was decompressed ahead must be dropped before the source is repositioned.
+class LZ4FrameCodec::Decoder::ReadAheadPause final {
+    public:
+    explicit ReadAheadPause ( Decoder & decoder_ ) : m_read_ahead ( decoder_.m_read_ahead.get ( ) ) {
+        if ( not m_read_ahead )
+            return;
+        std::unique_lock<std::mutex> lock ( m_read_ahead->mutex );
+        m_read_ahead->paused = true;
+        m_read_ahead->changed.wait ( lock, [ this ] { return not m_read_ahead->busy; } );
+    }
+    ~ReadAheadPause ( ) {
+        if ( not m_read_ahead )
+            return;
+        {
+            std::lock_guard<std::mutex> lock ( m_read_ahead->mutex );
+            m_read_ahead->paused = false;
+        }
+        m_read_ahead->changed.notify_all ( );
+    }
+
+    ReadAheadPause ( ReadAheadPause const & ) = delete;
+    ReadAheadPause & operator= ( ReadAheadPause const & ) = delete;
+
+    void drop ( ) {
+        if ( not m_read_ahead )
+            return;
+        std::lock_guard<std::mutex> lock ( m_read_ahead->mutex );
+        for ( auto & buffer : m_read_ahead->ready )
+            m_read_ahead->free.push_back ( std::move ( buffer.first ) );
+        m_read_ahead->ready.clear ( );
+        m_read_ahead->end   = false;
+        m_read_ahead->error = nullptr;
+    }
+
+    private:
+    ReadAhead * m_read_ahead;
+};
+
+// The context allocates from the resource of the options, except in read-ahead mode, where it allocates on the background
+// thread.
+LZ4FrameCodec::Decoder::Decoder ( Options const & options_, Dictionary const * dictionary_,
+                                  LZ4ParallelOptions const * parallel_, LZ4ContextPool * pool_,
+                                  LZ4DictionaryRegistry const * registry_ ) :
+    m_dictionary ( dictionary_ ),
+    m_registry ( registry_ ), m_resource ( buffer_resource ( pool_ ? pool_->m_resource : options_.memory_resource ) ),
+    m_src_buffer ( m_resource ), m_read_area ( m_resource ), m_pool ( pool_ ),
+    m_buffer_size ( options_.buffer_size ? options_.buffer_size : 4096u ) {
+    unsigned int const read_ahead = parallel_ ? 0u : options_.read_ahead;
+    m_compact                     = options_.compact and not parallel_ and not read_ahead;
+    if ( m_pool )
+        m_context = m_pool->acquireDecompressionContext ( );
+    else
+        m_context = create_decompression_context ( read_ahead ? nullptr : options_.memory_resource );
+    // The source is set by begin ( ).
+    if ( parallel_ )
+        m_parallel = std::make_unique<LZ4ParallelDecompressor> ( nullptr, m_dictionary, *parallel_ );
+    else if ( not m_compact ) {
+        m_src_buffer = acquire_buffer ( m_buffer_size );
+        m_read_area  = acquire_buffer ( m_buffer_size );
+    }
+    if ( read_ahead ) {
+        m_read_ahead = std::make_unique<ReadAhead> ( );
+        for ( unsigned int i = 0u; i < read_ahead; ++i )
+            m_read_ahead->free.push_back ( acquire_buffer ( m_buffer_size ) );
+    }
+}
+
+LZ4FrameCodec::Decoder::Decoder ( Options const & options_, Dictionary const * dictionary_,
+                                  std::unique_ptr<LZ4MemoryBuf> memory_ ) :
+    m_memory ( std::move ( memory_ ) ),
+    m_dictionary ( dictionary_ ), m_resource ( buffer_resource ( nullptr ) ), m_src_buffer ( m_resource ),
+    m_read_area ( m_resource ), m_buffer_size ( options_.buffer_size ? options_.buffer_size : 4096u ) {
+    m_context   = create_decompression_context ( nullptr );
+    m_read_area = acquire_buffer ( m_buffer_size );
+}
+
+LZ4FrameCodec::Decoder::~Decoder ( ) {
+    if ( m_read_ahead ) {
+        {
+            std::lock_guard<std::mutex> lock ( m_read_ahead->mutex );
+            m_read_ahead->stop = true;
+        }
+        m_read_ahead->changed.notify_all ( );
+        m_read_ahead->thread.join ( );
+    }
+    m_parallel.reset ( );
+    if ( m_pool ) {
+        m_pool->release ( m_context );
+        m_pool->release ( std::move ( m_src_buffer ) );
+        m_pool->release ( std::move ( m_read_area ) );
+        if ( m_read_ahead ) {
+            for ( std::pmr::vector<char> & buffer : m_read_ahead->free )
+                m_pool->release ( std::move ( buffer ) );
+            for ( auto & buffer : m_read_ahead->ready )
+                m_pool->release ( std::move ( buffer.first ) );
+        }
+    }
+    else
+        LZ4F_freeDecompressionContext ( m_context );
+}
+
+void LZ4FrameCodec::Decoder::begin ( std::streambuf * source_ ) {
+    m_source = source_;
+    if ( m_parallel )
+        m_parallel->reset ( m_source );
+    m_base = m_source->pubseekoff ( 0, std::ios_base::cur, std::ios_base::in );
+    if ( m_read_ahead )
+        m_read_ahead->thread = std::thread ( &Decoder::decompress_ahead, this );
+}
+
+char * LZ4FrameCodec::Decoder::next ( std::size_t & size_ ) {
+    if ( m_stats )
+        ++m_stats->buffer_calls;
+    size_ = 0u;
+    if ( m_parallel ) {
+        char * block = nullptr;
+        do
+            block = m_parallel->next ( size_ );
+        while ( block and 0u == size_ );
+        return block ? block : end_of_source ( );
+    }
+    if ( m_read_ahead )
+        return next_read_ahead ( size_ );
+    if ( m_compact ) {
+        if ( m_src_offset == m_src_size ) {
+            // Idle, the buffers go back while the source is waited on.
+            release_buffers ( );
+            if ( std::streambuf::traits_type::eq_int_type ( m_source->sgetc ( ), std::streambuf::traits_type::eof ( ) ) )
+                return end_of_source ( );
+        }
+        acquire_buffers ( );
+    }
+    size_ = decode ( m_read_area.data ( ), m_read_area.size ( ) );
+    return size_ ? m_read_area.data ( ) : end_of_source ( );
+}
+
+std::size_t LZ4FrameCodec::Decoder::decompress ( char * const dest_, std::size_t const capacity_ ) {
+    if ( m_compact )
+        acquire_buffers ( );
+    return decode ( dest_, capacity_ );
+}
+
+bool LZ4FrameCodec::Decoder::seekable ( std::uint64_t & size_ ) {
+    ReadAheadPause const pause ( *this );
+    if ( not load_index ( ) )
+        return false;
+    size_ = m_index->entries.back ( ).second;
+    return true;
+}
+
+// Positions the source at the block holding position_, the last entry (the end mark) if position_ is the end.
+bool LZ4FrameCodec::Decoder::seek ( std::uint64_t const position_, std::uint64_t & start_ ) {
+    ReadAheadPause pause ( *this );
+    auto const block = std::prev ( std::upper_bound (
+        m_index->entries.begin ( ), m_index->entries.end ( ), position_,
+        [] ( std::uint64_t const value_, std::pair<std::uint64_t, std::uint64_t> const & entry_ ) {
+            return value_ < entry_.second;
+        } ) );
+    pause.drop ( );
+    if ( std::streamoff ( -1 ) == std::streamoff ( m_source->pubseekpos ( m_base + std::streamoff ( block->first ),
+                                                                          std::ios_base::in ) ) )
+        return false;
+    if ( m_parallel )
+        m_parallel->restart ( m_header );
+    else {
+        LZ4F_resetDecompressionContext ( m_context );
+        start_frame ( );
+        m_src_offset = m_src_size = 0u;
+    }
+    start_ = block->second;
+    return true;
+}
+
+void LZ4FrameCodec::Decoder::reset ( std::streambuf * source_ ) {
+    ReadAheadPause pause ( *this );
+    pause.drop ( );
+    LZ4F_resetDecompressionContext ( m_context );
+    m_memory.reset ( );
+    m_source = source_;
+    if ( m_parallel )
+        m_parallel->reset ( m_source );
+    else if ( m_compact )
+        release_buffers ( );
+    else if ( m_src_buffer.empty ( ) )
+        m_src_buffer = acquire_buffer ( m_buffer_size );
+    m_src_offset  = m_src_size = 0u;
+    m_frame_start = true;
+    m_base        = m_source->pubseekoff ( 0, std::ios_base::cur, std::ios_base::in );
+    m_index.reset ( );
+    m_header.clear ( );
+}
+
+unsigned long long LZ4FrameCodec::Decoder::content_size ( ) {
+    if ( m_parallel )
+        return m_parallel->content_size ( );
+    ReadAheadPause const pause ( *this );
+    LZ4F_frameInfo_t info = LZ4F_INIT_FRAMEINFO;
+    return frame_info ( info ) ? info.contentSize : 0u;
+}
+
+void LZ4FrameCodec::Decoder::set_stats ( LZ4Stats * stats_ ) {
+    ReadAheadPause const pause ( *this );
+    m_stats = stats_;
+    // What was decompressed ahead has not been read yet, count it as if it were decompressed now.
+    if ( m_stats and m_read_ahead )
+        for ( auto const & buffer : m_read_ahead->ready )
+            m_stats->uncompressed_bytes += buffer.second;
+    if ( m_parallel )
+        m_parallel->set_stats ( stats_ );
+}
+
+std::size_t LZ4FrameCodec::Decoder::memory_usage ( ) {
+    ReadAheadPause const pause ( *this );
+    std::size_t usage = m_src_buffer.capacity ( ) + m_read_area.capacity ( );
+    LZ4F_frameInfo_t info;
+    std::size_t none = 0u;
+    if ( not m_parallel and not LZ4F_isError ( LZ4F_getFrameInfo ( m_context, &info, nullptr, &none ) ) )
+        usage += decompression_context_size ( info );
+    if ( m_read_ahead ) {
+        std::lock_guard<std::mutex> lock ( m_read_ahead->mutex );
+        for ( std::pmr::vector<char> const & buffer : m_read_ahead->free )
+            usage += buffer.capacity ( );
+        for ( auto const & buffer : m_read_ahead->ready )
+            usage += buffer.first.capacity ( );
+    }
+    return usage;
 }
 
-LZ4InputStream::LZ4InputBuffer::~LZ4InputBuffer ( ) { LZ4F_freeDecompressionContext ( ctx_ ); }
+// The background thread, keeps the free buffers filled with decompressed data.
+void LZ4FrameCodec::Decoder::decompress_ahead ( ) {
+    std::unique_lock<std::mutex> lock ( m_read_ahead->mutex );
+    while ( true ) {
+        m_read_ahead->changed.wait ( lock, [ this ] {
+            return m_read_ahead->stop or
+                   not( m_read_ahead->paused or m_read_ahead->end or m_read_ahead->free.empty ( ) or m_read_ahead->error );
+        } );
+        if ( m_read_ahead->stop )
+            break;
+        std::pmr::vector<char> buffer = std::move ( m_read_ahead->free.back ( ) );
+        m_read_ahead->free.pop_back ( );
+        m_read_ahead->busy = true;
+        lock.unlock ( );
+        std::size_t size = 0u;
+        std::exception_ptr error;
+        try {
+            size = decode ( buffer.data ( ), buffer.size ( ) );
+        }
+        catch ( ... ) {
+            error = std::current_exception ( );
+        }
+        lock.lock ( );
+        m_read_ahead->busy = false;
+        if ( size )
+            m_read_ahead->ready.emplace_back ( std::move ( buffer ), size );
+        else {
+            m_read_ahead->free.push_back ( std::move ( buffer ) );
+            m_read_ahead->end   = true;
+            m_read_ahead->error = error;
+        }
+        m_read_ahead->changed.notify_all ( );
+    }
+}
+
+// Swaps the read area for the next decompressed buffer.
+char * LZ4FrameCodec::Decoder::next_read_ahead ( std::size_t & size_ ) {
+    std::unique_lock<std::mutex> lock ( m_read_ahead->mutex );
+    m_read_ahead->changed.wait ( lock, [ this ] { return m_read_ahead->end or not m_read_ahead->ready.empty ( ); } );
+    if ( m_read_ahead->ready.empty ( ) ) {
+        if ( m_read_ahead->error )
+            std::rethrow_exception ( m_read_ahead->error );
+        lock.unlock ( );
+        return end_of_source ( );
+    }
+    m_read_ahead->free.push_back ( std::move ( m_read_area ) );
+    m_read_area = std::move ( m_read_ahead->ready.front ( ).first );
+    size_       = m_read_ahead->ready.front ( ).second;
+    m_read_ahead->ready.pop_front ( );
+    lock.unlock ( );
+    m_read_ahead->changed.notify_all ( );
+    return m_read_area.data ( );
+}
+
+char * LZ4FrameCodec::Decoder::end_of_source ( ) {
+    if ( m_stats and m_stats->report )
+        m_stats->report ( *m_stats );
+    return nullptr;
+}
+
+std::size_t LZ4FrameCodec::Decoder::read_source ( char * dest_, std::size_t const size_ ) {
+    LZ4ScopedTimer timer ( m_stats ? &m_stats->io_time : nullptr );
+    std::size_t const read_size = static_cast<std::size_t> ( m_source->sgetn ( dest_, size_ ) );
+    if ( m_stats )
+        m_stats->compressed_bytes += read_size;
+    return read_size;
+}
+
+std::pmr::vector<char> LZ4FrameCodec::Decoder::acquire_buffer ( std::size_t const size_ ) {
+    return m_pool ? m_pool->acquireBuffer ( size_ ) : std::pmr::vector<char> ( size_, m_resource );
+}
+
+// The compact mode holds the source buffer and the read area only while there's data in them.
+void LZ4FrameCodec::Decoder::acquire_buffers ( ) {
+    if ( m_read_area.size ( ) )
+        return;
+    m_src_buffer = acquire_buffer ( m_buffer_size );
+    m_read_area  = acquire_buffer ( m_buffer_size );
+}
+
+// Back to the pool, or freed, the source buffer must be consumed and the read area read.
+void LZ4FrameCodec::Decoder::release_buffers ( ) {
+    if ( m_pool ) {
+        m_pool->release ( std::move ( m_src_buffer ) );
+        m_pool->release ( std::move ( m_read_area ) );
+    }
+    m_src_buffer = std::pmr::vector<char> ( m_resource );
+    m_read_area  = std::pmr::vector<char> ( m_resource );
+}
+
+// Loads the block index and the frame header, once, returns false if the stream is not seekable.
+bool LZ4FrameCodec::Decoder::load_index ( ) {
+    if ( m_index )
+        return m_index->entries.size ( );
+    m_index                       = std::make_unique<LZ4BlockIndex> ( );
+    std::streamoff const position = m_source->pubseekoff ( 0, std::ios_base::cur, std::ios_base::in );
+    if ( std::streamoff ( -1 ) == position or std::streamoff ( -1 ) == m_base or not m_index->load ( m_source, m_base ) )
+        return restore ( position );
+    m_header.resize ( 4u );
+    if ( std::streamoff ( -1 ) == m_source->pubseekpos ( m_base, std::ios_base::in ) or
+         4 != m_source->sgetn ( m_header.data ( ), 4 ) or LZ4F_MAGICNUMBER != read_le32 ( m_header.data ( ) ) )
+        return restore ( position );
+    read_frame_header ( m_source, m_header );
+    if ( parse_frame_header ( m_header ).linked )
+        return restore ( position );
+    m_source->pubseekpos ( position, std::ios_base::in );
+    return true;
+}
+
+bool LZ4FrameCodec::Decoder::restore ( std::streamoff const position_ ) {
+    m_index->entries.clear ( );
+    if ( std::streamoff ( -1 ) != position_ )
+        m_source->pubseekpos ( position_, std::ios_base::in );
+    return false;
+}
+
+// Decodes the header of the current frame into info_, if it wasn't decoded yet, returns false if it can't be decoded.
+bool LZ4FrameCodec::Decoder::frame_info ( LZ4F_frameInfo_t & info_ ) {
+    char const * src     = nullptr;
+    std::size_t src_size = 0u;
+    if ( m_memory ) {
+        src      = m_memory->data ( );
+        src_size = m_memory->available ( );
+    }
+    else {
+        if ( m_compact )
+            acquire_buffers ( );
+        // The header must be staged whole.
+        if ( m_src_size - m_src_offset < LZ4F_HEADER_SIZE_MAX ) {
+            m_src_size = m_src_size - m_src_offset;
+            std::memmove ( m_src_buffer.data ( ), m_src_buffer.data ( ) + m_src_offset, m_src_size );
+            m_src_offset = 0u;
+            m_src_size += read_source ( m_src_buffer.data ( ) + m_src_size, m_src_buffer.size ( ) - m_src_size );
+        }
+        src      = m_src_buffer.data ( ) + m_src_offset;
+        src_size = m_src_size - m_src_offset;
+    }
+    if ( LZ4F_isError ( LZ4F_getFrameInfo ( m_context, &info_, src, &src_size ) ) )
+        return false;
+    if ( m_memory )
+        m_memory->consume ( src_size );
+    else
+        m_src_offset += src_size;
+    return true;
+}
+
+// The dictionary of the frame with ID dict_id_, from the registry.
+void LZ4FrameCodec::Decoder::select_dictionary ( unsigned int const dict_id_ ) {
+    m_dictionary = dict_id_ ? m_registry->find ( dict_id_ ) : nullptr;
+    if ( dict_id_ and not m_dictionary )
+        throw std::runtime_error ( "Error during LZ4 decompression, unknown dictionary" );
+}
+
+// Feeds the frame header to the reset context.
+void LZ4FrameCodec::Decoder::start_frame ( ) {
+    if ( m_registry )
+        select_dictionary ( parse_frame_header ( m_header ).dict_id );
+    m_frame_start        = false;
+    std::size_t src_size = m_header.size ( ), dest_size = 0u;
+    char none            = 0;
+    std::size_t ret      = 0u;
+    if ( m_dictionary )
+        ret = LZ4F_decompress_usingDict ( m_context, &none, &dest_size, m_header.data ( ), &src_size, m_dictionary->bytes,
+                                          m_dictionary->size, nullptr );
+    else
+        ret = LZ4F_decompress ( m_context, &none, &dest_size, m_header.data ( ), &src_size, nullptr );
+    if ( LZ4F_isError ( ret ) != 0 or src_size != m_header.size ( ) )
+        throw std::runtime_error ( "Error during LZ4 decompression" );
+}
+
+// Decompresses into dest_, returns the number of bytes written, 0 at the end of the source.
+std::size_t LZ4FrameCodec::Decoder::decode ( char * dest_, std::size_t const dest_capacity_ ) {
+    while ( true ) {
+        if ( m_registry and m_frame_start ) {
+            // LZ4F takes the dictionary until the header is decoded, so the header is decoded here first.
+            LZ4F_frameInfo_t info = LZ4F_INIT_FRAMEINFO;
+            select_dictionary ( frame_info ( info ) ? info.dictID : 0u );
+            m_frame_start = false;
+        }
+        char const * src         = nullptr;
+        std::size_t src_avalable = 0u;
+        if ( m_memory ) {
+            src          = m_memory->data ( );
+            src_avalable = m_memory->available ( );
+        }
+        else {
+            if ( m_src_offset == m_src_size ) {
+                m_src_size   = read_source ( &m_src_buffer.front ( ), m_src_buffer.size ( ) );
+                m_src_offset = 0;
+            }
+            src          = &m_src_buffer.front ( ) + m_src_offset;
+            src_avalable = m_src_size - m_src_offset;
+        }
+        // At the end of the source, LZ4F may still hold the rest of a block, of a frame that was flushed but not ended.
+        bool const source_end = 0u == src_avalable;
+        std::size_t dest_size = dest_capacity_;
+        std::size_t ret       = 0u;
+        {
+            LZ4ScopedTimer timer ( m_stats ? &m_stats->lz4_time : nullptr );
+            if ( m_dictionary )
+                ret = LZ4F_decompress_usingDict ( m_context, dest_, &dest_size, src, &src_avalable, m_dictionary->bytes,
+                                                  m_dictionary->size, nullptr );
+            else
+                ret = LZ4F_decompress ( m_context, dest_, &dest_size, src, &src_avalable, nullptr );
+        }
+        if ( m_stats ) {
+            m_stats->uncompressed_bytes += dest_size;
+            if ( m_memory )
+                m_stats->compressed_bytes += src_avalable;
+        }
+        if ( m_memory )
+            m_memory->consume ( src_avalable );
+        else
+            m_src_offset += src_avalable;
+        if ( LZ4F_isError ( ret ) != 0 )
+            throw std::runtime_error ( "Error during LZ4 decompression" );
+        if ( 0u == ret )
+            m_frame_start = true;
+        if ( dest_size > 0 or source_end )
+            return dest_size;
+    }
+}
+
+using LZ4OStreamBuf = CompressedOStreamBuf<LZ4FrameCodec>;
+using LZ4IStreamBuf = CompressedIStreamBuf<LZ4FrameCodec>;
+
+// The memory is the source of the stream buffer, which owns it.
+[[nodiscard]] static LZ4IStreamBuf * memory_buffer ( std::unique_ptr<LZ4MemoryBuf> memory_,
+                                                    LZ4Dictionary const * dictionary_ = nullptr ) {
+    std::streambuf * const source = memory_.get ( );
+    return new LZ4IStreamBuf ( source, LZ4Options ( ), dictionary_, std::move ( memory_ ) );
+}
+
+LZ4OStream::LZ4OStream ( std::ostream & stream_, int const compression_level_ ) :
+    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), level_options ( compression_level_ ) ) ) {}
+LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_, int const compression_level_ ) :
+    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), level_options ( compression_level_ ), &dictionary_ ) ) {}
+LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4ParallelOptions const & parallel_, int const compression_level_ ) :
+    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), level_options ( compression_level_ ), nullptr, &parallel_ ) ) {}
+LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_, LZ4ParallelOptions const & parallel_,
+                         int const compression_level_ ) :
+    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), level_options ( compression_level_ ), &dictionary_, &parallel_ ) ) {}
+LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4ContextPool & pool_, int const compression_level_ ) :
+    std::ostream (
+        new LZ4OStreamBuf ( stream_.rdbuf ( ), level_options ( compression_level_ ), nullptr, nullptr, false, &pool_ ) ) {}
+LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4Options const & options_ ) :
+    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), options_ ) ) {}
+LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_, LZ4Options const & options_ ) :
+    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), options_, &dictionary_ ) ) {}
+LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4Options const & options_, LZ4ParallelOptions const & parallel_ ) :
+    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), options_, nullptr, &parallel_ ) ) {}
+LZ4OStream::LZ4OStream ( std::ostream & stream_, LZ4ContextPool & pool_, LZ4Options const & options_ ) :
+    std::ostream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), options_, nullptr, nullptr, false, &pool_ ) ) {}
+LZ4OStream::LZ4OStream ( std::streambuf * buffer_ ) : std::ostream ( buffer_ ) {}
+LZ4OStream::~LZ4OStream ( ) { delete rdbuf ( ); }
+void LZ4OStream::close ( ) { dynamic_cast<LZ4OStreamBuf *> ( rdbuf ( ) )->close ( ); }
+void LZ4OStream::reset ( std::ostream & stream_ ) {
+    dynamic_cast<LZ4OStreamBuf *> ( rdbuf ( ) )->reset ( stream_.rdbuf ( ) );
+    clear ( );
+}
+void LZ4OStream::setStats ( LZ4Stats * stats_ ) { dynamic_cast<LZ4OStreamBuf *> ( rdbuf ( ) )->encoder ( ).set_stats ( stats_ ); }
+std::size_t LZ4OStream::memoryUsage ( ) const {
+    return dynamic_cast<LZ4OStreamBuf *> ( rdbuf ( ) )->encoder ( ).memory_usage ( );
+}
+void LZ4OStream::setSampler ( LZ4DictionaryTrainer * trainer_, double const fraction_ ) {
+    dynamic_cast<LZ4OStreamBuf *> ( rdbuf ( ) )->encoder ( ).set_sampler ( trainer_, fraction_ );
+}
+
+LZ4SeekableOStream::LZ4SeekableOStream ( std::ostream & stream_, int const compression_level_ ) :
+    LZ4OStream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), level_options ( compression_level_ ), nullptr, nullptr, true ) ) {}
+LZ4SeekableOStream::LZ4SeekableOStream ( std::ostream & stream_, LZ4Dictionary const & dictionary_, int const compression_level_ ) :
+    LZ4OStream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), level_options ( compression_level_ ), &dictionary_, nullptr, true ) ) {}
+LZ4SeekableOStream::LZ4SeekableOStream ( std::ostream & stream_, LZ4ParallelOptions const & parallel_,
+                                         int const compression_level_ ) :
+    LZ4OStream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), level_options ( compression_level_ ), nullptr, &parallel_, true ) ) {}
+LZ4SeekableOStream::LZ4SeekableOStream ( std::ostream & stream_, LZ4Options const & options_ ) :
+    LZ4OStream ( new LZ4OStreamBuf ( stream_.rdbuf ( ), options_, nullptr, nullptr, true ) ) {}
+
+LZ4IStream::LZ4IStream ( std::istream & stream_ ) : std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), LZ4Options ( ) ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4Dictionary const & dictionary_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), LZ4Options ( ), &dictionary_ ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4ParallelOptions const & parallel_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), LZ4Options ( ), nullptr, &parallel_ ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4Dictionary const & dictionary_, LZ4ParallelOptions const & parallel_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), LZ4Options ( ), &dictionary_, &parallel_ ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4ContextPool & pool_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), LZ4Options ( ), nullptr, nullptr, &pool_ ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4Options const & options_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), options_ ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4ContextPool & pool_, LZ4Options const & options_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), options_, nullptr, nullptr, &pool_ ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4Dictionary const & dictionary_, LZ4Options const & options_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), options_, &dictionary_ ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4DictionaryRegistry const & registry_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), LZ4Options ( ), nullptr, nullptr, nullptr, &registry_ ) ) {}
+LZ4IStream::LZ4IStream ( std::istream & stream_, LZ4DictionaryRegistry const & registry_, LZ4Options const & options_ ) :
+    std::istream ( new LZ4IStreamBuf ( stream_.rdbuf ( ), options_, nullptr, nullptr, nullptr, &registry_ ) ) {}
+LZ4IStream::LZ4IStream ( void const * data_, std::size_t const size_ ) :
+    std::istream ( memory_buffer ( std::make_unique<LZ4MemoryBuf> ( static_cast<char const *> ( data_ ), size_ ) ) ) {}
+LZ4IStream::LZ4IStream ( void const * data_, std::size_t const size_, LZ4Dictionary const & dictionary_ ) :
+    std::istream (
+        memory_buffer ( std::make_unique<LZ4MemoryBuf> ( static_cast<char const *> ( data_ ), size_ ), &dictionary_ ) ) {}
+LZ4IStream::LZ4IStream ( std::filesystem::path const & path_ ) :
+    std::istream ( memory_buffer ( std::make_unique<LZ4MemoryBuf> ( LZ4MappedFile ( path_ ) ) ) ) {}
+LZ4IStream::LZ4IStream ( std::filesystem::path const & path_, LZ4Dictionary const & dictionary_ ) :
+    std::istream ( memory_buffer ( std::make_unique<LZ4MemoryBuf> ( LZ4MappedFile ( path_ ) ), &dictionary_ ) ) {}
+LZ4IStream::~LZ4IStream ( ) { delete rdbuf ( ); }
+void LZ4IStream::reset ( std::istream & stream_ ) {
+    dynamic_cast<LZ4IStreamBuf *> ( rdbuf ( ) )->reset ( stream_.rdbuf ( ) );
+    clear ( );
+}
+unsigned long long LZ4IStream::contentSize ( ) {
+    return dynamic_cast<LZ4IStreamBuf *> ( rdbuf ( ) )->decoder ( ).content_size ( );
+}
+void LZ4IStream::setStats ( LZ4Stats * stats_ ) { dynamic_cast<LZ4IStreamBuf *> ( rdbuf ( ) )->decoder ( ).set_stats ( stats_ ); }
+std::size_t LZ4IStream::memoryUsage ( ) { return dynamic_cast<LZ4IStreamBuf *> ( rdbuf ( ) )->decoder ( ).memory_usage ( ); }
+
+// The largest frame LZ4Frame::compress ( ) compresses in one go, larger objects are compressed a block at a time. Bounds the
+// buffer each thread keeps.
+static constexpr std::size_t FRAME_BUFFER_MAX = 1024u * 1024u;
+
+void LZ4Frame::compress ( std::ostream & stream_, void const * data_, std::size_t const size_, int const compression_level_ ) {
+    struct Context {
+        ~Context ( ) { LZ4F_freeCompressionContext ( context ); }
+        LZ4F_cctx * context = nullptr; // Created by the first large object.
+        std::vector<char> buffer;
+    };
+    thread_local Context local;
+    LZ4F_preferences_t preferences    = DEFAULT_PREFERENCES;
+    preferences.frameInfo.contentSize = size_;
+    preferences.compressionLevel      = compression_level_;
+    std::size_t const bound           = LZ4F_compressFrameBound ( size_, &preferences );
+    if ( bound <= FRAME_BUFFER_MAX ) {
+        if ( local.buffer.size ( ) < bound )
+            local.buffer.resize ( bound );
+        std::size_t const compressed_size =
+            LZ4F_compressFrame ( local.buffer.data ( ), local.buffer.size ( ), data_, size_, &preferences );
+        if ( LZ4F_isError ( compressed_size ) )
+            throw std::runtime_error ( "Error during LZ4 frame compression" );
+        stream_.write ( local.buffer.data ( ), compressed_size );
+        return;
+    }
+    if ( not local.context )
+        local.context = create_compression_context ( nullptr );
+    std::size_t const chunk_size = block_size ( preferences.frameInfo.blockSizeID );
+    std::size_t const capacity =
+        std::max<std::size_t> ( LZ4F_compressBound ( chunk_size, &preferences ), LZ4F_HEADER_SIZE_MAX );
+    if ( local.buffer.size ( ) < capacity )
+        local.buffer.resize ( capacity );
+    std::size_t compressed_size = LZ4F_compressBegin ( local.context, local.buffer.data ( ), capacity, &preferences );
+    if ( LZ4F_isError ( compressed_size ) )
+        throw std::runtime_error ( "Error during LZ4 frame compression" );
+    stream_.write ( local.buffer.data ( ), compressed_size );
+    char const * const data = static_cast<char const *> ( data_ );
+    for ( std::size_t offset = 0u; offset < size_; offset += chunk_size ) {
+        compressed_size = LZ4F_compressUpdate ( local.context, local.buffer.data ( ), capacity, data + offset,
+                                                std::min ( chunk_size, size_ - offset ), nullptr );
+        if ( LZ4F_isError ( compressed_size ) )
+            throw std::runtime_error ( "Error during LZ4 frame compression" );
+        stream_.write ( local.buffer.data ( ), compressed_size );
+    }
+    compressed_size = LZ4F_compressEnd ( local.context, local.buffer.data ( ), capacity, nullptr );
+    if ( LZ4F_isError ( compressed_size ) )
+        throw std::runtime_error ( "Error during LZ4 frame compression" );
+    stream_.write ( local.buffer.data ( ), compressed_size );
+}
+
+void LZ4Frame::decompress ( std::istream & stream_, void * ( *destination_ ) ( void *, unsigned long long const ),
+                            void * object_ ) {
+    struct Context {
+        Context ( ) {
+            if ( LZ4F_isError ( LZ4F_createDecompressionContext ( &context, LZ4F_VERSION ) ) )
+                throw std::runtime_error ( "Error during LZ4 istream creation" );
+        }
+        ~Context ( ) { LZ4F_freeDecompressionContext ( context ); }
+        LZ4F_dctx * context = nullptr;
+        std::vector<char> buffer;
+    };
+    thread_local Context local;
+    LZ4F_resetDecompressionContext ( local.context );
+    // The size of the header is known from its first bytes, the content size from the header. Skippable frames in front of
+    // the frame are skipped.
+    char header[ LZ4F_HEADER_SIZE_MAX ];
+    while ( true ) {
+        if ( not stream_.read ( header, LZ4F_MIN_SIZE_TO_KNOW_HEADER_LENGTH ) )
+            throw std::runtime_error ( "Error during LZ4 frame decompression" );
+        if ( LZ4F_MAGIC_SKIPPABLE_START != ( read_le32 ( header ) & 0xFFFFFFF0u ) )
+            break;
+        if ( not stream_.read ( header + LZ4F_MIN_SIZE_TO_KNOW_HEADER_LENGTH, 8 - LZ4F_MIN_SIZE_TO_KNOW_HEADER_LENGTH ) )
+            throw std::runtime_error ( "Error during LZ4 frame decompression" );
+        std::streamsize const skip = read_le32 ( header + 4 );
+        if ( stream_.ignore ( skip ).gcount ( ) != skip )
+            throw std::runtime_error ( "Error during LZ4 frame decompression" );
+    }
+    std::size_t header_size = LZ4F_headerSize ( header, LZ4F_MIN_SIZE_TO_KNOW_HEADER_LENGTH );
+    if ( LZ4F_isError ( header_size ) or
+         not stream_.read ( header + LZ4F_MIN_SIZE_TO_KNOW_HEADER_LENGTH, header_size - LZ4F_MIN_SIZE_TO_KNOW_HEADER_LENGTH ) )
+        throw std::runtime_error ( "Error during LZ4 frame decompression" );
+    LZ4F_frameInfo_t info;
+    std::size_t hint = LZ4F_getFrameInfo ( local.context, &info, header, &header_size );
+    if ( LZ4F_isError ( hint ) )
+        throw std::runtime_error ( "Error during LZ4 frame decompression" );
+    if ( not info.contentSize ) {
+        // A frame written by a stream doesn't record its content size, it's decompressed a block at a time into memory of
+        // its own, and the size checked at the end.
+        std::vector<char> content;
+        std::size_t const step = block_size ( info.blockSizeID );
+        std::size_t used       = 0u;
+        while ( hint ) {
+            std::size_t const read_size = hint;
+            if ( local.buffer.size ( ) < read_size )
+                local.buffer.resize ( read_size );
+            if ( not stream_.read ( local.buffer.data ( ), read_size ) )
+                throw std::runtime_error ( "Error during LZ4 frame decompression" );
+            for ( std::size_t consumed = 0u; hint and consumed < read_size; ) {
+                if ( content.size ( ) - used < step )
+                    content.resize ( used + step );
+                std::size_t src_size = read_size - consumed, dest_size = content.size ( ) - used;
+                hint = LZ4F_decompress ( local.context, content.data ( ) + used, &dest_size, local.buffer.data ( ) + consumed,
+                                         &src_size, nullptr );
+                if ( LZ4F_isError ( hint ) or not ( src_size or dest_size ) )
+                    throw std::runtime_error ( "Error during LZ4 frame decompression" );
+                consumed += src_size;
+                used += dest_size;
+            }
+        }
+        char * const dest = static_cast<char *> ( destination_ ( object_, used ) );
+        if ( not dest )
+            throw std::runtime_error ( "Error during LZ4 frame decompression, the content size doesn't match" );
+        if ( used )
+            std::memcpy ( dest, content.data ( ), used );
+        return;
+    }
+    char * dest = static_cast<char *> ( destination_ ( object_, info.contentSize ) );
+    if ( not dest )
+        throw std::runtime_error ( "Error during LZ4 frame decompression, the content size doesn't match" );
+    char * const dest_end = dest + info.contentSize;
+    // LZ4F tells the size of the next read, the stream is never read beyond the frame.
+    while ( hint ) {
+        if ( local.buffer.size ( ) < hint )
+            local.buffer.resize ( hint );
+        if ( not stream_.read ( local.buffer.data ( ), hint ) )
+            throw std::runtime_error ( "Error during LZ4 frame decompression" );
+        std::size_t src_size = hint, dest_size = dest_end - dest;
+        hint                 = LZ4F_decompress ( local.context, dest, &dest_size, local.buffer.data ( ), &src_size, nullptr );
+        if ( LZ4F_isError ( hint ) )
+            throw std::runtime_error ( "Error during LZ4 frame decompression" );
+        dest += dest_size;
+    }
+    if ( dest != dest_end )
+        throw std::runtime_error ( "Error during LZ4 frame decompression" );
+}
+
+void LZ4Frame::saveSkippable ( std::ostream & stream_, void const * data_, std::size_t const size_, unsigned int const id_ ) {
+    if ( id_ > 0xFu or size_ > 0xFFFFFFFFu )
+        throw std::runtime_error ( "Error during LZ4 skippable frame writing" );
+    char header[ 8 ];
+    write_le32 ( header, LZ4F_MAGIC_SKIPPABLE_START + id_ );
+    write_le32 ( header + 4, static_cast<std::uint32_t> ( size_ ) );
+    stream_.write ( header, sizeof ( header ) );
+    stream_.write ( static_cast<char const *> ( data_ ), size_ );
+}
+
+LZ4FrameScanner::LZ4FrameScanner ( std::istream & stream_ ) : m_source ( stream_.rdbuf ( ) ) {
+    std::streamoff const position = m_source->pubseekoff ( 0, std::ios_base::cur, std::ios_base::in );
+    if ( std::streamoff ( -1 ) == position )
+        return;
+    std::streamoff const end = m_source->pubseekoff ( 0, std::ios_base::end, std::ios_base::in );
+    m_source->pubseekpos ( position, std::ios_base::in );
+    m_position = static_cast<std::uint64_t> ( position );
+    m_end      = static_cast<std::uint64_t> ( end );
+    m_seekable = std::streamoff ( -1 ) != end;
+}
+
+bool LZ4FrameScanner::next ( LZ4FrameInfo & frame_, std::vector<char> * skippable_data_ ) {
+    if ( std::char_traits<char>::eq_int_type ( m_source->sgetc ( ), std::char_traits<char>::eof ( ) ) )
+        return false;
+    frame_        = LZ4FrameInfo ( );
+    frame_.offset = m_position;
+    std::vector<char> header ( 4u );
+    read ( header.data ( ), 4u );
+    frame_.magic = read_le32 ( header.data ( ) );
+    if ( LZ4F_MAGICNUMBER != frame_.magic and LZ4F_MAGIC_SKIPPABLE_START != ( frame_.magic & 0xFFFFFFF0u ) )
+        throw std::runtime_error ( "Error during LZ4 frame scanning, unknown frame" );
+    if ( frame_.skippable ( ) ) {
+        read ( header.data ( ), 4u );
+        frame_.content_size = read_le32 ( header.data ( ) );
+        if ( skippable_data_ ) {
+            skippable_data_->resize ( static_cast<std::size_t> ( frame_.content_size ) );
+            read ( skippable_data_->data ( ), skippable_data_->size ( ) );
+        }
+        else
+            skip ( frame_.content_size );
+    }
+    else {
+        read_frame_header ( m_source, header );
+        m_position += header.size ( ) - 4u;
+        LZ4FrameHeader const format = parse_frame_header ( header );
+        frame_.content_size         = format.content_size;
+        // Block headers up to the end mark, the blocks themselves are skipped.
+        while ( true ) {
+            char block_header[ LZ4F_BLOCK_HEADER_SIZE ];
+            read ( block_header, sizeof ( block_header ) );
+            std::uint32_t const block_word = read_le32 ( block_header );
+            if ( 0u == block_word )
+                break;
+            if ( ( block_word & 0x7FFFFFFFu ) > format.block_size )
+                throw std::runtime_error ( "Error during LZ4 frame scanning, corrupt block header" );
+            skip ( ( block_word & 0x7FFFFFFFu ) + ( format.block_checksum ? 4u : 0u ) );
+        }
+        if ( format.content_checksum )
+            skip ( 4u );
+    }
+    frame_.size = m_position - frame_.offset;
+    return true;
+}
+
+std::vector<LZ4FrameInfo> LZ4FrameScanner::list ( std::istream & stream_ ) {
+    LZ4FrameScanner scanner ( stream_ );
+    std::vector<LZ4FrameInfo> frames;
+    LZ4FrameInfo frame;
+    while ( scanner.next ( frame ) )
+        frames.push_back ( frame );
+    return frames;
+}
+
+void LZ4FrameScanner::read ( char * dest_, std::size_t const size_ ) {
+    if ( static_cast<std::streamsize> ( size_ ) != m_source->sgetn ( dest_, size_ ) )
+        throw std::runtime_error ( "Error during LZ4 frame scanning, truncated source" );
+    m_position += size_;
+}
+
+void LZ4FrameScanner::skip ( std::uint64_t const size_ ) {
+    if ( m_seekable ) {
+        if ( m_end - m_position < size_ or
+             std::streamoff ( -1 ) == m_source->pubseekoff ( static_cast<std::streamoff> ( size_ ), std::ios_base::cur,
+                                                             std::ios_base::in ) )
+            throw std::runtime_error ( "Error during LZ4 frame scanning, truncated source" );
+        m_position += size_;
+        return;
+    }
+    char buffer[ 4096 ];
+    for ( std::uint64_t left = size_; left; ) {
+        std::size_t const size = static_cast<std::size_t> ( std::min<std::uint64_t> ( left, sizeof ( buffer ) ) );
+        read ( buffer, size );
+        left -= size;
+    }
+}
+
+LZ4MessageWriter::LZ4MessageWriter ( std::ostream & stream_, std::size_t const max_message_size_, int const acceleration_ ) :
+    m_sink ( stream_.rdbuf ( ) ), m_max_message_size ( max_message_size_ ), m_acceleration ( acceleration_ ) {
+    if ( 0u == max_message_size_ or max_message_size_ > LZ4_MAX_INPUT_SIZE )
+        throw std::runtime_error ( "Error during LZ4 message stream creation" );
+    m_context = LZ4_createStream ( );
+    if ( not m_context )
+        throw std::runtime_error ( "Error during LZ4 message stream creation" );
+    m_ring.resize ( message_ring_size ( max_message_size_ ) );
+    m_buffer.resize ( 5u + LZ4_compressBound ( static_cast<int> ( max_message_size_ ) ) );
+    char header[ 8 ];
+    write_le32 ( header, MESSAGE_STREAM_MAGIC );
+    write_le32 ( header + 4, static_cast<std::uint32_t> ( max_message_size_ ) );
+    m_sink->sputn ( header, sizeof ( header ) );
+}
+
+LZ4MessageWriter::LZ4MessageWriter ( std::ostream & stream_, LZ4Dictionary const & dictionary_,
+                                     std::size_t const max_message_size_, int const acceleration_ ) :
+    LZ4MessageWriter ( stream_, max_message_size_, acceleration_ ) {
+    LZ4_loadDict ( m_context, dictionary_.bytes, static_cast<int> ( dictionary_.size ) );
+}
+
+LZ4MessageWriter::~LZ4MessageWriter ( ) { LZ4_freeStream ( m_context ); }
+
+void LZ4MessageWriter::write ( void const * data_, std::size_t const size_ ) {
+    if ( size_ > m_max_message_size )
+        throw std::runtime_error ( "Error during LZ4 message compression, the message exceeds the maximum message size" );
+    if ( m_position + m_max_message_size > m_ring.size ( ) )
+        m_position = 0u;
+    char * const message = m_ring.data ( ) + m_position;
+    if ( size_ )
+        std::memcpy ( message, data_, size_ );
+    // Compressed behind the room for the largest size prefix, the prefix is then put right in front of it.
+    char * const compressed   = m_buffer.data ( ) + 5;
+    int const compressed_size = LZ4_compress_fast_continue ( m_context, message, compressed, static_cast<int> ( size_ ),
+                                                             static_cast<int> ( m_buffer.size ( ) - 5u ), m_acceleration );
+    if ( compressed_size <= 0 )
+        throw std::runtime_error ( "Error during LZ4 message compression" );
+    m_position += size_;
+    std::size_t prefix_size = 1u;
+    for ( std::uint32_t value = static_cast<std::uint32_t> ( compressed_size ) >> 7; value; value >>= 7 )
+        ++prefix_size;
+    char * const prefix = compressed - prefix_size;
+    std::uint32_t value = static_cast<std::uint32_t> ( compressed_size );
+    for ( std::size_t i = 0u; i < prefix_size; ++i, value >>= 7 )
+        prefix[ i ] = static_cast<char> ( ( value & 0x7Fu ) | ( i + 1u < prefix_size ? 0x80u : 0x00u ) );
+    m_sink->sputn ( prefix, prefix_size + compressed_size );
+    m_sink->pubsync ( );
+}
+
+LZ4MessageReader::LZ4MessageReader ( std::istream & stream_ ) : m_source ( stream_.rdbuf ( ) ), m_dictionary ( nullptr ) {
+    m_context = LZ4_createStreamDecode ( );
+    if ( not m_context )
+        throw std::runtime_error ( "Error during LZ4 message istream creation" );
+}
+
+LZ4MessageReader::LZ4MessageReader ( std::istream & stream_, LZ4Dictionary const & dictionary_ ) :
+    LZ4MessageReader ( stream_ ) {
+    m_dictionary = &dictionary_;
+}
+
+LZ4MessageReader::~LZ4MessageReader ( ) { LZ4_freeStreamDecode ( m_context ); }
+
+char const * LZ4MessageReader::read ( std::size_t & size_ ) {
+    size_ = 0u;
+    if ( m_ring.empty ( ) and not read_header ( ) )
+        return nullptr;
+    std::uint32_t compressed_size = 0u;
+    for ( int shift = 0;; shift += 7 ) {
+        std::streambuf::int_type const byte = m_source->sbumpc ( );
+        if ( std::char_traits<char>::eq_int_type ( byte, std::char_traits<char>::eof ( ) ) ) {
+            if ( 0 == shift )
+                return nullptr;
+            throw std::runtime_error ( "Error during LZ4 message decompression, truncated source" );
+        }
+        if ( shift > 28 )
+            throw std::runtime_error ( "Error during LZ4 message decompression, corrupt message size" );
+        compressed_size |= static_cast<std::uint32_t> ( byte & 0x7F ) << shift;
+        if ( not( byte & 0x80 ) )
+            break;
+    }
+    if ( compressed_size > m_buffer.size ( ) )
+        throw std::runtime_error ( "Error during LZ4 message decompression, corrupt message size" );
+    if ( static_cast<std::streamsize> ( compressed_size ) != m_source->sgetn ( m_buffer.data ( ), compressed_size ) )
+        throw std::runtime_error ( "Error during LZ4 message decompression, truncated source" );
+    if ( m_position + m_max_message_size > m_ring.size ( ) )
+        m_position = 0u;
+    char * const message = m_ring.data ( ) + m_position;
+    int const message_size =
+        LZ4_decompress_safe_continue ( m_context, m_buffer.data ( ), message, static_cast<int> ( compressed_size ),
+                                       static_cast<int> ( m_max_message_size ) );
+    if ( message_size < 0 )
+        throw std::runtime_error ( "Error during LZ4 message decompression" );
+    m_position += message_size;
+    size_ = static_cast<std::size_t> ( message_size );
+    return message;
+}
+
+// Sizes the buffers as the writer did, returns false if the source is empty.
+bool LZ4MessageReader::read_header ( ) {
+    char header[ 8 ];
+    std::streamsize const read_size = m_source->sgetn ( header, sizeof ( header ) );
+    if ( 0 == read_size )
+        return false;
+    if ( sizeof ( header ) != read_size or MESSAGE_STREAM_MAGIC != read_le32 ( header ) )
+        throw std::runtime_error ( "Error during LZ4 message decompression, corrupt header" );
+    m_max_message_size = read_le32 ( header + 4 );
+    if ( 0u == m_max_message_size or m_max_message_size > LZ4_MAX_INPUT_SIZE )
+        throw std::runtime_error ( "Error during LZ4 message decompression, corrupt header" );
+    m_ring.resize ( message_ring_size ( m_max_message_size ) );
+    m_buffer.resize ( LZ4_compressBound ( static_cast<int> ( m_max_message_size ) ) );
+    if ( m_dictionary )
+        LZ4_setStreamDecode ( m_context, m_dictionary->bytes, static_cast<int> ( m_dictionary->size ) );
+    return true;
+}
+
+LZ4SnapshotWriter::LZ4SnapshotWriter ( std::ostream & stream_, int const compression_level_, std::size_t const key_interval_ ) :
+    m_sink ( stream_.rdbuf ( ) ), m_buffer ( LZ4_compressBound ( static_cast<int> ( SNAPSHOT_BLOCK ) ) ),
+    m_level ( compression_level_ ), m_key_interval ( key_interval_ ) {
+    if ( m_level >= LZ4HC_CLEVEL_MIN ) {
+        m_hc_context = LZ4_createStreamHC ( );
+        if ( m_hc_context )
+            LZ4_resetStreamHC_fast ( m_hc_context, m_level );
+    }
+    else
+        m_context = LZ4_createStream ( );
+    if ( not m_context and not m_hc_context )
+        throw std::runtime_error ( "Error during LZ4 snapshot ostream creation" );
+}
+
+LZ4SnapshotWriter::~LZ4SnapshotWriter ( ) {
+    LZ4_freeStream ( m_context );
+    LZ4_freeStreamHC ( m_hc_context );
+}
+
+void LZ4SnapshotWriter::write ( void const * data_, std::size_t const size_ ) {
+    char const * const data = static_cast<char const *> ( data_ );
+    bool const delta        = m_count and ( not m_key_interval or m_count % m_key_interval );
+    // The blocks are collected first, the header holds their size.
+    m_output.resize ( SNAPSHOT_HEADER );
+    auto const append = [ this ] ( char const * bytes_, std::size_t const size_ ) {
+        m_output.insert ( m_output.end ( ), bytes_, bytes_ + size_ );
+    };
+    for ( std::size_t begin = 0u; begin < size_; begin += SNAPSHOT_BLOCK ) {
+        std::size_t const size = std::min ( SNAPSHOT_BLOCK, size_ - begin );
+        char block_size[ 4 ];
+        // Unchanged blocks are cheaper to compare than to compress.
+        if ( delta and begin + size <= m_previous.size ( ) and
+             0 == std::memcmp ( data + begin, m_previous.data ( ) + begin, size ) ) {
+            write_le32 ( block_size, 0u );
+            append ( block_size, sizeof ( block_size ) );
+            continue;
+        }
+        std::size_t const dictionary_end  = delta ? std::min ( begin + size, m_previous.size ( ) ) : 0u;
+        std::size_t const dictionary_size = std::min ( dictionary_end, SNAPSHOT_DICTIONARY );
+        char const * const dictionary     = m_previous.data ( ) + dictionary_end - dictionary_size;
+        int compressed_size;
+        if ( m_hc_context ) {
+            LZ4_loadDictHC ( m_hc_context, dictionary, static_cast<int> ( dictionary_size ) );
+            compressed_size = LZ4_compress_HC_continue ( m_hc_context, data + begin, m_buffer.data ( ), static_cast<int> ( size ),
+                                                         static_cast<int> ( m_buffer.size ( ) ) );
+        }
+        else {
+            LZ4_loadDict ( m_context, dictionary, static_cast<int> ( dictionary_size ) );
+            compressed_size = LZ4_compress_fast_continue ( m_context, data + begin, m_buffer.data ( ), static_cast<int> ( size ),
+                                                           static_cast<int> ( m_buffer.size ( ) ), 1 );
+        }
+        if ( compressed_size <= 0 )
+            throw std::runtime_error ( "Error during LZ4 snapshot compression" );
+        if ( static_cast<std::size_t> ( compressed_size ) < size ) {
+            write_le32 ( block_size, static_cast<std::uint32_t> ( compressed_size ) );
+            append ( block_size, sizeof ( block_size ) );
+            append ( m_buffer.data ( ), static_cast<std::size_t> ( compressed_size ) );
+        }
+        else {
+            write_le32 ( block_size, SNAPSHOT_RAW | static_cast<std::uint32_t> ( size ) );
+            append ( block_size, sizeof ( block_size ) );
+            append ( data + begin, size );
+        }
+    }
+    write_le32 ( m_output.data ( ), SNAPSHOT_MAGIC );
+    write_le32 ( m_output.data ( ) + 4, delta );
+    write_le64 ( m_output.data ( ) + 8, size_ );
+    write_le64 ( m_output.data ( ) + 16, m_output.size ( ) - SNAPSHOT_HEADER );
+    m_sink->sputn ( m_output.data ( ), m_output.size ( ) );
+    m_previous.assign ( data, data + size_ );
+    ++m_count;
+}
+
+LZ4SnapshotReader::LZ4SnapshotReader ( std::istream & stream_ ) :
+    m_source ( stream_.rdbuf ( ) ), m_buffer ( LZ4_compressBound ( static_cast<int> ( SNAPSHOT_BLOCK ) ) ) {}
+
+// Reads the header of the next snapshot, false at the end of the source.
+[[nodiscard]] static bool read_snapshot_header ( std::streambuf * source_, bool & delta_, std::uint64_t & size_,
+                                                 std::uint64_t & compressed_size_ ) {
+    char header[ SNAPSHOT_HEADER ];
+    std::streamsize const read_size = source_->sgetn ( header, sizeof ( header ) );
+    if ( 0 == read_size )
+        return false;
+    if ( sizeof ( header ) != read_size or SNAPSHOT_MAGIC != read_le32 ( header ) or read_le32 ( header + 4 ) > 1u )
+        throw std::runtime_error ( "Error during LZ4 snapshot decompression, corrupt header" );
+    delta_           = 1u == read_le32 ( header + 4 );
+    size_            = read_le64 ( header + 8 );
+    compressed_size_ = read_le64 ( header + 16 );
+    return true;
+}
+
+bool LZ4SnapshotReader::seekLastBase ( ) {
+    std::streamoff position = m_source->pubseekoff ( 0, std::ios_base::cur, std::ios_base::in );
+    if ( std::streamoff ( -1 ) == position )
+        return false;
+    std::streamoff base = -1;
+    bool delta;
+    std::uint64_t size, compressed_size;
+    while ( read_snapshot_header ( m_source, delta, size, compressed_size ) ) {
+        if ( not delta )
+            base = position;
+        position = m_source->pubseekoff ( static_cast<std::streamoff> ( compressed_size ), std::ios_base::cur, std::ios_base::in );
+        if ( std::streamoff ( -1 ) == position )
+            throw std::runtime_error ( "Error during LZ4 snapshot decompression, truncated source" );
+    }
+    if ( std::streamoff ( -1 ) == base )
+        return false;
+    m_source->pubseekpos ( base, std::ios_base::in );
+    m_has_base = false; // The snapshots read before are not the ones before the base.
+    return true;
+}
+
+char const * LZ4SnapshotReader::read ( std::size_t & size_ ) {
+    size_ = 0u;
+    bool delta;
+    std::uint64_t size, compressed_size;
+    if ( not read_snapshot_header ( m_source, delta, size, compressed_size ) )
+        return nullptr;
+    if ( delta and not m_has_base )
+        throw std::runtime_error ( "Error during LZ4 snapshot decompression, a delta without a base" );
+    // The last snapshot becomes the dictionary.
+    m_previous.swap ( m_current );
+    if ( not delta )
+        m_previous.clear ( );
+    m_current.resize ( static_cast<std::size_t> ( size ) );
+    std::uint64_t consumed = 0u;
+    for ( std::size_t begin = 0u; begin < m_current.size ( ); begin += SNAPSHOT_BLOCK ) {
+        std::size_t const size = std::min ( SNAPSHOT_BLOCK, m_current.size ( ) - begin );
+        char block_size_le[ 4 ];
+        if ( sizeof ( block_size_le ) != m_source->sgetn ( block_size_le, sizeof ( block_size_le ) ) )
+            throw std::runtime_error ( "Error during LZ4 snapshot decompression, truncated source" );
+        std::uint32_t const block_size = read_le32 ( block_size_le );
+        consumed += sizeof ( block_size_le ) + ( block_size & ~SNAPSHOT_RAW );
+        if ( 0u == block_size ) {
+            if ( not delta or begin + size > m_previous.size ( ) )
+                throw std::runtime_error ( "Error during LZ4 snapshot decompression, corrupt block size" );
+            std::memcpy ( m_current.data ( ) + begin, m_previous.data ( ) + begin, size );
+            continue;
+        }
+        if ( block_size & SNAPSHOT_RAW ) {
+            if ( size != ( block_size & ~SNAPSHOT_RAW ) )
+                throw std::runtime_error ( "Error during LZ4 snapshot decompression, corrupt block size" );
+            if ( static_cast<std::streamsize> ( size ) != m_source->sgetn ( m_current.data ( ) + begin, size ) )
+                throw std::runtime_error ( "Error during LZ4 snapshot decompression, truncated source" );
+            continue;
+        }
+        if ( block_size > m_buffer.size ( ) )
+            throw std::runtime_error ( "Error during LZ4 snapshot decompression, corrupt block size" );
+        if ( static_cast<std::streamsize> ( block_size ) != m_source->sgetn ( m_buffer.data ( ), block_size ) )
+            throw std::runtime_error ( "Error during LZ4 snapshot decompression, truncated source" );
+        std::size_t const dictionary_end  = delta ? std::min ( begin + size, m_previous.size ( ) ) : 0u;
+        std::size_t const dictionary_size = std::min ( dictionary_end, SNAPSHOT_DICTIONARY );
+        int const decompressed_size       = LZ4_decompress_safe_usingDict (
+            m_buffer.data ( ), m_current.data ( ) + begin, static_cast<int> ( block_size ), static_cast<int> ( size ),
+            m_previous.data ( ) + dictionary_end - dictionary_size, static_cast<int> ( dictionary_size ) );
+        if ( static_cast<int> ( size ) != decompressed_size )
+            throw std::runtime_error ( "Error during LZ4 snapshot decompression" );
+    }
+    if ( consumed != compressed_size )
+        throw std::runtime_error ( "Error during LZ4 snapshot decompression, corrupt header" );
+    m_is_base = not delta;
+    m_has_base |= m_is_base;
+    size_ = m_current.size ( );
+    return m_current.data ( );
+}
+
+// The state of one thread of a batch compressor, or the dictionary prepared for the block API.
+struct LZ4BatchCompressor::State {
+    State ( ) = default;
+    State ( State const & ) = delete;
+    ~State ( ) {
+        LZ4F_freeCompressionContext ( frame_context );
+        LZ4_freeStream ( fast );
+        LZ4_freeStreamHC ( high );
+    }
+
+    State & operator= ( State const & ) = delete;
+
+    LZ4F_cctx * frame_context = nullptr; // Of compress ( ).
+    LZ4_stream_t * fast       = nullptr; // Of pack ( ), at compression levels < LZ4HC_CLEVEL_MIN.
+    LZ4_streamHC_t * high     = nullptr; // Of pack ( ), at the other levels.
+    std::vector<char> blocks;            // Of the payloads of the thread, in pack ( ).
+    std::vector<std::uint32_t> block_sizes;
+};
+
+LZ4BatchCompressor::LZ4BatchCompressor ( int const compression_level_, LZ4ParallelOptions const & parallel_ ) :
+    m_level ( compression_level_ ), m_dictionary ( nullptr ), m_parallel ( parallel_ ) {}
+
+LZ4BatchCompressor::LZ4BatchCompressor ( LZ4Dictionary const & dictionary_, int const compression_level_,
+                                         LZ4ParallelOptions const & parallel_ ) :
+    m_level ( compression_level_ ),
+    m_dictionary ( &dictionary_ ), m_parallel ( parallel_ ) {}
+
+LZ4BatchCompressor::~LZ4BatchCompressor ( ) = default;
+
+std::size_t LZ4BatchCompressor::threads ( LZ4Payload const * payloads_, std::size_t const count_ ) {
+    std::size_t input_size = 0u;
+    for ( std::size_t i = 0u; i < count_; ++i )
+        input_size += payloads_[ i ].size;
+    std::size_t const threads = batch_threads ( m_parallel.threads, count_, input_size );
+    while ( m_states.size ( ) < threads )
+        m_states.push_back ( std::make_unique<State> ( ) );
+    // Started by the first batch that needs them, as many as the largest batch could use.
+    if ( threads > 1u and not m_pool )
+        m_pool = std::make_unique<LZ4BatchPool> (
+            ( m_parallel.threads ? m_parallel.threads : std::max ( std::thread::hardware_concurrency ( ), 1u ) ) - 1u );
+    return threads;
+}
+
+std::vector<std::vector<char>> LZ4BatchCompressor::compress ( LZ4Payload const * payloads_, std::size_t const count_ ) {
+    std::vector<std::vector<char>> frames ( count_ );
+    std::size_t const threads = this->threads ( payloads_, count_ );
+    run_batch ( m_pool.get ( ), threads, count_,
+                [ this, payloads_, &frames ] ( std::size_t const thread_, std::size_t const begin_, std::size_t const end_ ) {
+                    State & state = *m_states[ thread_ ];
+                    if ( not state.frame_context and
+                         LZ4F_isError ( LZ4F_createCompressionContext ( &state.frame_context, LZ4F_VERSION ) ) )
+                        throw std::runtime_error ( "Error during LZ4 batch compression" );
+                    LZ4F_preferences_t preferences = DEFAULT_PREFERENCES;
+                    preferences.compressionLevel   = m_level;
+                    preferences.frameInfo.dictID   = m_dictionary ? m_dictionary->dict_id : 0u;
+                    for ( std::size_t i = begin_; i < end_; ++i ) {
+                        LZ4Payload const & payload        = payloads_[ i ];
+                        preferences.frameInfo.contentSize = payload.size;
+                        std::vector<char> & frame         = frames[ i ];
+                        frame.resize ( LZ4F_compressFrameBound ( payload.size, &preferences ) );
+                        std::size_t const frame_size = LZ4F_compressFrame_usingCDict (
+                            state.frame_context, frame.data ( ), frame.size ( ), payload.data, payload.size,
+                            m_dictionary ? m_dictionary->cdict : nullptr, &preferences );
+                        if ( LZ4F_isError ( frame_size ) )
+                            throw std::runtime_error ( "Error during LZ4 batch compression" );
+                        frame.resize ( frame_size );
+                    }
+                } );
+    return frames;
+}
+
+void LZ4BatchCompressor::pack ( LZ4Payload const * payloads_, std::size_t const count_, std::vector<char> & container_ ) {
+    bool const fast = m_level < LZ4HC_CLEVEL_MIN;
+    int const accel = m_level < 0 ? -m_level : 1;
+    if ( m_dictionary and not m_prepared ) {
+        // Prepared once, then attached to the stream of each payload, which is then as cheap as without dictionary.
+        auto prepared             = std::make_unique<State> ( );
+        int const dictionary_size = static_cast<int> ( m_dictionary->size );
+        if ( fast ) {
+            prepared->fast = LZ4_createStream ( );
+            if ( not prepared->fast )
+                throw std::runtime_error ( "Error during LZ4 batch compression" );
+            LZ4_loadDict ( prepared->fast, m_dictionary->bytes, dictionary_size );
+        }
+        else {
+            prepared->high = LZ4_createStreamHC ( );
+            if ( not prepared->high )
+                throw std::runtime_error ( "Error during LZ4 batch compression" );
+            LZ4_setCompressionLevel ( prepared->high, m_level );
+            LZ4_loadDictHC ( prepared->high, m_dictionary->bytes, dictionary_size );
+        }
+        m_prepared = std::move ( prepared );
+    }
+    std::size_t const threads = this->threads ( payloads_, count_ );
+    run_batch ( m_pool.get ( ), threads, count_, [ this, payloads_, fast, accel ] ( std::size_t const thread_,
+                                                                                    std::size_t const begin_,
+                                                                                    std::size_t const end_ ) {
+        State & state = *m_states[ thread_ ];
+        if ( fast and not state.fast )
+            state.fast = LZ4_createStream ( );
+        if ( not fast and not state.high )
+            state.high = LZ4_createStreamHC ( );
+        if ( not state.fast and not state.high )
+            throw std::runtime_error ( "Error during LZ4 batch compression" );
+        state.blocks.clear ( );
+        state.block_sizes.clear ( );
+        for ( std::size_t i = begin_; i < end_; ++i ) {
+            LZ4Payload const & payload = payloads_[ i ];
+            if ( payload.size > LZ4_MAX_INPUT_SIZE )
+                throw std::runtime_error ( "Error during LZ4 batch compression, payload too large" );
+            char const * const src   = static_cast<char const *> ( payload.data );
+            int const size           = static_cast<int> ( payload.size );
+            std::size_t const offset = state.blocks.size ( );
+            state.blocks.resize ( offset + LZ4_compressBound ( size ) );
+            char * const dest  = state.blocks.data ( ) + offset;
+            int const capacity = LZ4_compressBound ( size );
+            int block_size     = 0;
+            if ( m_prepared ) {
+                if ( fast ) {
+                    LZ4_resetStream_fast ( state.fast );
+                    LZ4_attach_dictionary ( state.fast, m_prepared->fast );
+                    block_size = LZ4_compress_fast_continue ( state.fast, src, dest, size, capacity, accel );
+                }
+                else {
+                    LZ4_resetStreamHC_fast ( state.high, m_level );
+                    LZ4_attach_HC_dictionary ( state.high, m_prepared->high );
+                    block_size = LZ4_compress_HC_continue ( state.high, src, dest, size, capacity );
+                }
+            }
+            else if ( fast )
+                block_size = LZ4_compress_fast_extState_fastReset ( state.fast, src, dest, size, capacity, accel );
+            else
+                block_size = LZ4_compress_HC_extStateHC_fastReset ( state.high, src, dest, size, capacity, m_level );
+            if ( block_size <= 0 or block_size >= size ) {
+                // Stored as is.
+                block_size = size;
+                if ( size )
+                    std::memcpy ( dest, src, payload.size );
+            }
+            state.blocks.resize ( offset + block_size );
+            state.block_sizes.push_back ( static_cast<std::uint32_t> ( block_size ) );
+        }
+    } );
+    // The threads took consecutive payloads, their blocks are concatenated in thread order.
+    std::size_t const table_size = 8u * ( count_ + 1u ) + 4u * count_;
+    std::size_t blocks_size      = 0u;
+    for ( std::size_t t = 0u; t < threads; ++t )
+        blocks_size += m_states[ t ]->blocks.size ( );
+    container_.resize ( 8u + table_size + blocks_size );
+    char * const header = container_.data ( );
+    write_le32 ( header, BATCH_MAGIC );
+    write_le32 ( header + 4, static_cast<std::uint32_t> ( count_ ) );
+    char * offsets       = header + 8;
+    char * sizes         = offsets + 8u * ( count_ + 1u );
+    char * blocks        = sizes + 4u * count_;
+    std::uint64_t offset = 0u;
+    std::size_t i        = 0u;
+    for ( std::size_t t = 0u; t < threads; ++t ) {
+        State const & state = *m_states[ t ];
+        for ( std::uint32_t const block_size : state.block_sizes ) {
+            write_le64 ( offsets, offset );
+            write_le32 ( sizes, static_cast<std::uint32_t> ( payloads_[ i++ ].size ) );
+            offsets += 8;
+            sizes += 4;
+            offset += block_size;
+        }
+        if ( state.blocks.size ( ) )
+            std::memcpy ( blocks, state.blocks.data ( ), state.blocks.size ( ) );
+        blocks += state.blocks.size ( );
+    }
+    write_le64 ( offsets, offset );
+}
+
+LZ4BatchReader::LZ4BatchReader ( void const * data_, std::size_t const size_ ) {
+    char const * const data = static_cast<char const *> ( data_ );
+    if ( size_ < 8u or BATCH_MAGIC != read_le32 ( data ) )
+        throw std::runtime_error ( "Error during LZ4 batch decompression, corrupt container" );
+    m_count                        = read_le32 ( data + 4 );
+    std::uint64_t const table_size = 8u * ( std::uint64_t{ m_count } + 1u ) + 4u * std::uint64_t{ m_count };
+    if ( size_ - 8u < table_size )
+        throw std::runtime_error ( "Error during LZ4 batch decompression, corrupt container" );
+    m_table  = data + 8;
+    m_blocks = m_table + table_size;
+    // The offsets must rise from 0 to the size of the blocks, so that every block lies in the container.
+    std::uint64_t offset = read_le64 ( m_table );
+    if ( offset )
+        throw std::runtime_error ( "Error during LZ4 batch decompression, corrupt container" );
+    for ( std::size_t i = 1u; i <= m_count; ++i ) {
+        std::uint64_t const next = read_le64 ( m_table + 8u * i );
+        if ( next < offset )
+            throw std::runtime_error ( "Error during LZ4 batch decompression, corrupt container" );
+        offset = next;
+    }
+    if ( offset != size_ - 8u - table_size )
+        throw std::runtime_error ( "Error during LZ4 batch decompression, corrupt container" );
+}
+
+LZ4BatchReader::LZ4BatchReader ( void const * data_, std::size_t const size_, LZ4Dictionary const & dictionary_ ) :
+    LZ4BatchReader ( data_, size_ ) {
+    m_dictionary = &dictionary_;
+}
+
+std::size_t LZ4BatchReader::payloadSize ( std::size_t const index_ ) const {
+    if ( index_ >= m_count )
+        throw std::runtime_error ( "Error during LZ4 batch decompression, index out of range" );
+    return read_le32 ( m_table + 8u * ( m_count + 1u ) + 4u * index_ );
+}
+
+void LZ4BatchReader::read ( std::size_t const index_, void * dest_ ) const {
+    std::size_t const size         = payloadSize ( index_ );
+    std::uint64_t const offset     = read_le64 ( m_table + 8u * index_ );
+    std::uint64_t const block_size = read_le64 ( m_table + 8u * ( index_ + 1u ) ) - offset;
+    char const * const block       = m_blocks + offset;
+    if ( block_size == size ) {
+        if ( size )
+            std::memcpy ( dest_, block, size );
+        return;
+    }
+    // Compressed blocks are smaller than their payload.
+    if ( block_size > size or size > LZ4_MAX_INPUT_SIZE )
+        throw std::runtime_error ( "Error during LZ4 batch decompression, corrupt container" );
+    char * const dest = static_cast<char *> ( dest_ );
+    int const decompressed_size =
+        m_dictionary ? LZ4_decompress_safe_usingDict ( block, dest, static_cast<int> ( block_size ), static_cast<int> ( size ),
+                                                       m_dictionary->bytes, static_cast<int> ( m_dictionary->size ) )
+                     : LZ4_decompress_safe ( block, dest, static_cast<int> ( block_size ), static_cast<int> ( size ) );
+    if ( decompressed_size != static_cast<int> ( size ) )
+        throw std::runtime_error ( "Error during LZ4 batch decompression" );
+}
+
+std::vector<char> LZ4BatchReader::read ( std::size_t const index_ ) const {
+    std::vector<char> payload ( payloadSize ( index_ ) );
+    read ( index_, payload.data ( ) );
+    return payload;
+}
+
+std::vector<std::vector<char>> LZ4BatchReader::readAll ( LZ4ParallelOptions const & parallel_ ) const {
+    std::vector<std::vector<char>> payloads ( m_count );
+    std::size_t input_size = 0u;
+    for ( std::size_t i = 0u; i < m_count; ++i )
+        input_size += payloadSize ( i );
+    std::size_t const threads = batch_threads ( parallel_.threads, m_count, input_size );
+    run_batch ( threads > 1u ? &shared_batch_pool ( ) : nullptr, threads, m_count,
+                [ this, &payloads ] ( std::size_t, std::size_t const begin_, std::size_t const end_ ) {
+                    for ( std::size_t i = begin_; i < end_; ++i ) {
+                        payloads[ i ].resize ( payloadSize ( i ) );
+                        read ( i, payloads[ i ].data ( ) );
+                    }
+                } );
+    return payloads;
+}
+
+constexpr std::size_t FILE_ALIGNMENT = 4096u; // Of the buffers, offsets and sizes of the reads and writes of direct I/O.
+
+// A file with a queue of reads or writes in flight, each in a slot (< depth) of its own. On Linux, the requests are queued on an
+// io_uring, if the kernel has one (with IORING_OP_READ and IORING_OP_WRITE) and allows it. Otherwise they're done right away,
+// and wait ( ) just hands back the results in order.
+class LZ4QueuedFile final {
+    public:
+    LZ4QueuedFile ( std::filesystem::path const & path_, bool const write_, bool const direct_, unsigned int const depth_ ) :
+        m_write ( write_ ), m_requests ( depth_ ) {
+#ifdef _WIN32
+        DWORD const flags = direct_ ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN;
+        m_file            = CreateFileW ( path_.c_str ( ), write_ ? GENERIC_WRITE : GENERIC_READ, write_ ? 0 : FILE_SHARE_READ,
+                                          NULL, write_ ? CREATE_ALWAYS : OPEN_EXISTING, flags, NULL );
+        if ( INVALID_HANDLE_VALUE == m_file )
+            throw std::runtime_error ( "Failed to open file." );
+#else
+        int const flags = ( write_ ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY ) | O_CLOEXEC;
+#    ifdef O_DIRECT
+        m_file = ::open ( path_.c_str ( ), flags | ( direct_ ? O_DIRECT : 0 ), 0644 );
+#    else
+        m_file = ::open ( path_.c_str ( ), flags, 0644 );
+#    endif
+        if ( -1 == m_file )
+            throw std::runtime_error ( "Failed to open file." );
+#    ifdef __linux__
+        setup_ring ( depth_ );
+#    endif
+#endif
+    }
+    LZ4QueuedFile ( LZ4QueuedFile const & ) = delete;
+    ~LZ4QueuedFile ( ) {
+        // The kernel may still be writing into (reading from) the buffers of the requests in flight.
+        try {
+            while ( m_in_flight )
+                static_cast<void> ( wait ( ) );
+        }
+        catch ( ... ) {
+        }
+#ifdef __linux__
+        if ( -1 != m_ring ) {
+            ::munmap ( m_sqes, m_sqes_size );
+            if ( m_cq_ring != m_sq_ring )
+                ::munmap ( m_cq_ring, m_cq_ring_size );
+            ::munmap ( m_sq_ring, m_sq_ring_size );
+            ::close ( m_ring );
+        }
+#endif
+        close ( );
+    }
+
+    LZ4QueuedFile & operator= ( LZ4QueuedFile const & ) = delete;
+
+    [[nodiscard]] unsigned int inFlight ( ) const noexcept { return m_in_flight; }
+    // The bytes transferred by the last request of slot_ (as returned by wait ( )).
+    [[nodiscard]] std::size_t transferred ( unsigned int const slot_ ) const noexcept { return m_requests[ slot_ ].done; }
+
+    // Queues a read (write) of size_ bytes at offset_ into (from) data_, which must stay valid until the slot is returned by
+    // wait ( ). There can't be a request in flight in slot_.
+    void submit ( unsigned int const slot_, char * data_, std::size_t const size_, std::uint64_t const offset_ ) {
+        m_requests[ slot_ ] = { data_, size_, offset_, 0u };
+        ++m_in_flight;
+#ifdef __linux__
+        if ( -1 != m_ring ) {
+            unsigned int const tail  = *m_sq_tail;
+            unsigned int const index = tail & *m_sq_mask;
+            io_uring_sqe & sqe       = m_sqes[ index ];
+            std::memset ( &sqe, 0, sizeof ( sqe ) );
+            sqe.opcode          = m_write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe.fd              = m_file;
+            sqe.addr            = reinterpret_cast<std::uint64_t> ( data_ );
+            sqe.len             = static_cast<std::uint32_t> ( size_ );
+            sqe.off             = offset_;
+            sqe.user_data       = slot_;
+            m_sq_array[ index ] = index;
+            __atomic_store_n ( m_sq_tail, tail + 1u, __ATOMIC_RELEASE );
+            while ( ::syscall ( __NR_io_uring_enter, m_ring, 1u, 0u, 0u, nullptr, 0u ) < 0 )
+                if ( EINTR != errno ) {
+                    --m_in_flight;
+                    throw std::runtime_error ( "Error during LZ4 file I/O" );
+                }
+            return;
+        }
+#endif
+        m_completed.push_back ( slot_ );
+        finish ( slot_ );
+    }
+
+    // Waits for a request to complete, and returns its slot. A short read stops at the end of the file, a short write throws.
+    [[nodiscard]] unsigned int wait ( ) {
+        unsigned int slot;
+#ifdef __linux__
+        if ( -1 != m_ring ) {
+            unsigned int head = *m_cq_head;
+            while ( head == __atomic_load_n ( m_cq_tail, __ATOMIC_ACQUIRE ) )
+                if ( ::syscall ( __NR_io_uring_enter, m_ring, 0u, 1u, IORING_ENTER_GETEVENTS, nullptr, 0u ) < 0 and EINTR != errno )
+                    throw std::runtime_error ( "Error during LZ4 file I/O" );
+            io_uring_cqe const & cqe = m_cqes[ head & *m_cq_mask ];
+            slot                     = static_cast<unsigned int> ( cqe.user_data );
+            int const result         = cqe.res;
+            __atomic_store_n ( m_cq_head, head + 1u, __ATOMIC_RELEASE );
+            --m_in_flight;
+            if ( result < 0 )
+                throw std::runtime_error ( "Error during LZ4 file I/O" );
+            m_requests[ slot ].done = static_cast<std::size_t> ( result );
+            // The ring may do less than asked (e.g. when interrupted), the rest is done here.
+            if ( m_requests[ slot ].done < m_requests[ slot ].size )
+                finish ( slot );
+            return slot;
+        }
+#endif
+        slot = m_completed.front ( );
+        m_completed.pop_front ( );
+        --m_in_flight;
+        return slot;
+    }
+
+    [[nodiscard]] std::uint64_t size ( ) const {
+#ifdef _WIN32
+        LARGE_INTEGER file_size;
+        if ( not GetFileSizeEx ( m_file, &file_size ) )
+            throw std::runtime_error ( "Failed to get file size." );
+        return static_cast<std::uint64_t> ( file_size.QuadPart );
+#else
+        struct stat file_status;
+        if ( -1 == ::fstat ( m_file, &file_status ) )
+            throw std::runtime_error ( "Failed to get file size." );
+        return static_cast<std::uint64_t> ( file_status.st_size );
+#endif
+    }
+
+    // Cuts the padding of the last block of direct I/O.
+    void truncate ( std::uint64_t const size_ ) {
+#ifdef _WIN32
+        FILE_END_OF_FILE_INFO end_of_file;
+        end_of_file.EndOfFile.QuadPart = static_cast<LONGLONG> ( size_ );
+        if ( not SetFileInformationByHandle ( m_file, FileEndOfFileInfo, &end_of_file, sizeof ( end_of_file ) ) )
+#else
+        if ( -1 == ::ftruncate ( m_file, static_cast<off_t> ( size_ ) ) )
+#endif
+            throw std::runtime_error ( "Error during LZ4 file I/O" );
+    }
+
+    void close ( ) noexcept {
+#ifdef _WIN32
+        if ( INVALID_HANDLE_VALUE != m_file )
+            CloseHandle ( m_file );
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if ( -1 != m_file )
+            ::close ( m_file );
+        m_file = -1;
+#endif
+    }
+
+    private:
+    struct Request {
+        char * data;
+        std::size_t size;
+        std::uint64_t offset;
+        std::size_t done;
+    };
+
+    // Does what's left of the request in slot_, synchronously.
+    void finish ( unsigned int const slot_ ) {
+        Request & request = m_requests[ slot_ ];
+        while ( request.done < request.size ) {
+            std::size_t const size     = request.size - request.done;
+            std::uint64_t const offset = request.offset + request.done;
+#ifdef _WIN32
+            OVERLAPPED position{ };
+            position.Offset     = static_cast<DWORD> ( offset );
+            position.OffsetHigh = static_cast<DWORD> ( offset >> 32 );
+            DWORD done          = 0;
+            DWORD const chunk   = static_cast<DWORD> ( std::min<std::size_t> ( size, 1u << 30 ) );
+            BOOL const success  = m_write ? WriteFile ( m_file, request.data + request.done, chunk, &done, &position )
+                                         : ReadFile ( m_file, request.data + request.done, chunk, &done, &position );
+            long long const result = success or ERROR_HANDLE_EOF == GetLastError ( ) ? done : -1;
+#else
+            ssize_t const result = m_write ? ::pwrite ( m_file, request.data + request.done, size, static_cast<off_t> ( offset ) )
+                                           : ::pread ( m_file, request.data + request.done, size, static_cast<off_t> ( offset ) );
+            if ( result < 0 and EINTR == errno )
+                continue;
+#endif
+            if ( result < 0 or ( 0 == result and m_write ) )
+                throw std::runtime_error ( "Error during LZ4 file I/O" );
+            if ( 0 == result )
+                break; // The end of the file.
+            request.done += static_cast<std::size_t> ( result );
+        }
+    }
+
+#ifdef __linux__
+    void setup_ring ( unsigned int const depth_ ) {
+        io_uring_params params;
+        std::memset ( &params, 0, sizeof ( params ) );
+        int const ring = static_cast<int> ( ::syscall ( __NR_io_uring_setup, depth_, &params ) );
+        if ( ring < 0 )
+            return;
+        // IORING_OP_READ and IORING_OP_WRITE came with IORING_FEAT_RW_CUR_POS (5.6).
+        if ( not( params.features & IORING_FEAT_RW_CUR_POS ) ) {
+            ::close ( ring );
+            return;
+        }
+        m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof ( unsigned int );
+        m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof ( io_uring_cqe );
+        if ( params.features & IORING_FEAT_SINGLE_MMAP )
+            m_sq_ring_size = m_cq_ring_size = std::max ( m_sq_ring_size, m_cq_ring_size );
+        m_sq_ring = ::mmap ( nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING );
+        m_cq_ring = MAP_FAILED == m_sq_ring or ( params.features & IORING_FEAT_SINGLE_MMAP )
+                        ? m_sq_ring
+                        : ::mmap ( nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                                   IORING_OFF_CQ_RING );
+        m_sqes_size = params.sq_entries * sizeof ( io_uring_sqe );
+        void * const sqes =
+            MAP_FAILED == m_cq_ring
+                ? MAP_FAILED
+                : ::mmap ( nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES );
+        if ( MAP_FAILED == sqes ) {
+            if ( MAP_FAILED != m_cq_ring and m_cq_ring != m_sq_ring )
+                ::munmap ( m_cq_ring, m_cq_ring_size );
+            if ( MAP_FAILED != m_sq_ring )
+                ::munmap ( m_sq_ring, m_sq_ring_size );
+            ::close ( ring );
+            return;
+        }
+        char * const sq = static_cast<char *> ( m_sq_ring );
+        char * const cq = static_cast<char *> ( m_cq_ring );
+        m_sq_tail       = reinterpret_cast<unsigned int *> ( sq + params.sq_off.tail );
+        m_sq_mask       = reinterpret_cast<unsigned int *> ( sq + params.sq_off.ring_mask );
+        m_sq_array      = reinterpret_cast<unsigned int *> ( sq + params.sq_off.array );
+        m_cq_head       = reinterpret_cast<unsigned int *> ( cq + params.cq_off.head );
+        m_cq_tail       = reinterpret_cast<unsigned int *> ( cq + params.cq_off.tail );
+        m_cq_mask       = reinterpret_cast<unsigned int *> ( cq + params.cq_off.ring_mask );
+        m_cqes          = reinterpret_cast<io_uring_cqe *> ( cq + params.cq_off.cqes );
+        m_sqes          = static_cast<io_uring_sqe *> ( sqes );
+        m_ring          = ring;
+    }
+#endif
+
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+    int m_file = -1;
+#endif
+#ifdef __linux__
+    int m_ring       = -1; // -1 == synchronous.
+    void * m_sq_ring = nullptr;
+    void * m_cq_ring = nullptr;
+    std::size_t m_sq_ring_size = 0u, m_cq_ring_size = 0u, m_sqes_size = 0u;
+    unsigned int *m_sq_tail = nullptr, *m_sq_mask = nullptr, *m_sq_array = nullptr;
+    unsigned int *m_cq_head = nullptr, *m_cq_tail = nullptr, *m_cq_mask = nullptr;
+    io_uring_sqe * m_sqes = nullptr;
+    io_uring_cqe * m_cqes = nullptr;
+#endif
+    bool m_write;
+    std::vector<Request> m_requests; // Per slot.
+    std::deque<unsigned int> m_completed; // The slots of the synchronous requests, in order.
+    unsigned int m_in_flight = 0u;
+};
+
+// The blocks of LZ4FileOStreamBuf and LZ4FileIStreamBuf, in one allocation aligned for direct I/O.
+class LZ4FileBlocks final {
+    public:
+    LZ4FileBlocks ( LZ4FileOptions const & options_ ) :
+        m_block_size ( ( std::max<std::size_t> ( options_.block_size, 1u ) + FILE_ALIGNMENT - 1u ) / FILE_ALIGNMENT *
+                       FILE_ALIGNMENT ),
+        m_count ( std::max ( options_.queue_depth, 1u ) ),
+        m_memory ( static_cast<char *> ( ::operator new ( m_block_size * m_count, std::align_val_t ( FILE_ALIGNMENT ) ) ) ) {}
+    LZ4FileBlocks ( LZ4FileBlocks const & ) = delete;
+    ~LZ4FileBlocks ( ) { ::operator delete ( m_memory, std::align_val_t ( FILE_ALIGNMENT ) ); }
+
+    LZ4FileBlocks & operator= ( LZ4FileBlocks const & ) = delete;
+
+    [[nodiscard]] char * operator[] ( unsigned int const slot_ ) const noexcept { return m_memory + slot_ * m_block_size; }
+    [[nodiscard]] std::size_t blockSize ( ) const noexcept { return m_block_size; }
+    [[nodiscard]] unsigned int count ( ) const noexcept { return m_count; }
+
+    private:
+    std::size_t m_block_size;
+    unsigned int m_count;
+    char * m_memory;
+};
+
+class LZ4FileOStreamBuf final : public std::streambuf {
+    public:
+    LZ4FileOStreamBuf ( std::filesystem::path const & path_, LZ4FileOptions const & options_ ) :
+        m_blocks ( options_ ), m_file ( path_, true, options_.direct, m_blocks.count ( ) ), m_direct ( options_.direct ) {
+        for ( unsigned int slot = m_blocks.count ( ); slot-- > 1u; )
+            m_free.push_back ( slot );
+        setp ( m_blocks[ 0u ], m_blocks[ 0u ] + m_blocks.blockSize ( ) );
+    }
+    LZ4FileOStreamBuf ( LZ4FileOStreamBuf const & ) = delete;
+    virtual ~LZ4FileOStreamBuf ( ) {
+        // The I/O errors of the last writes (ENOSPC, EIO) are reported by LZ4FileOStream::close ( ) only.
+        try {
+            close ( );
+        }
+        catch ( ... ) {
+        }
+    }
+
+    LZ4FileOStreamBuf & operator= ( LZ4FileOStreamBuf const & ) = delete;
+
+    void close ( ) {
+        if ( m_is_open ) {
+            m_is_open              = false;
+            std::size_t const size = write_partial ( );
+            if ( m_direct and size % FILE_ALIGNMENT )
+                m_file.truncate ( m_offset + size );
+            m_file.close ( );
+            setp ( nullptr, nullptr );
+        }
+    }
+
+    protected:
+    [[nodiscard]] virtual int_type overflow ( int_type ch ) override {
+        if ( not m_is_open )
+            return traits_type::eof ( );
+        if ( pptr ( ) == epptr ( ) ) {
+            m_file.submit ( m_slot, pbase ( ), m_blocks.blockSize ( ), m_offset );
+            m_offset += m_blocks.blockSize ( );
+            m_synced = 0u;
+            if ( m_free.empty ( ) )
+                m_free.push_back ( m_file.wait ( ) );
+            m_slot = m_free.back ( );
+            m_free.pop_back ( );
+            setp ( m_blocks[ m_slot ], m_blocks[ m_slot ] + m_blocks.blockSize ( ) );
+        }
+        if ( traits_type::eq_int_type ( ch, traits_type::eof ( ) ) )
+            return traits_type::not_eof ( ch );
+        *pptr ( ) = traits_type::to_char_type ( ch );
+        pbump ( 1 );
+        return ch;
+    }
+
+    [[nodiscard]] virtual std::streamsize xsputn ( char_type const * s_, std::streamsize n_ ) override {
+        std::streamsize written = 0;
+        while ( written < n_ ) {
+            if ( pptr ( ) == epptr ( ) and traits_type::eq_int_type ( overflow ( traits_type::eof ( ) ), traits_type::eof ( ) ) )
+                break;
+            std::streamsize const size = std::min<std::streamsize> ( n_ - written, epptr ( ) - pptr ( ) );
+            std::memcpy ( pptr ( ), s_ + written, static_cast<std::size_t> ( size ) );
+            pbump ( static_cast<int> ( size ) );
+            written += size;
+        }
+        return written;
+    }
+
+    // Writes the partly filled block at its offset (padded with zeros for direct I/O), the block is written again as it
+    // fills, the padding is cut by close ( ).
+    [[nodiscard]] virtual int sync ( ) override {
+        if ( m_is_open )
+            static_cast<void> ( write_partial ( ) );
+        return 0;
+    }
+
+    private:
+    // Writes what sync ( ) didn't write yet of the partly filled block (from the aligned offset before it for direct I/O, up
+    // to the aligned offset after it), and waits for all writes. Returns the size of the data in the block.
+    std::size_t write_partial ( ) {
+        std::size_t const size = pptr ( ) - pbase ( );
+        if ( size != m_synced ) {
+            std::size_t const begin = m_direct ? m_synced / FILE_ALIGNMENT * FILE_ALIGNMENT : m_synced;
+            std::size_t const end   = m_direct ? ( size + FILE_ALIGNMENT - 1u ) / FILE_ALIGNMENT * FILE_ALIGNMENT : size;
+            std::memset ( pptr ( ), 0, end - size );
+            m_file.submit ( m_slot, pbase ( ) + begin, end - begin, m_offset + begin );
+        }
+        drain ( );
+        m_synced = size;
+        return size;
+    }
+
+    void drain ( ) {
+        while ( m_file.inFlight ( ) ) {
+            unsigned int const slot = m_file.wait ( );
+            if ( slot != m_slot ) // The write area, written by write_partial ( ), stays in use.
+                m_free.push_back ( slot );
+        }
+    }
+
+    LZ4FileBlocks m_blocks; // Outlives the file, which waits for the writes in flight.
+    LZ4QueuedFile m_file;
+    std::vector<unsigned int> m_free;
+    unsigned int m_slot    = 0u; // Of the write area.
+    std::uint64_t m_offset = 0u; // Of the write area in the file.
+    std::size_t m_synced   = 0u; // The bytes of the write area written by sync ( ).
+    bool m_direct, m_is_open = true;
+};
+
+class LZ4FileIStreamBuf final : public std::streambuf {
+    public:
+    LZ4FileIStreamBuf ( std::filesystem::path const & path_, LZ4FileOptions const & options_ ) :
+        m_blocks ( options_ ), m_file ( path_, false, options_.direct, m_blocks.count ( ) ), m_file_size ( m_file.size ( ) ),
+        m_offsets ( m_blocks.count ( ) ) {
+        start ( 0u );
+    }
+
+    protected:
+    [[nodiscard]] virtual int_type underflow ( ) override {
+        if ( gptr ( ) < egptr ( ) )
+            return traits_type::to_int_type ( *gptr ( ) );
+        // The read area is used up, its block is read again, further on.
+        if ( eback ( ) ) {
+            m_base += egptr ( ) - eback ( );
+            submit ( m_slot );
+            setg ( nullptr, nullptr, nullptr );
+        }
+        if ( m_queue.empty ( ) )
+            return traits_type::eof ( );
+        m_slot = m_queue.front ( );
+        m_queue.pop_front ( );
+        while ( not m_done[ m_slot ] )
+            m_done[ m_file.wait ( ) ] = true;
+        std::size_t const size = m_file.transferred ( m_slot );
+        std::size_t const skip = std::min<std::size_t> ( m_skip, size );
+        m_base                 = m_offsets[ m_slot ];
+        m_skip                 = 0u;
+        setg ( m_blocks[ m_slot ], m_blocks[ m_slot ] + skip, m_blocks[ m_slot ] + size );
+        if ( gptr ( ) == egptr ( ) )
+            return traits_type::eof ( );
+        return traits_type::to_int_type ( *gptr ( ) );
+    }
+
+    [[nodiscard]] virtual pos_type seekoff ( off_type off_, std::ios_base::seekdir dir_,
+                                             std::ios_base::openmode which_ = std::ios_base::in ) override {
+        off_type const position = static_cast<off_type> ( m_base + m_skip ) + ( gptr ( ) - eback ( ) );
+        off_type const target   = off_ + ( std::ios_base::beg == dir_ ? 0 : std::ios_base::cur == dir_ ? position
+                                                                                                       : off_type ( m_file_size ) );
+        if ( not( which_ & std::ios_base::in ) or target < 0 or target > off_type ( m_file_size ) )
+            return pos_type ( off_type ( -1 ) );
+        if ( target != position ) {
+            // Within the read area, or a fresh start.
+            if ( eback ( ) and target >= off_type ( m_base ) and target <= off_type ( m_base ) + ( egptr ( ) - eback ( ) ) )
+                setg ( eback ( ), eback ( ) + ( target - off_type ( m_base ) ), egptr ( ) );
+            else
+                start ( static_cast<std::uint64_t> ( target ) );
+        }
+        return pos_type ( target );
+    }
+
+    [[nodiscard]] virtual pos_type seekpos ( pos_type pos_, std::ios_base::openmode which_ = std::ios_base::in ) override {
+        return seekoff ( off_type ( pos_ ), std::ios_base::beg, which_ );
+    }
+
+    private:
+    void submit ( unsigned int const slot_ ) {
+        if ( m_next < m_file_size ) {
+            m_offsets[ slot_ ] = m_next;
+            m_done[ slot_ ]    = false;
+            m_file.submit ( slot_, m_blocks[ slot_ ], m_blocks.blockSize ( ), m_next );
+            m_queue.push_back ( slot_ );
+            m_next += m_blocks.blockSize ( );
+        }
+    }
+
+    // Drops the blocks read ahead, and reads ahead from position_.
+    void start ( std::uint64_t const position_ ) {
+        while ( m_file.inFlight ( ) )
+            static_cast<void> ( m_file.wait ( ) );
+        m_queue.clear ( );
+        m_done.assign ( m_blocks.count ( ), false );
+        setg ( nullptr, nullptr, nullptr );
+        // Whole blocks from an aligned offset, the read area starts m_skip bytes into the first.
+        m_next = position_ / m_blocks.blockSize ( ) * m_blocks.blockSize ( );
+        m_base = m_next;
+        m_skip = static_cast<std::size_t> ( position_ - m_next );
+        for ( unsigned int slot = 0u; slot < m_blocks.count ( ); ++slot )
+            submit ( slot );
+    }
+
+    LZ4FileBlocks m_blocks; // Outlives the file, which waits for the reads in flight.
+    LZ4QueuedFile m_file;
+    std::uint64_t m_file_size;
+    std::vector<std::uint64_t> m_offsets; // Of the blocks of the slots in the file.
+    std::vector<bool> m_done;             // Per slot, read.
+    std::deque<unsigned int> m_queue;     // The slots read ahead, in file order.
+    unsigned int m_slot  = 0u;            // Of the read area.
+    std::uint64_t m_base = 0u;            // Of eback ( ) in the file.
+    std::uint64_t m_next = 0u;            // Of the next block to read.
+    std::size_t m_skip   = 0u;            // Into the next block, after a seek.
+};
+
+LZ4FileOStream::LZ4FileOStream ( std::filesystem::path const & path_, LZ4FileOptions const & options_ ) :
+    std::ostream ( new LZ4FileOStreamBuf ( path_, options_ ) ) {}
+LZ4FileOStream::~LZ4FileOStream ( ) { delete rdbuf ( ); }
+void LZ4FileOStream::close ( ) { dynamic_cast<LZ4FileOStreamBuf *> ( rdbuf ( ) )->close ( ); }
+
+LZ4FileIStream::LZ4FileIStream ( std::filesystem::path const & path_, LZ4FileOptions const & options_ ) :
+    std::istream ( new LZ4FileIStreamBuf ( path_, options_ ) ) {}
+LZ4FileIStream::~LZ4FileIStream ( ) { delete rdbuf ( ); }
+
+// The frames of LZ4OutputStream keep the 64 KB blocks of LZ4F_INIT_PREFERENCES, which lz4stream.hpp wrote.
+LZ4OutputStream::LZ4OutputStream ( std::ostream & sink, const int compression_level_ ) :
+    CompressedOStream<LZ4FrameCodec> ( sink, level_options ( compression_level_, LZ4F_max64KB ) ) {}
+
+LZ4InputStream::LZ4InputStream ( std::istream & source ) :
+    CompressedIStream<LZ4FrameCodec> ( source, buffer_options ( 64u * 1024u ) ) {}
 
 } // namespace sf
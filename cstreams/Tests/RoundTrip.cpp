@@ -0,0 +1,831 @@
+
+// MIT License
+//
+// Copyright (c) 2019 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Round-trips data through the LZ4 streams of LZ4Stream.h, in all their modes, and checks that it comes back unchanged: the
+// dictionaries (frames written with different dictionaries, read back through an LZ4DictionaryRegistry by the ID in their
+// headers), and the paths on the static-only LZ4 API (seekable, parallel, asynchronous, compact and read-ahead streams,
+// incompressible blocks, messages, snapshots, batches, and the files of LZ4FileOStream and LZ4FileIStream, with and
+// without direct I/O). The same for the zstd streams of ZstdStream.h, and, if cereal is on the include path, for the archives
+// of CompressedArchive.h, plain and chunked, and in both directions against cereal::BinaryOutputArchive and
+// cereal::BinaryInputArchive over the streams. On Linux:
+//
+//     g++ -std=c++17 -O2 -pthread -I cstreams [-I cereal/include] cstreams/Tests/RoundTrip.cpp cstreams/LZ4Stream.cpp
+//         cstreams/ZstdStream.cpp -l:liblz4.a -lzstd -o lz4_round_trip
+//     ./lz4_round_trip
+//
+// LZ4 must be linked statically, as for the benchmark. On Windows, build the RoundTrip project of cstreams.sln. Prints a line
+// per check, and exits with EXIT_FAILURE if any fails. The files are written to the temporary directory, and removed after.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "Extensions/LZ4Stream.h"
+#include "Extensions/ZstdStream.h"
+
+#if __has_include( <cereal/archives/binary.hpp>)
+#    include <cereal/archives/binary.hpp>
+#    include <cereal/cereal.hpp>
+#    include <cereal/types/array.hpp>
+#    include "Extensions/CompressedArchive.h"
+#    define ROUND_TRIP_CEREAL 1
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Thrown by CHECK, caught by run ( ), which reports the failed condition.
+struct CheckFailure {
+    char const * condition;
+    int line;
+};
+
+#define CHECK( condition )                                                                                                         \
+    do {                                                                                                                           \
+        if ( not( condition ) )                                                                                                    \
+            throw CheckFailure{ #condition, __LINE__ };                                                                            \
+    } while ( false )
+
+// Log-like lines of a few templates and fields drawn from a fixed seed, compressible, and with dictionary material in common
+// between calls of the same kind.
+[[nodiscard]] std::string make_text ( std::size_t const size_, unsigned int const seed_, int const kind_ = 0 ) {
+    std::mt19937 rng ( seed_ );
+    std::string text;
+    text.reserve ( size_ + 256u );
+    char line[ 256 ];
+    while ( text.size ( ) < size_ ) {
+        unsigned int const id    = static_cast<unsigned int> ( rng ( ) % 100000u );
+        unsigned int const town  = static_cast<unsigned int> ( rng ( ) % 1000u );
+        unsigned int const value = static_cast<unsigned int> ( rng ( ) % 1000u );
+        int const length =
+            kind_ ? std::snprintf ( line, sizeof ( line ), "{\"user\":%u,\"name\":\"user%u\",\"active\":%s}\n", id, town,
+                                    value % 2u ? "true" : "false" )
+                  : std::snprintf ( line, sizeof ( line ), "<row id='%u' city='town%u' value='%u'/>\n", id, town, value );
+        text.append ( line, static_cast<std::size_t> ( length ) );
+    }
+    text.resize ( size_ );
+    return text;
+}
+
+// Uniformly random bytes, incompressible.
+[[nodiscard]] std::string make_random ( std::size_t const size_, unsigned int const seed_ ) {
+    std::mt19937 rng ( seed_ );
+    std::string data ( size_, '\0' );
+    for ( char & c : data )
+        c = static_cast<char> ( rng ( ) );
+    return data;
+}
+
+[[nodiscard]] std::string read_all ( std::istream & stream_ ) {
+    return std::string ( std::istreambuf_iterator<char> ( stream_ ), std::istreambuf_iterator<char> ( ) );
+}
+
+// A path in the temporary directory, removed on destruction.
+struct TemporaryFile {
+    explicit TemporaryFile ( char const * name_ ) : path ( fs::temp_directory_path ( ) / name_ ) {}
+    ~TemporaryFile ( ) {
+        std::error_code error;
+        fs::remove ( path, error );
+    }
+
+    fs::path path;
+};
+
+// Whether writing throws (as the writers do on settings they can't honour).
+template<typename Write>
+[[nodiscard]] bool throws ( Write && write_ ) {
+    try {
+        write_ ( );
+    }
+    catch ( std::exception const & ) {
+        return true;
+    }
+    return false;
+}
+
+void check_plain ( ) {
+    std::string const data = make_text ( 1u << 20, 1u );
+    for ( int const level : { sf::LZ4OStream::BEST_SPEED, sf::LZ4OStream::BEST_COMPRESSION } ) {
+        std::stringstream stream;
+        {
+            sf::LZ4OStream lz4 ( stream, level );
+            lz4 << data;
+            lz4.close ( );
+        }
+        CHECK( stream.str ( ).size ( ) < data.size ( ) );
+        sf::LZ4IStream lz4 ( stream );
+        CHECK( read_all ( lz4 ) == data );
+    }
+}
+
+// Frames written with two trained dictionaries and without one, concatenated, are read back through a registry, each with
+// the dictionary of the ID in its header.
+void check_dictionaries ( ) {
+    sf::LZ4DictionaryTrainer trainer_a, trainer_b;
+    for ( unsigned int i = 0u; i < 1000u; ++i ) {
+        std::string const a = make_text ( 2048u, 100u + i, 0 ), b = make_text ( 2048u, 5000u + i, 1 );
+        trainer_a.addSample ( a.data ( ), a.size ( ) );
+        trainer_b.addSample ( b.data ( ), b.size ( ) );
+    }
+    sf::LZ4Dictionary const dictionary_a = trainer_a.train ( );
+    sf::LZ4Dictionary dictionary_b       = trainer_b.train ( 16u * 1024u );
+    unsigned int const id_b              = dictionary_b.dictID ( );
+    CHECK( dictionary_a.dictID ( ) and id_b and dictionary_a.dictID ( ) != id_b );
+
+    std::string const a = make_text ( 100'000u, 2u, 0 ), b = make_text ( 100'000u, 3u, 1 ), c = "without a dictionary";
+    std::stringstream stream;
+    {
+        sf::LZ4OStream lz4 ( stream, dictionary_a );
+        lz4 << a;
+        lz4.close ( );
+    }
+    {
+        sf::LZ4OStream lz4 ( stream, dictionary_b, sf::LZ4OStream::BEST_COMPRESSION );
+        lz4 << b;
+        lz4.close ( );
+    }
+    {
+        sf::LZ4OStream lz4 ( stream );
+        lz4 << c;
+        lz4.close ( );
+    }
+    std::string const frames = stream.str ( );
+
+    sf::LZ4DictionaryRegistry registry;
+    registry.add ( dictionary_a );
+    registry.add ( std::move ( dictionary_b ) );
+    CHECK( registry.find ( dictionary_a.dictID ( ) ) == &dictionary_a );
+    CHECK( registry.find ( id_b ) and registry.find ( id_b )->dictID ( ) == id_b );
+    CHECK( not registry.find ( dictionary_a.dictID ( ) + id_b ) );
+
+    // The dictionary IDs, as recorded in the frame headers.
+    std::istringstream scanned ( frames );
+    std::vector<sf::LZ4FrameInfo> const infos = sf::LZ4FrameScanner::list ( scanned );
+    CHECK( 3u == infos.size ( ) );
+    unsigned int const expected_ids[] = { dictionary_a.dictID ( ), id_b, 0u };
+    for ( std::size_t i = 0u; i < infos.size ( ); ++i ) {
+        unsigned char const * const header = reinterpret_cast<unsigned char const *> ( frames.data ( ) + infos[ i ].offset );
+        bool const has_id                  = header[ 4 ] & 0x01u; // FLG, the dictionary ID flag.
+        unsigned int id                    = 0u;
+        if ( has_id ) {
+            std::size_t const position = 6u + ( header[ 4 ] & 0x08u ? 8u : 0u ); // After the content size, if any.
+            for ( int byte = 3; byte >= 0; --byte )
+                id = id << 8 | header[ position + static_cast<std::size_t> ( byte ) ];
+        }
+        CHECK( id == expected_ids[ i ] );
+    }
+
+    for ( int mode = 0; mode < 3; ++mode ) {
+        sf::LZ4Options options;
+        options.buffer_size = 2 == mode ? 64u : 1000u;
+        options.read_ahead  = 1 == mode ? 3u : 0u;
+        options.compact     = 2 == mode;
+        std::istringstream source ( frames );
+        sf::LZ4IStream lz4 ( source, registry, options );
+        CHECK( read_all ( lz4 ) == a + b + c );
+    }
+
+    // An unknown ID throws.
+    sf::LZ4DictionaryRegistry empty;
+    std::istringstream source ( frames );
+    sf::LZ4IStream lz4 ( source, empty );
+    lz4.exceptions ( std::ios::badbit );
+    CHECK( throws ( [ & ] { (void) read_all ( lz4 ); } ) );
+}
+
+// Seeks to random positions of a seekable stream, from the block index.
+void check_seekable ( ) {
+    std::string const data = make_text ( 1u << 20, 4u );
+    std::stringstream stream;
+    {
+        sf::LZ4Options options;
+        options.block_size = LZ4F_max64KB;
+        sf::LZ4SeekableOStream lz4 ( stream, options );
+        lz4 << data;
+        lz4.close ( );
+    }
+    sf::LZ4IStream lz4 ( stream );
+    std::mt19937 rng ( 4u );
+    char bytes[ 100 ];
+    for ( int i = 0; i < 200; ++i ) {
+        std::size_t const position = rng ( ) % ( data.size ( ) - sizeof ( bytes ) );
+        lz4.seekg ( static_cast<std::streamoff> ( position ) );
+        lz4.read ( bytes, sizeof ( bytes ) );
+        CHECK( lz4 and 0 == data.compare ( position, sizeof ( bytes ), bytes, sizeof ( bytes ) ) );
+    }
+    lz4.seekg ( 0 );
+    CHECK( read_all ( lz4 ) == data );
+
+    // A seeking reader can't verify a content checksum.
+    sf::LZ4Options options;
+    options.content_checksum = true;
+    std::ostringstream sink;
+    CHECK( throws ( [ & ] { sf::LZ4SeekableOStream lz4 ( sink, options ); } ) );
+}
+
+void check_parallel ( ) {
+    std::string const data = make_text ( 3u << 20, 5u );
+    sf::LZ4ParallelOptions parallel;
+    parallel.threads       = 3u;
+    parallel.max_in_flight = 1u << 20;
+    std::stringstream stream;
+    {
+        sf::LZ4Options options;
+        options.block_size = LZ4F_max64KB;
+        sf::LZ4OStream lz4 ( stream, options, parallel );
+        lz4 << data;
+        lz4.close ( );
+    }
+    std::string const compressed = stream.str ( );
+    {
+        std::istringstream source ( compressed );
+        sf::LZ4IStream lz4 ( source, parallel );
+        CHECK( read_all ( lz4 ) == data );
+    }
+    std::istringstream source ( compressed );
+    sf::LZ4IStream lz4 ( source );
+    CHECK( read_all ( lz4 ) == data );
+}
+
+// The asynchronous writer, the compact streams and the read-ahead reader, written in calls of varying sizes.
+void check_buffering ( ) {
+    std::string const data = make_text ( 2u << 20, 6u );
+    for ( int mode = 0; mode < 3; ++mode ) {
+        sf::LZ4Options options;
+        options.block_size    = LZ4F_max64KB;
+        options.async_buffers = 0 == mode ? 3u : 0u;
+        options.compact       = 1 == mode;
+        options.read_ahead    = 2 == mode ? 4u : 0u;
+        options.buffer_size   = 1 == mode ? 1000u : 0u;
+        std::stringstream stream;
+        {
+            sf::LZ4OStream lz4 ( stream, options );
+            std::mt19937 rng ( 6u );
+            for ( std::size_t position = 0u; position < data.size ( ); ) {
+                std::size_t const size = std::min<std::size_t> ( 1u + rng ( ) % 200'000u, data.size ( ) - position );
+                lz4.write ( data.data ( ) + position, static_cast<std::streamsize> ( size ) );
+                position += size;
+                if ( 0u == rng ( ) % 8u )
+                    lz4.flush ( );
+            }
+            lz4.close ( );
+        }
+        sf::LZ4IStream lz4 ( stream, options );
+        CHECK( read_all ( lz4 ) == data );
+    }
+}
+
+// Incompressible blocks are stored as is, with independent blocks; a writer of linked blocks throws.
+void check_incompressible ( ) {
+    std::string const data = make_random ( 1u << 20, 7u ) + make_text ( 1u << 20, 7u );
+    sf::LZ4Options options;
+    options.block_size           = LZ4F_max64KB;
+    options.block_mode           = LZ4F_blockIndependent;
+    options.compression_level    = 9;
+    options.incompressible_ratio = 0.9;
+    std::stringstream stream;
+    {
+        sf::LZ4OStream lz4 ( stream, options );
+        lz4 << data;
+        lz4.close ( );
+    }
+    CHECK( stream.str ( ).size ( ) < data.size ( ) );
+    sf::LZ4IStream lz4 ( stream );
+    CHECK( read_all ( lz4 ) == data );
+
+    options.block_mode = LZ4F_blockLinked;
+    std::ostringstream sink;
+    CHECK( throws ( [ & ] { sf::LZ4OStream lz4 ( sink, options ); } ) );
+}
+
+// One-shot frames, with the content size, and a frame of LZ4OStream (without one) loaded by LZ4Frame.
+void check_frames ( ) {
+    std::vector<std::uint32_t> values ( 500'000u );
+    for ( std::size_t i = 0u; i < values.size ( ); ++i )
+        values[ i ] = static_cast<std::uint32_t> ( i / 7u );
+    std::stringstream stream;
+    sf::LZ4Frame::saveSkippable ( stream, "skipped", 7u, 3u );
+    sf::LZ4Frame::save ( stream, values, 9 );
+    {
+        sf::LZ4OStream lz4 ( stream );
+        lz4.write ( reinterpret_cast<char const *> ( values.data ( ) ),
+                    static_cast<std::streamsize> ( values.size ( ) * sizeof ( std::uint32_t ) ) );
+        lz4.close ( );
+    }
+    std::vector<std::uint32_t> loaded;
+    sf::LZ4Frame::load ( stream, loaded );
+    CHECK( loaded == values );
+    loaded.clear ( );
+    sf::LZ4Frame::load ( stream, loaded );
+    CHECK( loaded == values );
+
+    // The wrong type throws.
+    std::stringstream small;
+    sf::LZ4Frame::save ( small, std::uint64_t{ 42u } );
+    std::uint32_t wrong;
+    CHECK( throws ( [ & ] { sf::LZ4Frame::load ( small, wrong ); } ) );
+}
+
+void check_messages ( ) {
+    std::vector<std::string> messages;
+    for ( unsigned int i = 0u; i < 5000u; ++i )
+        messages.push_back ( make_text ( 1u + i % 900u, 8u + i % 50u ) );
+    std::stringstream stream;
+    {
+        sf::LZ4MessageWriter writer ( stream, 1024u );
+        for ( std::string const & message : messages )
+            writer.write ( message.data ( ), message.size ( ) );
+        std::string const too_large ( 2048u, 'x' );
+        CHECK( throws ( [ & ] { writer.write ( too_large.data ( ), too_large.size ( ) ); } ) );
+    }
+    sf::LZ4MessageReader reader ( stream );
+    std::size_t count = 0u, size;
+    for ( char const * message = reader.read ( size ); message; message = reader.read ( size ), ++count )
+        CHECK( count < messages.size ( ) and std::string ( message, size ) == messages[ count ] );
+    CHECK( count == messages.size ( ) );
+}
+
+// Snapshots of a mutating state, read in full, and from the last base on.
+void check_snapshots ( ) {
+    std::mt19937 rng ( 9u );
+    std::string state = make_random ( 300'000u, 9u );
+    std::vector<std::string> snapshots;
+    std::size_t total = 0u;
+    std::stringstream stream;
+    {
+        sf::LZ4SnapshotWriter writer ( stream, 0, 4u );
+        for ( int i = 0; i < 14; ++i ) {
+            for ( int j = 0; j < 2000; ++j )
+                state[ rng ( ) % state.size ( ) ] = static_cast<char> ( rng ( ) );
+            if ( 6 == i )
+                state.insert ( 1000u, 100u, 'x' );
+            if ( 9 == i )
+                state.resize ( state.size ( ) - 12'345u );
+            snapshots.push_back ( state );
+            total += state.size ( );
+            writer.write ( state.data ( ), state.size ( ) );
+        }
+    }
+    std::string const compressed = stream.str ( );
+    CHECK( compressed.size ( ) < total / 2u ); // Only the 4 bases are incompressible.
+    {
+        std::istringstream source ( compressed );
+        sf::LZ4SnapshotReader reader ( source );
+        std::size_t count = 0u, size;
+        for ( char const * snapshot = reader.read ( size ); snapshot; snapshot = reader.read ( size ), ++count )
+            CHECK( count < snapshots.size ( ) and std::string ( snapshot, size ) == snapshots[ count ] and
+                   reader.isBase ( ) == ( 0u == count % 4u ) );
+        CHECK( count == snapshots.size ( ) );
+    }
+    std::istringstream source ( compressed );
+    sf::LZ4SnapshotReader reader ( source );
+    CHECK( reader.seekLastBase ( ) );
+    std::size_t count = 12u, size; // The last base is snapshot 12.
+    for ( char const * snapshot = reader.read ( size ); snapshot; snapshot = reader.read ( size ), ++count )
+        CHECK( count < snapshots.size ( ) and std::string ( snapshot, size ) == snapshots[ count ] );
+    CHECK( count == snapshots.size ( ) );
+}
+
+// Batches of small payloads, as frames and packed, without and with a dictionary, on one and more threads.
+void check_batches ( ) {
+    std::vector<std::string> strings;
+    for ( unsigned int i = 0u; i < 20'000u; ++i )
+        strings.push_back ( i % 100u ? make_text ( i % 700u, 10u + i, 1 ) : make_random ( 300u, i ) );
+    std::vector<sf::LZ4Payload> payloads;
+    for ( std::string const & string : strings )
+        payloads.push_back ( { string.data ( ), string.size ( ) } );
+    sf::LZ4DictionaryTrainer trainer;
+    for ( unsigned int i = 0u; i < 1000u; ++i ) {
+        std::string const sample = make_text ( 700u, 50'000u + i, 1 );
+        trainer.addSample ( sample.data ( ), sample.size ( ) );
+    }
+    sf::LZ4Dictionary const dictionary = trainer.train ( 16u * 1024u );
+
+    for ( unsigned int const threads : { 1u, 3u } ) {
+        sf::LZ4ParallelOptions parallel;
+        parallel.threads = threads;
+        for ( bool const with_dictionary : { false, true } ) {
+            sf::LZ4BatchCompressor compressor = with_dictionary ? sf::LZ4BatchCompressor ( dictionary, 0, parallel )
+                                                                : sf::LZ4BatchCompressor ( 0, parallel );
+            std::vector<char> container;
+            compressor.pack ( payloads.data ( ), payloads.size ( ), container );
+            sf::LZ4BatchReader const reader = with_dictionary
+                                                  ? sf::LZ4BatchReader ( container.data ( ), container.size ( ), dictionary )
+                                                  : sf::LZ4BatchReader ( container.data ( ), container.size ( ) );
+            CHECK( reader.size ( ) == strings.size ( ) );
+            for ( std::size_t i = 0u; i < strings.size ( ); i += 997u ) {
+                std::vector<char> const payload = reader.read ( i );
+                CHECK( reader.payloadSize ( i ) == strings[ i ].size ( ) and
+                       std::string ( payload.begin ( ), payload.end ( ) ) == strings[ i ] );
+            }
+            std::vector<std::vector<char>> const all = reader.readAll ( parallel );
+            CHECK( all.size ( ) == strings.size ( ) );
+            for ( std::size_t i = 0u; i < strings.size ( ); ++i )
+                CHECK( std::string ( all[ i ].begin ( ), all[ i ].end ( ) ) == strings[ i ] );
+
+            std::vector<std::vector<char>> const frames = compressor.compress ( payloads.data ( ), payloads.size ( ) );
+            CHECK( frames.size ( ) == strings.size ( ) );
+            for ( std::size_t i = 0u; i < strings.size ( ); i += 97u ) {
+                std::istringstream source ( std::string ( frames[ i ].begin ( ), frames[ i ].end ( ) ) );
+                std::vector<char> loaded;
+                if ( with_dictionary ) {
+                    sf::LZ4IStream lz4 ( source, dictionary );
+                    loaded.assign ( std::istreambuf_iterator<char> ( lz4 ), std::istreambuf_iterator<char> ( ) );
+                }
+                else
+                    sf::LZ4Frame::load ( source, loaded );
+                CHECK( std::string ( loaded.begin ( ), loaded.end ( ) ) == strings[ i ] );
+            }
+        }
+    }
+}
+
+// Compressed streams on the files of LZ4FileOStream and LZ4FileIStream, with and without direct I/O, and the raw files:
+// random reads, and the partly filled block written on flush.
+void check_files ( ) {
+    std::string const data = make_text ( 3'000'000u, 11u );
+    TemporaryFile const compressed ( "lz4_round_trip.lz4" ), raw ( "lz4_round_trip.raw" );
+    for ( bool const direct : { false, true } ) {
+        sf::LZ4FileOptions options;
+        options.block_size  = 100'000u; // Rounded up to 102400.
+        options.queue_depth = 3u;
+        options.direct      = direct;
+        {
+            sf::LZ4FileOStream file ( compressed.path, options );
+            sf::LZ4OStream lz4 ( file );
+            lz4 << data;
+            lz4.close ( );
+            file.close ( );
+        }
+        {
+            sf::LZ4FileIStream file ( compressed.path, options );
+            sf::LZ4IStream lz4 ( file );
+            CHECK( read_all ( lz4 ) == data );
+        }
+
+        {
+            sf::LZ4FileOStream file ( raw.path, options );
+            file.write ( data.data ( ), 250'000 );
+            file.flush ( );
+            CHECK( fs::file_size ( raw.path ) >= 250'000u );
+            {
+                std::ifstream written ( raw.path, std::ios::binary );
+                std::string head ( 250'000u, '\0' );
+                written.read ( head.data ( ), static_cast<std::streamsize> ( head.size ( ) ) );
+                CHECK( written and 0 == data.compare ( 0u, head.size ( ), head ) );
+            }
+            file.write ( data.data ( ) + 250'000, static_cast<std::streamsize> ( data.size ( ) - 250'000u ) );
+            file.close ( );
+        }
+        CHECK( fs::file_size ( raw.path ) == data.size ( ) );
+        sf::LZ4FileIStream file ( raw.path, options );
+        std::mt19937 rng ( 11u );
+        char bytes[ 10 ];
+        for ( int i = 0; i < 200; ++i ) {
+            std::size_t const position = rng ( ) % ( data.size ( ) - sizeof ( bytes ) );
+            file.seekg ( static_cast<std::streamoff> ( position ) );
+            file.read ( bytes, sizeof ( bytes ) );
+            CHECK( file and 0 == data.compare ( position, sizeof ( bytes ), bytes, sizeof ( bytes ) ) );
+        }
+    }
+}
+
+// Writes of varying sizes through ZstdOStream, with flushes, read back through ZstdIStream: with the default buffers, a small
+// write area and a content checksum, and on workers (if the library was built with them).
+void check_zstd ( ) {
+    std::string const data = make_text ( 2u << 20, 12u );
+    bool const has_workers = ZSTD_cParam_getBounds ( ZSTD_c_nbWorkers ).upperBound > 0;
+    for ( int mode = 0; mode < 3; ++mode ) {
+        sf::ZstdOptions options;
+        options.compression_level = 2 == mode ? 9 : 1 == mode ? -1 : 0;
+        options.content_checksum  = 1 == mode;
+        options.buffer_size       = 1 == mode ? 1000u : 0u;
+        options.workers           = 2 == mode ? 2u : 0u;
+        std::stringstream stream;
+        if ( 2 == mode and not has_workers ) {
+            CHECK( throws ( [ & ] { sf::ZstdOStream zstd ( stream, options ); } ) );
+            continue;
+        }
+        {
+            sf::ZstdOStream zstd ( stream, options );
+            std::mt19937 rng ( 12u );
+            for ( std::size_t position = 0u; position < data.size ( ); ) {
+                std::size_t const size = std::min<std::size_t> ( 1u + rng ( ) % 100'000u, data.size ( ) - position );
+                zstd.write ( data.data ( ) + position, static_cast<std::streamsize> ( size ) );
+                position += size;
+                if ( 0u == rng ( ) % 8u )
+                    zstd.flush ( );
+            }
+            zstd.close ( );
+        }
+        CHECK( stream.str ( ).size ( ) < data.size ( ) );
+        sf::ZstdIStream zstd ( stream, options );
+        CHECK( read_all ( zstd ) == data );
+    }
+
+    // A content size that doesn't match throws on close.
+    sf::ZstdOptions options;
+    options.content_size = 1000u;
+    std::ostringstream sink;
+    sf::ZstdOStream zstd ( sink, options );
+    zstd << "too short";
+    CHECK( throws ( [ & ] { zstd.close ( ); } ) );
+}
+
+// A raw content dictionary (any data of the kind, zstd takes it as is), and frames without and with it concatenated, read as
+// one stream; the position is reported, but the stream can't seek.
+void check_zstd_frames ( ) {
+    std::string const sample = make_text ( 64u * 1024u, 13u, 1 );
+    sf::ZstdDictionary const dictionary ( sample.data ( ), sample.size ( ), 3 );
+    std::string const data = make_text ( 2000u, 14u, 1 );
+    std::string compressed[ 2 ];
+    for ( int i = 0; i < 2; ++i ) {
+        std::stringstream stream;
+        {
+            std::unique_ptr<sf::ZstdOStream> const zstd = i ? std::make_unique<sf::ZstdOStream> ( stream, dictionary )
+                                                             : std::make_unique<sf::ZstdOStream> ( stream );
+            *zstd << data;
+            zstd->close ( );
+        }
+        std::unique_ptr<sf::ZstdIStream> const zstd = i ? std::make_unique<sf::ZstdIStream> ( stream, dictionary )
+                                                         : std::make_unique<sf::ZstdIStream> ( stream );
+        CHECK( read_all ( *zstd ) == data );
+        compressed[ i ] = stream.str ( );
+    }
+    CHECK( compressed[ 1 ].size ( ) < compressed[ 0 ].size ( ) );
+
+    std::istringstream source ( compressed[ 0 ] + compressed[ 0 ] );
+    sf::ZstdIStream zstd ( source );
+    char bytes[ 100 ];
+    zstd.read ( bytes, sizeof ( bytes ) );
+    CHECK( zstd and 0 == data.compare ( 0u, sizeof ( bytes ), bytes, sizeof ( bytes ) ) );
+    CHECK( static_cast<std::streamoff> ( sizeof ( bytes ) ) == zstd.tellg ( ) );
+    CHECK( read_all ( zstd ) == data.substr ( sizeof ( bytes ) ) + data );
+    zstd.clear ( );
+    zstd.seekg ( 0 );
+    CHECK( zstd.fail ( ) );
+}
+
+#ifdef ROUND_TRIP_CEREAL
+// A record of the kind an archive holds, of the arithmetic types and contiguous ranges cereal writes as they are.
+struct Record {
+    std::uint64_t id = 0u;
+    double value     = 0.0;
+    std::array<std::uint16_t, 6> fields{};
+    bool flag = false;
+
+    template<typename Archive>
+    void serialize ( Archive & archive_ ) {
+        archive_ ( id, value, fields, flag );
+    }
+
+    [[nodiscard]] bool operator== ( Record const & other_ ) const noexcept {
+        return id == other_.id and value == other_.value and fields == other_.fields and flag == other_.flag;
+    }
+};
+
+[[nodiscard]] std::vector<Record> make_records ( std::size_t const size_, unsigned int const seed_ ) {
+    std::mt19937 rng ( seed_ );
+    std::vector<Record> records ( size_ );
+    for ( std::size_t i = 0u; i < records.size ( ); ++i ) {
+        Record & record = records[ i ];
+        record.id       = i;
+        record.value    = static_cast<double> ( rng ( ) % 1000u ) / 8.0;
+        for ( std::uint16_t & field : record.fields )
+            field = static_cast<std::uint16_t> ( rng ( ) % 16u );
+        record.flag = rng ( ) % 2u;
+    }
+    return records;
+}
+
+// The archives, and the format of cereal::BinaryOutputArchive (cereal::BinaryInputArchive) over the compressed streams.
+void check_archives ( ) {
+    std::vector<Record> const records = make_records ( 50'000u, 15u );
+    std::stringstream stream;
+    {
+        sf::LZ4OutputArchive archive ( stream );
+        for ( Record const & record : records )
+            archive ( record );
+        archive.close ( );
+    }
+    std::string const compressed = stream.str ( );
+    {
+        std::istringstream source ( compressed );
+        sf::LZ4InputArchive archive ( source );
+        Record record;
+        for ( Record const & expected : records ) {
+            archive ( record );
+            CHECK( record == expected );
+        }
+        // Reading past the end throws.
+        CHECK( throws ( [ & ] { archive ( record ); } ) );
+    }
+    {
+        std::istringstream source ( compressed );
+        sf::LZ4InputStream lz4 ( source );
+        cereal::BinaryInputArchive archive ( lz4 );
+        Record record;
+        for ( Record const & expected : records ) {
+            archive ( record );
+            CHECK( record == expected );
+        }
+    }
+    {
+        std::stringstream binary;
+        {
+            sf::LZ4OutputStream lz4 ( binary );
+            cereal::BinaryOutputArchive archive ( lz4 );
+            for ( Record const & record : records )
+                archive ( record );
+            lz4.close ( );
+        }
+        sf::LZ4InputArchive archive ( binary );
+        Record record;
+        for ( Record const & expected : records ) {
+            archive ( record );
+            CHECK( record == expected );
+        }
+    }
+
+    std::string const sample = make_text ( 64u * 1024u, 16u );
+    sf::ZstdDictionary const dictionary ( sample.data ( ), sample.size ( ) );
+    std::stringstream zstd;
+    {
+        sf::ZstdOutputArchive archive ( zstd, dictionary );
+        for ( Record const & record : records )
+            archive ( record );
+        archive.close ( );
+    }
+    sf::ZstdInputArchive archive ( zstd, dictionary );
+    Record record;
+    for ( Record const & expected : records ) {
+        archive ( record );
+        CHECK( record == expected );
+    }
+    CHECK( throws ( [ & ] { archive ( record ); } ) );
+}
+
+// Whether loading the chunked archive in [ data_, data_ + size_ ) throws.
+template<typename Archive>
+[[nodiscard]] bool rejects ( char const * data_, std::size_t const size_ ) {
+    return throws ( [ & ] {
+        Archive archive ( data_, size_ );
+        std::vector<Record> records;
+        archive.load ( records, 1u );
+    } );
+}
+
+// Chunked archives, behind a prefix, loaded on one and more threads, from memory and from file, read in sequence by a plain
+// archive, and with corrupt directories.
+template<typename OutputArchive, typename InputArchive, typename SequentialArchive>
+void check_chunked ( typename InputArchive::Options const & options_ ) {
+    std::vector<Record> const records = make_records ( 100'000u, 17u );
+    std::string const prefix          = "a frame of something else";
+    std::stringstream stream;
+    stream << prefix;
+    {
+        OutputArchive archive ( stream, 7000u, options_ );
+        archive.add ( records );
+        archive.close ( );
+    }
+    std::string const compressed = stream.str ( );
+    InputArchive const archive ( compressed.data ( ), compressed.size ( ), options_ );
+    CHECK( archive.size ( ) == records.size ( ) and archive.chunks ( ) == ( records.size ( ) + 6999u ) / 7000u );
+    for ( unsigned int const threads : { 1u, 3u } ) {
+        std::vector<Record> loaded;
+        archive.load ( loaded, threads );
+        CHECK( loaded == records );
+    }
+
+    {
+        std::istringstream source ( compressed.substr ( prefix.size ( ) ) );
+        SequentialArchive sequential ( source, options_ );
+        Record record;
+        for ( Record const & expected : records ) {
+            sequential ( record );
+            CHECK( record == expected );
+        }
+    }
+
+    TemporaryFile const file ( "lz4_round_trip.chunked" );
+    {
+        std::ofstream written ( file.path, std::ios::binary );
+        written.write ( compressed.data ( ), static_cast<std::streamsize> ( compressed.size ( ) ) );
+    }
+    std::vector<Record> loaded;
+    InputArchive ( file.path, options_ ).load ( loaded, 2u );
+    CHECK( loaded == records );
+
+    // Corrupt directories: without one, with more entries than the data holds, with records or chunk sizes beyond bounds.
+    std::size_t const directory = compressed.size ( ) - ( 16u + 16u * archive.chunks ( ) );
+    std::string corrupt         = compressed.substr ( compressed.size ( ) - 8u );
+    corrupt[ 0 ]                = static_cast<char> ( 0xFF );
+    corrupt[ 1 ]                = static_cast<char> ( 0xFF );
+    CHECK( rejects<InputArchive> ( corrupt.data ( ), corrupt.size ( ) ) );
+    CHECK( rejects<InputArchive> ( compressed.data ( ) + compressed.size ( ) - 20u, 20u ) );
+    CHECK( rejects<InputArchive> ( compressed.data ( ), compressed.size ( ) - 1u ) );
+    corrupt                         = compressed;
+    corrupt[ directory + 16u + 7u ] = static_cast<char> ( 0x7F );
+    CHECK( rejects<InputArchive> ( corrupt.data ( ), corrupt.size ( ) ) );
+    corrupt                        = compressed;
+    corrupt[ directory + 8u + 6u ] = static_cast<char> ( 0x7F );
+    CHECK( rejects<InputArchive> ( corrupt.data ( ), corrupt.size ( ) ) );
+}
+
+void check_chunked_lz4 ( ) {
+    check_chunked<sf::LZ4ChunkedOutputArchive, sf::LZ4ChunkedInputArchive, sf::LZ4InputArchive> ( sf::LZ4Options ( ) );
+}
+
+void check_chunked_zstd ( ) {
+    sf::ZstdOptions options;
+    options.compression_level = 3;
+    check_chunked<sf::ZstdChunkedOutputArchive, sf::ZstdChunkedInputArchive, sf::ZstdInputArchive> ( options );
+}
+#endif
+
+struct Check {
+    char const * name;
+    void ( *run ) ( );
+};
+
+Check const checks[] = {
+    { "plain", check_plain },
+    { "dictionaries", check_dictionaries },
+    { "seekable", check_seekable },
+    { "parallel", check_parallel },
+    { "async, compact, read-ahead", check_buffering },
+    { "incompressible", check_incompressible },
+    { "frames", check_frames },
+    { "messages", check_messages },
+    { "snapshots", check_snapshots },
+    { "batches", check_batches },
+    { "files", check_files },
+    { "zstd", check_zstd },
+    { "zstd frames, dictionary", check_zstd_frames },
+#ifdef ROUND_TRIP_CEREAL
+    { "archives", check_archives },
+    { "chunked lz4", check_chunked_lz4 },
+    { "chunked zstd", check_chunked_zstd },
+#endif
+};
+
+// Runs the check, returns whether it passed.
+[[nodiscard]] bool run ( Check const & check_ ) {
+    try {
+        check_.run ( );
+        std::printf ( "%-28s ok\n", check_.name );
+        return true;
+    }
+    catch ( CheckFailure const & failure ) {
+        std::printf ( "%-28s FAILED, line %d: %s\n", check_.name, failure.line, failure.condition );
+    }
+    catch ( std::exception const & exception ) {
+        std::printf ( "%-28s FAILED, threw \"%s\"\n", check_.name, exception.what ( ) );
+    }
+    return false;
+}
+
+} // namespace
+
+int main ( ) {
+    bool ok = true;
+    for ( Check const & check : checks )
+        ok = run ( check ) and ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,183 @@
+// MIT License
+//
+// Copyright (c) 2019 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Extensions/ZstdStream.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include <zstd.h>
+
+namespace sf {
+
+ZstdDictionary::ZstdDictionary ( ZstdDictionary && other_ ) noexcept { *this = std::move ( other_ ); }
+
+ZstdDictionary::ZstdDictionary ( std::filesystem::path const & path_, int const compression_level_ ) {
+    loadFromFile ( path_, compression_level_ );
+}
+
+ZstdDictionary::ZstdDictionary ( void const * data_, std::size_t const size_, int const compression_level_ ) {
+    loadFromMemory ( data_, size_, compression_level_ );
+}
+
+ZstdDictionary::~ZstdDictionary ( ) { reset ( ); }
+
+[[maybe_unused]] ZstdDictionary const & ZstdDictionary::operator= ( ZstdDictionary && other_ ) noexcept {
+    if ( this != &other_ ) {
+        reset ( );
+        cdict        = other_.cdict;
+        ddict        = other_.ddict;
+        other_.cdict = nullptr;
+        other_.ddict = nullptr;
+    }
+    return *this;
+}
+
+void ZstdDictionary::loadFromFile ( std::filesystem::path const & path_, int const compression_level_ ) {
+    std::ifstream stream ( path_, std::ios::binary );
+    if ( not stream )
+        throw std::runtime_error ( "Failed to open zstd-dictionary." );
+    std::vector<char> const bytes ( ( std::istreambuf_iterator<char> ( stream ) ), std::istreambuf_iterator<char> ( ) );
+    loadFromMemory ( bytes.data ( ), bytes.size ( ), compression_level_ );
+}
+
+// Both dictionaries copy the bytes.
+void ZstdDictionary::loadFromMemory ( void const * data_, std::size_t const size_, int const compression_level_ ) {
+    if ( 0u == size_ )
+        throw std::runtime_error ( "Size of zstd-dictionary is 0." );
+    reset ( );
+    cdict = ZSTD_createCDict ( data_, size_, compression_level_ ? compression_level_ : ZSTD_CLEVEL_DEFAULT );
+    ddict = ZSTD_createDDict ( data_, size_ );
+    if ( not cdict or not ddict ) {
+        reset ( );
+        throw std::runtime_error ( "Failed to load zstd-dictionary." );
+    }
+}
+
+void ZstdDictionary::reset ( ) noexcept {
+    ZSTD_freeCDict ( cdict );
+    ZSTD_freeDDict ( ddict );
+    cdict = nullptr;
+    ddict = nullptr;
+}
+
+ZstdCodec::Encoder::Encoder ( Options const & options_, Dictionary const * dictionary_ ) :
+    m_write_area ( ( options_.buffer_size ? options_.buffer_size : ZSTD_CStreamInSize ( ) ) + 1u ), // One for overflow.
+    m_buffer ( ZSTD_CStreamOutSize ( ) ) {
+    m_context = ZSTD_createCCtx ( );
+    if ( not m_context )
+        throw std::runtime_error ( "Error during zstd stream creation" );
+    // Multi-threading fails here if the library was built without it.
+    if ( ZSTD_isError ( ZSTD_CCtx_setParameter ( m_context, ZSTD_c_compressionLevel,
+                                                 options_.compression_level ? options_.compression_level
+                                                                            : ZSTD_CLEVEL_DEFAULT ) ) or
+         ZSTD_isError ( ZSTD_CCtx_setParameter ( m_context, ZSTD_c_checksumFlag, options_.content_checksum ) ) or
+         ZSTD_isError ( ZSTD_CCtx_setParameter ( m_context, ZSTD_c_nbWorkers, static_cast<int> ( options_.workers ) ) ) or
+         ( options_.content_size and ZSTD_isError ( ZSTD_CCtx_setPledgedSrcSize ( m_context, options_.content_size ) ) ) or
+         ( dictionary_ and ZSTD_isError ( ZSTD_CCtx_refCDict ( m_context, dictionary_->cdict ) ) ) ) {
+        ZSTD_freeCCtx ( m_context );
+        throw std::runtime_error ( "Error during zstd stream creation" );
+    }
+}
+
+ZstdCodec::Encoder::~Encoder ( ) { ZSTD_freeCCtx ( m_context ); }
+
+char * ZstdCodec::Encoder::compress ( std::size_t const size_ ) {
+    compress ( m_write_area.data ( ), size_, ZSTD_e_continue );
+    return m_write_area.data ( );
+}
+
+void ZstdCodec::Encoder::update ( char const * data_, std::size_t const size_ ) { compress ( data_, size_, ZSTD_e_continue ); }
+
+int ZstdCodec::Encoder::sync ( ) {
+    compress ( nullptr, 0u, ZSTD_e_flush );
+    return m_sink->pubsync ( );
+}
+
+void ZstdCodec::Encoder::end ( ) {
+    compress ( nullptr, 0u, ZSTD_e_end );
+    m_sink->pubsync ( );
+}
+
+// Continues until all input is consumed and, when flushing or ending, until zstd holds nothing back.
+void ZstdCodec::Encoder::compress ( char const * data_, std::size_t const size_, ZSTD_EndDirective const directive_ ) {
+    ZSTD_inBuffer input{ data_, size_, 0u };
+    std::size_t remaining = 0u;
+    do {
+        ZSTD_outBuffer output{ m_buffer.data ( ), m_buffer.size ( ), 0u };
+        remaining = ZSTD_compressStream2 ( m_context, &output, &input, directive_ );
+        if ( ZSTD_isError ( remaining ) )
+            throw std::runtime_error ( ZSTD_e_end == directive_ ? "Error during zstd stream finalization"
+                                                                : "Error during zstd stream writing" );
+        m_sink->sputn ( m_buffer.data ( ), output.pos );
+    } while ( ZSTD_e_continue == directive_ ? input.pos < input.size : 0u != remaining );
+}
+
+ZstdCodec::Decoder::Decoder ( Options const & options_, Dictionary const * dictionary_ ) :
+    m_src_buffer ( options_.buffer_size ? options_.buffer_size : ZSTD_DStreamInSize ( ) ),
+    m_read_area ( ZSTD_DStreamOutSize ( ) ) {
+    m_context = ZSTD_createDCtx ( );
+    if ( not m_context )
+        throw std::runtime_error ( "Error during zstd istream creation" );
+    if ( dictionary_ and ZSTD_isError ( ZSTD_DCtx_refDDict ( m_context, dictionary_->ddict ) ) ) {
+        ZSTD_freeDCtx ( m_context );
+        throw std::runtime_error ( "Error during zstd istream creation" );
+    }
+}
+
+ZstdCodec::Decoder::~Decoder ( ) { ZSTD_freeDCtx ( m_context ); }
+
+void ZstdCodec::Decoder::begin ( std::streambuf * source_ ) noexcept {
+    m_source  = source_;
+    m_src     = m_src_end = m_src_buffer.data ( );
+    m_pending = false;
+}
+
+char * ZstdCodec::Decoder::next ( std::size_t & size_ ) {
+    size_ = decompress ( m_read_area.data ( ), m_read_area.size ( ) );
+    return m_read_area.data ( );
+}
+
+// Decompresses into dest_, returns the number of bytes written, 0 at the end of the source.
+std::size_t ZstdCodec::Decoder::decompress ( char * const dest_, std::size_t const capacity_ ) {
+    while ( true ) {
+        // A frame that filled the destination may hold more output, it's drained before reading on.
+        if ( m_src == m_src_end and not m_pending ) {
+            m_src     = m_src_buffer.data ( );
+            m_src_end = m_src + m_source->sgetn ( m_src_buffer.data ( ), m_src_buffer.size ( ) );
+            if ( m_src == m_src_end )
+                return 0u;
+        }
+        ZSTD_inBuffer input{ m_src, static_cast<std::size_t> ( m_src_end - m_src ), 0u };
+        ZSTD_outBuffer output{ dest_, capacity_, 0u };
+        if ( ZSTD_isError ( ZSTD_decompressStream ( m_context, &output, &input ) ) )
+            throw std::runtime_error ( "Error during zstd decompression" );
+        m_src += input.pos;
+        m_pending = output.pos == capacity_;
+        if ( output.pos )
+            return output.pos;
+    }
+}
+
+} // namespace sf
@@ -26,6 +26,7 @@
 #include <cstdint>
 #include <cstdlib>
 
+#include <algorithm>
 #include <array>
 #include <filesystem>
 #include <fstream>
@@ -43,18 +44,11 @@
 #include <cereal/cereal.hpp>
 #include <cereal/types/array.hpp>
 
+#include "Extensions/CompressedArchive.h"
 #include "Extensions/LZ4Stream.h"
 
-#include <compressed_streams/lz4_stream.h>
-
 #include <lz4stream.hpp>
 
-#ifdef _DEBUG
-#    pragma comment( lib, "compressed_streams.lib" )
-#else
-#    pragma comment( lib, "compressed_streams.lib" )
-#endif
-
 namespace fs = std::filesystem;
 
 void handleEptr ( std::exception_ptr eptr ) { // Passing by value is ok.
@@ -73,34 +67,122 @@ void saveToFileLZ4 ( const T & t_, fs::path && path_, std::string && file_name_,
     std::ofstream compressed_ostream ( path_ / ( file_name_ + std::string ( ".lz4cereal" ) ),
                                        append_ ? std::ios::binary | std::ios::app | std::ios::out
                                                : std::ios::binary | std::ios::out );
-    {
-        sf::LZ4OutputStream lz4_ostream ( compressed_ostream, 0 );
-        {
-            cereal::BinaryOutputArchive archive ( lz4_ostream );
-            archive ( t_ );
-        }
-        lz4_ostream.flush ( );
+    if constexpr ( std::is_trivially_copyable_v<T> )
+        sf::LZ4Frame::save ( compressed_ostream, t_, compression_level_ );
+    else {
+        sf::LZ4Options options;
+        options.compression_level = compression_level_;
+        // Embedded JPEGs and other compressed blobs are stored as they are, instead of taking a high compression pass each.
+        // LZ4F can only store independent blocks uncompressed.
+        options.block_mode           = LZ4F_blockIndependent;
+        options.incompressible_ratio = 0.95;
+        sf::LZ4OutputArchive archive ( compressed_ostream, options );
+        archive ( t_ );
     }
     compressed_ostream.flush ( );
     compressed_ostream.close ( );
 }
 
+// Loads the last of the frames appended by saveToFileLZ4 ( ), the earlier ones are skipped without decompressing them.
 template<typename T>
 void loadFromFileLZ4 ( T & t_, fs::path && path_, std::string && file_name_ ) noexcept {
     std::ifstream compressed_istream ( path_ / ( file_name_ + std::string ( ".lz4cereal" ) ), std::ios::binary );
-    compressed_streams::Lz4IStream lz4_istream ( compressed_istream );
-    {
-        cereal::BinaryInputArchive archive ( lz4_istream );
+    std::vector<sf::LZ4FrameInfo> const frames = sf::LZ4FrameScanner::list ( compressed_istream );
+    auto const last = std::find_if ( frames.rbegin ( ), frames.rend ( ),
+                                     [] ( sf::LZ4FrameInfo const & frame_ ) { return not frame_.skippable ( ); } );
+    if ( frames.rend ( ) != last )
+        compressed_istream.seekg ( last->offset );
+    // Files saved before saveToFileLZ4 ( ) used LZ4Frame hold a cereal archive, its frame has no content size.
+    [[maybe_unused]] bool const archived = frames.rend ( ) != last and not last->content_size;
+    if constexpr ( std::is_trivially_copyable_v<T> ) {
+        if constexpr ( cereal::traits::is_input_serializable<T, sf::LZ4InputArchive>::value ) {
+            if ( archived ) {
+                sf::LZ4InputArchive archive ( compressed_istream );
+                archive ( t_ );
+                compressed_istream.close ( );
+                return;
+            }
+        }
+        sf::LZ4Frame::load ( compressed_istream, t_ );
+    }
+    else {
+        sf::LZ4InputArchive archive ( compressed_istream );
         archive ( t_ );
     }
     compressed_istream.close ( );
 }
 
+// Saves the records as a chunked archive, loadFromFileLZ4Chunked ( ) deserializes its chunks in parallel.
+template<typename T>
+void saveToFileLZ4Chunked ( std::vector<T> const & records_, fs::path && path_, std::string && file_name_,
+                            const int compression_level_ = 9 ) noexcept {
+    std::ofstream compressed_ostream ( path_ / ( file_name_ + std::string ( ".lz4chunks" ) ), std::ios::binary | std::ios::out );
+    sf::LZ4Options options;
+    options.compression_level = compression_level_;
+    {
+        sf::LZ4ChunkedOutputArchive archive ( compressed_ostream, 16u * 1024u, options );
+        archive.add ( records_ );
+    }
+    compressed_ostream.close ( );
+}
+
+template<typename T>
+void loadFromFileLZ4Chunked ( std::vector<T> & records_, fs::path && path_, std::string && file_name_ ) noexcept {
+    sf::LZ4ChunkedInputArchive archive ( path_ / ( file_name_ + std::string ( ".lz4chunks" ) ) );
+    archive.load ( records_ );
+}
+
+// Appends a snapshot of t_ (serialized with cereal) to snapshots_, compressed against the snapshot saved before it.
+template<typename T>
+void saveSnapshotLZ4 ( const T & t_, sf::LZ4SnapshotWriter & snapshots_ ) noexcept {
+    std::ostringstream serialized ( std::ios::binary | std::ios::out );
+    {
+        cereal::BinaryOutputArchive archive ( serialized );
+        archive ( t_ );
+    }
+    std::string const bytes = serialized.str ( );
+    snapshots_.write ( bytes.data ( ), bytes.size ( ) );
+}
+
+// Loads the last of the snapshots saved by saveSnapshotLZ4 ( ) to path_ / file_name_.lz4snapshots, replaying the deltas
+// from the last base on, the snapshots before it are skipped without decompressing them.
+template<typename T>
+void loadLastSnapshotLZ4 ( T & t_, fs::path && path_, std::string && file_name_ ) noexcept {
+    std::ifstream compressed_istream ( path_ / ( file_name_ + std::string ( ".lz4snapshots" ) ), std::ios::binary );
+    sf::LZ4SnapshotReader snapshots ( compressed_istream );
+    snapshots.seekLastBase ( );
+    char const * last     = nullptr;
+    std::size_t last_size = 0u, size;
+    for ( char const * snapshot = snapshots.read ( size ); snapshot; snapshot = snapshots.read ( size ) )
+        last = snapshot, last_size = size;
+    if ( last ) {
+        std::istringstream serialized ( std::string ( last, last_size ), std::ios::binary | std::ios::in );
+        cereal::BinaryInputArchive archive ( serialized );
+        archive ( t_ );
+    }
+}
+
 int main ( ) {
 
     std::array<int, 16> a{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
 
     saveToFileLZ4 ( a, "y://tmp//", "cstest" );
+    loadFromFileLZ4 ( a, "y://tmp//", "cstest" );
+
+    std::vector<std::array<int, 16>> records ( 100'000, a );
+
+    saveToFileLZ4Chunked ( records, "y://tmp//", "cstest" );
+    loadFromFileLZ4Chunked ( records, "y://tmp//", "cstest" );
+
+    {
+        std::ofstream compressed_ostream ( fs::path ( "y://tmp//" ) / "cstest.lz4snapshots", std::ios::binary | std::ios::out );
+        sf::LZ4SnapshotWriter snapshots ( compressed_ostream, 0, 16u );
+        for ( int i = 0; i < 64; ++i ) {
+            a[ i % a.size ( ) ] += i;
+            saveSnapshotLZ4 ( a, snapshots );
+        }
+    }
+    loadLastSnapshotLZ4 ( a, "y://tmp//", "cstest" );
 
     return EXIT_SUCCESS;
 }